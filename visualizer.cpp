@@ -2,12 +2,22 @@
  * Dual SSD1309 OLED Audio Visualizer for Raspberry Pi
  * Optimized C++ implementation using bcm2835 library
  * 
- * Compile: g++ -o visualizer visualizer.cpp -lbcm2835 -lpthread -lasound -lfftw3f -lm -O3 -march=native -lfreetype
+ * Compile: g++ -o visualizer visualizer.cpp -lbcm2835 -lpthread -lasound -lfftw3f -ljpeg -lm -O3 -march=native -lfreetype \
+ *          $(pkg-config --cflags --libs dbus-1)
+ * Options: -DAAV_BANDS=7|16|32|64 (spectrum band count, default 7)
+ *          -DAAV_NO_FFTW (built-in Q15 FFT only, drop -lfftw3f)
+ *          -DAAV_NO_JPEG (no album art decoding, drop -ljpeg)
+ *          -DAAV_NO_MPRIS (no MPRIS players over D-Bus, drop dbus-1)
  */
 
 #include <bcm2835.h>
 #include <alsa/asoundlib.h>
+#ifndef AAV_NO_FFTW
 #include <fftw3.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include <cmath>
 #include <cstring>
 #include <cstdio>
@@ -17,13 +27,44 @@
 #include <chrono>
 #include <array>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
 #include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/ioctl.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <ft2build.h>
 #include <mpd/client.h>
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <vector>
+#include <map>
+#include <complex>
 #include FT_FREETYPE_H
+#ifndef AAV_NO_JPEG
+#include <jpeglib.h>  // Needs <cstdio> first
+#include <setjmp.h>
+#endif
+#ifndef AAV_NO_MPRIS
+#include <dbus/dbus.h>
+#endif
+
+#ifndef AAV_BANDS
+#define AAV_BANDS 7
+#endif
+
+// Views cycled by rotary 1, in VisualizerApp::visualizations order
+constexpr int VISUALIZATION_COUNT = 7;
+constexpr int VU_METER_VIEW = 0;
+constexpr int PLAYER_INFO_VIEW = 6;
 
 // Forward declarations
 class Display;
@@ -48,52 +89,576 @@ namespace GPIO {
     constexpr uint8_t POWER_SW = 13;
 }
 
-// Improved MPD Client that respects sleep state
-class MPDClient {
+// Single-writer record published with atomic_store on a shared_ptr. T carries
+// its own version field, which publish() stamps; readers check version() first
+// and only load() when it moved.
+template <typename T>
+class Snapshot {
 private:
-    struct mpd_connection* conn;
-    std::thread mpd_thread;
-    std::atomic<bool> thread_running;
-    std::atomic<bool> shutdown_requested;
-    std::atomic<bool> is_sleeping;  // Track sleep state
-    std::mutex data_mutex;
-    std::mutex conn_mutex;
+    std::shared_ptr<const T> current;
+    std::atomic<uint64_t> current_version{0};
+    
+public:
+    void publish(const T& value) {
+        auto published = std::make_shared<T>(value);
+        published->version = current_version.load(std::memory_order_relaxed) + 1;
+        std::atomic_store(&current, std::shared_ptr<const T>(published));
+        current_version.store(published->version, std::memory_order_release);
+    }
     
-    // Current song info
+    std::shared_ptr<const T> load() const { return std::atomic_load(&current); }
+    uint64_t version() const { return current_version.load(std::memory_order_acquire); }
+};
+
+// Current song as published by a PlayerSource. Never modified after publishing,
+// so readers may keep the pointer and compare versions instead of strings.
+struct TrackMetadata {
+    uint64_t version = 0;
+    int song_id = -1;  // MPD song id (a per-source counter elsewhere), -1 when nothing is queued
+    std::string uri;
     std::string track_number;
     std::string title;
     std::string artist;
+    std::string album;
     std::string year;
     std::string formatted_text;
+};
+
+// Cover thumbnail in display page format: 8 pages of 64 columns, bit = row % 8
+struct AlbumArt {
+    static constexpr int SIZE = 64;
+    static constexpr size_t BYTES = SIZE * SIZE / 8;
     
-    // Connection parameters
-    std::string host;
-    int port;
-    static constexpr int RECONNECT_DELAY_SEC = 5;
-    static constexpr int SLEEP_CHECK_INTERVAL_MS = 500;  // Check sleep state every 500ms
+    uint64_t version = 0;
+    int song_id = -1;
+    bool present = false;  // False when the song has no usable cover
+    std::array<uint8_t, BYTES> bitmap{};
+};
+
+// Downscales a cover image to an AlbumArt bitmap with Floyd-Steinberg dithering
+class CoverDecoder {
+private:
+#ifndef AAV_NO_JPEG
+    struct JPEGError {
+        struct jpeg_error_mgr mgr;
+        jmp_buf jump;
+    };
+    
+    static void onJPEGError(j_common_ptr cinfo) {
+        char message[JMSG_LENGTH_MAX];
+        (*cinfo->err->format_message)(cinfo, message);
+        printf("Cover decode error: %s\n", message);
+        longjmp(((JPEGError*)cinfo->err)->jump, 1);
+    }
+    
+    // Grayscale decode at the smallest libjpeg scale (1/1..1/8) that still
+    // covers SIZE pixels, so large covers never decode at full resolution
+    static bool decodeJPEG(const std::vector<uint8_t>& data, std::vector<uint8_t>& gray, int& width, int& height) {
+        struct jpeg_decompress_struct cinfo;
+        JPEGError error;
+        cinfo.err = jpeg_std_error(&error.mgr);
+        error.mgr.error_exit = onJPEGError;
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&cinfo);
+            return false;
+        }
+        
+        jpeg_create_decompress(&cinfo);
+        jpeg_mem_src(&cinfo, data.data(), data.size());
+        jpeg_read_header(&cinfo, TRUE);
+        
+        unsigned short_side = std::min(cinfo.image_width, cinfo.image_height);
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = 1;
+        while (cinfo.scale_denom < 8 && short_side / (cinfo.scale_denom * 2) >= (unsigned)AlbumArt::SIZE) {
+            cinfo.scale_denom *= 2;
+        }
+        cinfo.out_color_space = JCS_GRAYSCALE;
+        cinfo.dct_method = JDCT_IFAST;
+        jpeg_start_decompress(&cinfo);
+        
+        width = cinfo.output_width;
+        height = cinfo.output_height;
+        gray.resize((size_t)width * height);
+        while (cinfo.output_scanline < cinfo.output_height) {
+            JSAMPROW row = gray.data() + (size_t)cinfo.output_scanline * width;
+            jpeg_read_scanlines(&cinfo, &row, 1);
+        }
+        
+        jpeg_finish_decompress(&cinfo);
+        jpeg_destroy_decompress(&cinfo);
+        return true;
+    }
+#endif
+    
+public:
+    // Box-filter the centered square of a grayscale image down to SIZE x SIZE
+    static void downscale(const uint8_t* gray, int width, int height, float* out) {
+        int side = std::min(width, height);
+        int x0 = (width - side) / 2, y0 = (height - side) / 2;
+        
+        for (int ty = 0; ty < AlbumArt::SIZE; ty++) {
+            int sy0 = y0 + ty * side / AlbumArt::SIZE;
+            int sy1 = std::max(sy0 + 1, y0 + (ty + 1) * side / AlbumArt::SIZE);
+            for (int tx = 0; tx < AlbumArt::SIZE; tx++) {
+                int sx0 = x0 + tx * side / AlbumArt::SIZE;
+                int sx1 = std::max(sx0 + 1, x0 + (tx + 1) * side / AlbumArt::SIZE);
+                unsigned sum = 0;
+                for (int sy = sy0; sy < sy1; sy++) {
+                    const uint8_t* row = gray + (size_t)sy * width;
+                    for (int sx = sx0; sx < sx1; sx++) sum += row[sx];
+                }
+                out[ty * AlbumArt::SIZE + tx] = sum / (255.0f * (sy1 - sy0) * (sx1 - sx0));
+            }
+        }
+    }
+    
+    // Stretch contrast, then serpentine Floyd-Steinberg into page format
+    static void dither(float* pixels, uint8_t* bitmap) {
+        const int n = AlbumArt::SIZE;
+        float lo = 1.0f, hi = 0.0f;
+        for (int i = 0; i < n * n; i++) {
+            lo = std::min(lo, pixels[i]);
+            hi = std::max(hi, pixels[i]);
+        }
+        float scale = hi - lo > 0.05f ? 1.0f / (hi - lo) : 1.0f;
+        for (int i = 0; i < n * n; i++) pixels[i] = (pixels[i] - lo) * scale;
+        
+        memset(bitmap, 0, AlbumArt::BYTES);
+        for (int y = 0; y < n; y++) {
+            bool reverse = y & 1;
+            int dir = reverse ? -1 : 1;
+            for (int i = 0; i < n; i++) {
+                int x = reverse ? n - 1 - i : i;
+                float old_value = pixels[y * n + x];
+                float new_value = old_value >= 0.5f ? 1.0f : 0.0f;
+                float err = old_value - new_value;
+                if (new_value > 0.0f) bitmap[(y / 8) * n + x] |= 1 << (y % 8);
+                
+                if (x + dir >= 0 && x + dir < n) pixels[y * n + x + dir] += err * (7.0f / 16.0f);
+                if (y + 1 < n) {
+                    if (x - dir >= 0 && x - dir < n) pixels[(y + 1) * n + x - dir] += err * (3.0f / 16.0f);
+                    pixels[(y + 1) * n + x] += err * (5.0f / 16.0f);
+                    if (x + dir >= 0 && x + dir < n) pixels[(y + 1) * n + x + dir] += err * (1.0f / 16.0f);
+                }
+            }
+        }
+    }
+    
+    // Encoded cover to bitmap; only JPEG is decoded (the usual cover.jpg / embedded APIC)
+    static bool decode(const std::vector<uint8_t>& data, uint8_t* bitmap) {
+#ifndef AAV_NO_JPEG
+        if (data.size() < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+            printf("Cover is not a JPEG (%zu bytes), skipping\n", data.size());
+            return false;
+        }
+        std::vector<uint8_t> gray;
+        int width, height;
+        if (!decodeJPEG(data, gray, width, height) || width < 1 || height < 1) return false;
+        
+        std::vector<float> pixels(AlbumArt::SIZE * AlbumArt::SIZE);
+        downscale(gray.data(), width, height, pixels.data());
+        dither(pixels.data(), bitmap);
+        return true;
+#else
+        return false;
+#endif
+    }
+};
+
+// Dithered covers on disk, one file per album directory, so repeat plays skip
+// the transfer and the JPEG decode. An empty file records "no cover".
+class ArtCache {
+private:
+    std::string directory;
+    
+    static uint64_t fnv1a(const std::string& text) {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (unsigned char c : text) {
+            hash ^= c;
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+    
+    std::string pathFor(const std::string& album_key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.art", (unsigned long long)fnv1a(album_key));
+        return directory + name;
+    }
+    
+public:
+    ArtCache() {
+        const char* cache_home = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        std::string base;
+        if (cache_home && cache_home[0] == '/') {
+            base = cache_home;
+        } else if (home) {
+            base = std::string(home) + "/.cache";
+            mkdir(base.c_str(), 0755);
+        }
+        if (!base.empty()) {
+            directory = base + "/aav";
+            if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+                printf("Album art cache disabled: %s: %s\n", directory.c_str(), strerror(errno));
+                directory.clear();
+            }
+        }
+    }
+    
+    // Covers are per album, so key by the song's directory
+    static std::string albumKey(const std::string& uri) {
+        size_t slash = uri.rfind('/');
+        return slash == std::string::npos ? uri : uri.substr(0, slash);
+    }
+    
+    // True when the album has an entry; art.present tells whether it has a cover
+    bool load(const std::string& album_key, AlbumArt& art) const {
+        if (directory.empty()) return false;
+        FILE* file = fopen(pathFor(album_key).c_str(), "rb");
+        if (!file) return false;
+        size_t got = fread(art.bitmap.data(), 1, AlbumArt::BYTES, file);
+        fclose(file);
+        art.present = got == AlbumArt::BYTES;
+        return got == 0 || art.present;
+    }
+    
+    void store(const std::string& album_key, const AlbumArt& art) const {
+        if (directory.empty()) return;
+        std::string path = pathFor(album_key);
+        std::string temp = path + ".tmp";
+        FILE* file = fopen(temp.c_str(), "wb");
+        if (!file) return;
+        bool ok = !art.present || fwrite(art.bitmap.data(), 1, AlbumArt::BYTES, file) == AlbumArt::BYTES;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(temp.c_str(), path.c_str()) != 0) unlink(temp.c_str());
+    }
+};
+
+// Player position as of the last status exchange. Elapsed time is extrapolated
+// locally between player events, so progress costs no MPD traffic per frame.
+struct PlaybackStatus {
+    uint64_t version = 0;
+    enum mpd_state state = MPD_STATE_UNKNOWN;
+    unsigned elapsed_ms = 0;
+    unsigned duration_ms = 0;
+    unsigned kbit_rate = 0;
+    unsigned sample_rate = 0;
+    uint8_t bits = 0;
+    uint8_t channels = 0;
+    int volume = -1;              // -1 without a mixer
+    uint64_t commands_done = 0;   // Last transport command batch this status reflects
+    std::chrono::steady_clock::time_point synced;  // When elapsed_ms was current
+    
+    float elapsedAt(std::chrono::steady_clock::time_point now) const {
+        float elapsed = elapsed_ms / 1000.0f;
+        if (state == MPD_STATE_PLAY) {
+            elapsed += std::chrono::duration<float>(now - synced).count();
+        }
+        if (duration_ms > 0) elapsed = std::min(elapsed, duration_ms / 1000.0f);
+        return elapsed;
+    }
+    
+    // 0-1 through the current song, 0 for streams without a duration
+    float progressAt(std::chrono::steady_clock::time_point now) const {
+        if (duration_ms == 0 || state == MPD_STATE_STOP) return 0.0f;
+        return elapsedAt(now) / (duration_ms / 1000.0f);
+    }
+};
+
+// Recently seen songs by MPD song id, so player events that return to a known
+// song (prev/next, repeat) skip the tag fetch and formatting
+class TrackCache {
+private:
+    struct Entry {
+        int song_id;
+        unsigned queue_version;  // Ids are stable, but tags and positions can change with the queue
+        uint64_t last_used;
+        std::shared_ptr<const TrackMetadata> track;
+    };
+    
+    std::vector<Entry> entries;
+    uint64_t clock = 0;
+    
+public:
+    static constexpr size_t CAPACITY = 32;
+    
+    std::shared_ptr<const TrackMetadata> find(int song_id, unsigned queue_version) {
+        for (auto& entry : entries) {
+            if (entry.song_id == song_id && entry.queue_version == queue_version) {
+                entry.last_used = ++clock;
+                return entry.track;
+            }
+        }
+        return nullptr;
+    }
+    
+    void insert(int song_id, unsigned queue_version, std::shared_ptr<const TrackMetadata> track) {
+        Entry* slot = nullptr;
+        for (auto& entry : entries) {
+            if (entry.song_id == song_id) { slot = &entry; break; }
+        }
+        if (!slot && entries.size() < CAPACITY) {
+            entries.push_back({});
+            slot = &entries.back();
+        }
+        if (!slot) {
+            // Evict the least recently used song
+            slot = &*std::min_element(entries.begin(), entries.end(),
+                [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+        }
+        *slot = { song_id, queue_version, ++clock, std::move(track) };
+    }
+    
+    void clear() { entries.clear(); }
+};
+
+// eventfd that interrupts a worker thread's poll() (shutdown, sleep, commands)
+class WakeEvent {
+private:
+    int fd;
+    const char* owner;
+    
+public:
+    explicit WakeEvent(const char* owner_name)
+        : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), owner(owner_name) {
+        if (fd < 0) {
+            printf("%s eventfd failed: %s\n", owner, strerror(errno));
+        }
+    }
+    
+    ~WakeEvent() {
+        if (fd >= 0) close(fd);
+    }
+    
+    int get() const { return fd; }
+    
+    void signal() {
+        uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            printf("%s wake signal failed: %s\n", owner, strerror(errno));
+        }
+    }
     
-    void updateFormattedText() {
+    void drain() {
+        uint64_t count;
+        while (read(fd, &count, sizeof(count)) > 0) {}
+    }
+    
+    // Block on the eventfd only; returns early when signalled
+    void wait(int timeout_ms) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            drain();
+        }
+    }
+};
+
+// A player whose state we display: MPD, an MPRIS player on the session bus or
+// shairport-sync. Each source runs its own event thread and publishes whole
+// snapshots; the listener hears about every publish, which is how PlayerArbiter
+// follows all sources without polling them.
+class PlayerSource {
+protected:
+    // Current song and player position, swapped whole on change
+    Snapshot<TrackMetadata> metadata;
+    Snapshot<PlaybackStatus> playback;
+    Snapshot<TrackMetadata> upcoming;  // Next queue entry, empty text at the end of the queue
+    Snapshot<AlbumArt> art_snapshot;
+    std::function<void(PlayerSource*)> listener;
+    
+    // Transport controls waiting for the source thread, merged as they arrive
+    struct PendingCommands {
+        int skip = 0;          // Net tracks, negative for previous
+        int volume = 0;        // Net volume change in percent
+        float seek = 0.0f;     // Net relative seek in seconds
+        bool toggle_pause = false;
+        uint64_t sequence = 0; // Last submitted batch
+        
+        bool empty() const { return skip == 0 && volume == 0 && seek == 0.0f && !toggle_pause; }
+    };
+    std::mutex command_mutex;
+    PendingCommands pending_commands;
+    uint64_t commands_submitted = 0;
+    uint64_t commands_done = 0;  // Source thread only
+    
+    void publishMetadata(const TrackMetadata& track) { metadata.publish(track); notify(); }
+    void publishPlayback(const PlaybackStatus& status) { playback.publish(status); notify(); }
+    void publishUpcoming(const TrackMetadata& track) { upcoming.publish(track); notify(); }
+    void publishArt(const AlbumArt& art) { art_snapshot.publish(art); notify(); }
+    
+    void notify() {
+        if (listener) listener(this);
+    }
+    
+    static void updateFormattedText(TrackMetadata& track) {
         std::stringstream ss;
         
-        if (!track_number.empty()) {
-            ss << std::setfill('0') << std::setw(2) << track_number << ". ";
+        if (!track.track_number.empty()) {
+            ss << std::setfill('0') << std::setw(2) << track.track_number << ". ";
         }
         
-        if (!title.empty()) {
-            ss << title;
+        if (!track.title.empty()) {
+            ss << track.title;
         } else {
             ss << "Unknown Title";
         }
         
-        if (!artist.empty()) {
-            ss << " - " << artist;
+        if (!track.artist.empty()) {
+            ss << " - " << track.artist;
         }
         
-        if (!year.empty()) {
-            ss << " (" << year << ")";
+        if (!track.year.empty()) {
+            ss << " (" << track.year << ")";
         }
         
-        formatted_text = ss.str();
+        track.formatted_text = ss.str();
+    }
+    
+    // Record a transport command and wake the source thread; never blocks on the player
+    template <typename Merge>
+    uint64_t submit(Merge merge) {
+        uint64_t sequence;
+        {
+            std::lock_guard<std::mutex> lock(command_mutex);
+            merge(pending_commands);
+            sequence = pending_commands.sequence = ++commands_submitted;
+        }
+        wakeThread();
+        return sequence;
+    }
+    
+    bool commandsPending() {
+        std::lock_guard<std::mutex> lock(command_mutex);
+        return !pending_commands.empty();
+    }
+    
+    // Everything queued since the last batch, leaving the queue empty
+    PendingCommands takeCommands() {
+        std::lock_guard<std::mutex> lock(command_mutex);
+        PendingCommands batch = pending_commands;
+        pending_commands = PendingCommands();
+        return batch;
+    }
+    
+    virtual void wakeThread() {}
+    
+public:
+    virtual ~PlayerSource() = default;
+    
+    virtual const char* name() const = 0;
+    virtual bool start() = 0;
+    virtual void stop() = 0;
+    virtual void setSleepState(bool sleeping) = 0;
+    
+    // Called on the source's thread after every publish; set before start()
+    void setListener(std::function<void(PlayerSource*)> callback) { listener = std::move(callback); }
+    
+    // Transport controls. They return at once; bursts are merged (twelve volume
+    // steps become one command) and PlaybackStatus::commands_done reports
+    // completion once the new state is published.
+    virtual uint64_t skipTracks(int tracks) {
+        return submit([tracks](PendingCommands& p) { p.skip += tracks; });
+    }
+    
+    virtual uint64_t changeVolume(int delta) {
+        return submit([delta](PendingCommands& p) { p.volume += delta; });
+    }
+    
+    virtual uint64_t seekBy(float seconds) {
+        return submit([seconds](PendingCommands& p) { p.seek += seconds; });
+    }
+    
+    virtual uint64_t togglePause() {
+        return submit([](PendingCommands& p) { p.toggle_pause = !p.toggle_pause; });
+    }
+    
+    // Current song; the record never changes, so it can be held across frames
+    std::shared_ptr<const TrackMetadata> getMetadata() const { return metadata.load(); }
+    
+    // Bumped on every publish; a cheap check before calling getMetadata()
+    uint64_t getMetadataVersion() const { return metadata.version(); }
+    
+    // Player state as of the last event; use elapsedAt()/progressAt() per frame
+    std::shared_ptr<const PlaybackStatus> getPlayback() const { return playback.load(); }
+    uint64_t getPlaybackVersion() const { return playback.version(); }
+    
+    // Cover of the current song's album
+    std::shared_ptr<const AlbumArt> getAlbumArt() const { return art_snapshot.load(); }
+    uint64_t getAlbumArtVersion() const { return art_snapshot.version(); }
+    
+    // Song after the current one, prefetched for title pre-rendering
+    std::shared_ptr<const TrackMetadata> getUpcoming() const { return upcoming.load(); }
+    uint64_t getUpcomingVersion() const { return upcoming.version(); }
+};
+
+// Improved MPD Client that respects sleep state
+class MPDClient : public PlayerSource {
+private:
+    struct mpd_connection* conn;
+    std::thread mpd_thread;
+    std::atomic<bool> thread_running;
+    std::atomic<bool> shutdown_requested;
+    std::atomic<bool> is_sleeping;  // Track sleep state
+    std::mutex conn_mutex;
+    WakeEvent wake;  // Interrupts the idle poll()
+    ArtCache art_cache;
+    std::string current_album_key;  // Album the published art belongs to
+    bool art_pending = false;       // A fetch for the current song was interrupted
+    
+    // Picture transfer interrupted by a command or song change, resumed at its offset
+    std::string partial_art_key;
+    std::vector<uint8_t> partial_art;
+    
+    // What the published record was fetched for (MPD thread only)
+    int current_song_id;
+    int current_next_id;
+    unsigned current_queue_version;
+    TrackCache track_cache;
+    
+    // Connection parameters
+    std::string host;
+    int port;
+    static constexpr int RECONNECT_DELAY_SEC = 5;
+    static constexpr size_t ART_CHUNK_BYTES = 64 * 1024;  // Also requested as the binary limit
+    static constexpr size_t ART_MAX_BYTES = 8 * 1024 * 1024;
+    static constexpr int ART_SONG_CHECK_MS = 250;  // Status check interval during a transfer
+    
+    // How a picture transfer ended: data, the server has none, the server
+    // refused (old MPD, no permission), or we stopped (connection lost,
+    // shutdown, sleep, a command or song change waiting)
+    enum PictureResult { PICTURE_FOUND, PICTURE_NONE, PICTURE_REFUSED, PICTURE_ABORTED };
+    
+    static bool isSocket(const std::string& path) {
+        struct stat st;
+        return !path.empty() && stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+    }
+    
+    // MPD's local Unix socket when talking to this host, empty otherwise
+    std::string findLocalSocket() const {
+        if (!host.empty() && host[0] == '/') return host;
+        if (host != "localhost" && host != "127.0.0.1" && host != "::1") return "";
+        
+        std::vector<std::string> candidates;
+        const char* env_host = getenv("MPD_HOST");
+        if (env_host && env_host[0] == '/') candidates.push_back(env_host);
+        const char* runtime_dir = getenv("XDG_RUNTIME_DIR");
+        if (runtime_dir) candidates.push_back(std::string(runtime_dir) + "/mpd/socket");
+        candidates.push_back("/run/mpd/socket");
+        candidates.push_back("/var/run/mpd/socket");
+        
+        for (const auto& path : candidates) {
+            if (isSocket(path)) return path;
+        }
+        return "";
+    }
+    
+    // Bigger album art chunks than the 8 KiB default; older servers refuse, which is fine
+    void raiseBinaryLimit() {
+        if (!mpd_run_binarylimit(conn, ART_CHUNK_BYTES)) {
+            mpd_connection_clear_error(conn);
+        }
     }
     
     bool connectMPD() {
@@ -106,6 +671,31 @@ private:
         
         if (shutdown_requested || is_sleeping) return false;
         
+        // A restarted MPD reuses song ids for other songs
+        current_song_id = -2;
+        current_next_id = -2;
+        current_album_key.clear();
+        partial_art_key.clear();
+        partial_art.clear();
+        track_cache.clear();
+        
+        // Prefer the local socket: no TCP stack, and it survives a missing loopback
+        std::string socket_path = findLocalSocket();
+        if (!socket_path.empty()) {
+            conn = mpd_connection_new(socket_path.c_str(), 0, 2000);
+            if (conn && mpd_connection_get_error(conn) == MPD_ERROR_SUCCESS) {
+                printf("Connected to MPD at %s\n", socket_path.c_str());
+                raiseBinaryLimit();
+                return true;
+            }
+            if (conn) {
+                printf("MPD socket %s: %s, trying TCP\n", socket_path.c_str(), mpd_connection_get_error_message(conn));
+                mpd_connection_free(conn);
+                conn = nullptr;
+            }
+            if (socket_path == host) return false;
+        }
+        
         conn = mpd_connection_new(host.c_str(), port, 2000);
         
         if (!conn || mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
@@ -118,6 +708,7 @@ private:
         }
         
         printf("Connected to MPD at %s:%d\n", host.c_str(), port);
+        raiseBinaryLimit();
         return true;
     }
     
@@ -130,115 +721,353 @@ private:
         }
     }
     
-    void updateCurrentSong() {
-        std::lock_guard<std::mutex> lock(conn_mutex);
-        if (!conn || shutdown_requested || is_sleeping) return;
-        
-        struct mpd_song* song = mpd_run_current_song(conn);
-        
-        if (mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
-            printf("MPD error getting current song: %s\n", mpd_connection_get_error_message(conn));
-            mpd_connection_free(conn);
-            conn = nullptr;
-            return;
-        }
-        
-        std::lock_guard<std::mutex> data_lock(data_mutex);
+    // Tags and formatted title line for a song (frees it), or the idle text.
+    // Keyed by the song's own id: the status it was looked up from may be
+    // older if the song changed between the two round trips.
+    static std::shared_ptr<const TrackMetadata> makeTrack(struct mpd_song* song) {
+        auto track = std::make_shared<TrackMetadata>();
+        track->song_id = song ? (int)mpd_song_get_id(song) : -1;
         
         if (song) {
             // Get track number
-            unsigned track = mpd_song_get_pos(song) + 1;
-            track_number = std::to_string(track);
+            unsigned number = mpd_song_get_pos(song) + 1;
+            track->track_number = std::to_string(number);
             
             // Get title
             const char* tag = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
-            title = tag ? tag : "";
+            track->title = tag ? tag : "";
             
             // Get artist
             tag = mpd_song_get_tag(song, MPD_TAG_ARTIST, 0);
-            artist = tag ? tag : "";
+            track->artist = tag ? tag : "";
+            
+            // Get album
+            tag = mpd_song_get_tag(song, MPD_TAG_ALBUM, 0);
+            track->album = tag ? tag : "";
+            
+            track->uri = mpd_song_get_uri(song);
             
             // Get year/date
             tag = mpd_song_get_tag(song, MPD_TAG_DATE, 0);
             if (tag && strlen(tag) >= 4) {
-                year = std::string(tag).substr(0, 4);
-            } else {
-                year = "";
+                track->year = std::string(tag).substr(0, 4);
             }
             
             mpd_song_free(song);
         } else {
-            track_number = "";
-            title = "No song playing";
-            artist = "";
-            year = "";
+            track->song_id = -1;
+            track->title = "No song playing";
         }
         
-        updateFormattedText();
+        updateFormattedText(*track);
+        return track;
     }
     
-    void mpdThreadFunc() {
-        printf("MPD thread started\n");
+    static PlaybackStatus makePlayback(const struct mpd_status* status) {
+        PlaybackStatus playback;
+        playback.state = mpd_status_get_state(status);
+        playback.elapsed_ms = mpd_status_get_elapsed_ms(status);
+        playback.duration_ms = mpd_status_get_total_time(status) * 1000;
+        playback.kbit_rate = mpd_status_get_kbit_rate(status);
+        playback.volume = mpd_status_get_volume(status);
+        const struct mpd_audio_format* format = mpd_status_get_audio_format(status);
+        if (format) {
+            playback.sample_rate = format->sample_rate;
+            playback.bits = format->bits;
+            playback.channels = format->channels;
+        }
+        playback.synced = std::chrono::steady_clock::now();
+        return playback;
+    }
+    
+    void dropConnection(const char* what) {
+        printf("MPD error %s: %s\n", what, mpd_connection_get_error_message(conn));
+        mpd_connection_free(conn);
+        conn = nullptr;
+    }
+    
+    // One status exchange per player event; it resyncs the elapsed clock, and
+    // pause, resume and seek stop there. After connecting, status and
+    // currentsong go out together in one command list.
+    void updateCurrentSong() {
+        std::lock_guard<std::mutex> lock(conn_mutex);
+        if (!conn || shutdown_requested || is_sleeping) return;
         
-        while (thread_running && !shutdown_requested) {
-            // Check if we're sleeping
-            if (is_sleeping) {
-                // Disconnect while sleeping to save resources
-                if (conn) {
-                    printf("MPD entering sleep mode - disconnecting\n");
-                    disconnectMPD();
-                }
-                
-                // Wait while sleeping, checking periodically
-                while (is_sleeping && !shutdown_requested) {
-                    std::this_thread::sleep_for(std::chrono::milliseconds(SLEEP_CHECK_INTERVAL_MS));
+        bool full_sync = current_song_id == -2;
+        bool sent = full_sync
+            ? mpd_command_list_begin(conn, true) && mpd_send_status(conn) &&
+              mpd_send_current_song(conn) && mpd_command_list_end(conn)
+            : mpd_send_status(conn);
+        struct mpd_status* status = sent ? mpd_recv_status(conn) : nullptr;
+        if (!status) {
+            dropConnection("getting status");
+            return;
+        }
+        int song_id = mpd_status_get_song_id(status);
+        int next_id = mpd_status_get_next_song_id(status);
+        int next_pos = mpd_status_get_next_song_pos(status);
+        unsigned queue_version = mpd_status_get_queue_version(status);
+        PlaybackStatus now_playing = makePlayback(status);
+        now_playing.commands_done = commands_done;
+        publishPlayback(now_playing);
+        mpd_status_free(status);
+        
+        struct mpd_song* song = nullptr;
+        if (full_sync) {
+            if (mpd_response_next(conn)) song = mpd_recv_song(conn);
+        }
+        if (!mpd_response_finish(conn)) {
+            if (song) mpd_song_free(song);
+            dropConnection("getting current song");
+            return;
+        }
+        
+        if (song_id == current_song_id && queue_version == current_queue_version) {
+            if (song) mpd_song_free(song);
+            if (next_id != current_next_id) prefetchNext(next_id, next_pos, queue_version);
+            if (art_pending && conn) updateAlbumArt(*metadata.load());
+            return;
+        }
+        
+        std::shared_ptr<const TrackMetadata> track = track_cache.find(song_id, queue_version);
+        if (track) {
+            if (song) mpd_song_free(song);
+        } else {
+            if (!full_sync) {
+                song = mpd_run_current_song(conn);
+                if (mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
+                    dropConnection("getting current song");
+                    return;
                 }
-                
-                if (!shutdown_requested) {
-                    printf("MPD waking up - reconnecting\n");
-                    // Continue to normal operation
+            }
+            track = makeTrack(song);
+            track_cache.insert(track->song_id, queue_version, track);
+        }
+        
+        current_song_id = track->song_id;
+        current_queue_version = queue_version;
+        publishMetadata(*track);
+        
+        prefetchNext(next_id, next_pos, queue_version);
+        if (conn) updateAlbumArt(*track);
+    }
+    
+    // Stop a transfer when a transport command is waiting or the song moved
+    // on; either one is handled right after, and the transfer resumes later
+    bool artInterrupted(int song_id, std::chrono::steady_clock::time_point& next_check) {
+        if (commandsPending()) return true;
+        auto now = std::chrono::steady_clock::now();
+        if (now < next_check) return false;
+        next_check = now + std::chrono::milliseconds(ART_SONG_CHECK_MS);
+        
+        struct mpd_status* status = mpd_run_status(conn);
+        if (!status) {
+            dropConnection("getting status");
+            return true;
+        }
+        bool moved = mpd_status_get_song_id(status) != song_id;
+        mpd_status_free(status);
+        return moved;
+    }
+    
+    // Read a whole binary response ("albumart" or "readpicture") chunk by
+    // chunk. A cover over ART_MAX_BYTES counts as found but comes back empty.
+    PictureResult fetchPicture(const TrackMetadata& track, bool embedded, std::vector<uint8_t>& data) {
+        // albumart serves the directory's cover file, readpicture the song's own tag
+        std::string key = (embedded ? "picture:" + track.uri : "cover:" + ArtCache::albumKey(track.uri));
+        data.clear();
+        if (key == partial_art_key) data.swap(partial_art);
+        partial_art_key.clear();
+        partial_art.clear();
+        
+        std::vector<uint8_t> chunk(ART_CHUNK_BYTES);
+        auto next_check = std::chrono::steady_clock::now() + std::chrono::milliseconds(ART_SONG_CHECK_MS);
+        while (data.size() < ART_MAX_BYTES) {
+            if (shutdown_requested || is_sleeping) return PICTURE_ABORTED;
+            if (artInterrupted(track.song_id, next_check)) {
+                if (conn && !data.empty()) {
+                    partial_art_key = key;
+                    partial_art.swap(data);
                 }
+                return PICTURE_ABORTED;
             }
             
-            if (shutdown_requested) break;
-            
-            // Normal operation when not sleeping
-            if (!conn) {
-                if (!connectMPD()) {
-                    // Sleep with interruption check
-                    for (int i = 0; i < RECONNECT_DELAY_SEC * 10 && !shutdown_requested && !is_sleeping; i++) {
-                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            int got = embedded
+                ? mpd_run_readpicture(conn, track.uri.c_str(), data.size(), chunk.data(), chunk.size())
+                : mpd_run_albumart(conn, track.uri.c_str(), data.size(), chunk.data(), chunk.size());
+            if (got < 0) {
+                // Server errors leave the connection usable; only "no such file" means no cover
+                if (mpd_connection_get_error(conn) == MPD_ERROR_SERVER) {
+                    bool missing = mpd_connection_get_server_error(conn) == MPD_SERVER_ERROR_NO_EXIST;
+                    std::string message = mpd_connection_get_error_message(conn);
+                    if (mpd_connection_clear_error(conn)) {
+                        if (missing) return PICTURE_NONE;
+                        printf("MPD album art unavailable: %s\n", message.c_str());
+                        return PICTURE_REFUSED;
                     }
-                    continue;
                 }
-                updateCurrentSong();
+                dropConnection("fetching album art");
+                return PICTURE_ABORTED;
             }
-            
-            // Use idle with timeout
-            {
-                std::lock_guard<std::mutex> lock(conn_mutex);
-                if (!conn || shutdown_requested || is_sleeping) continue;
-                
-                if (!mpd_send_idle_mask(conn, MPD_IDLE_PLAYER)) {
-                    printf("MPD failed to send idle\n");
-                    mpd_connection_free(conn);
-                    conn = nullptr;
-                    continue;
+            if (got == 0) return data.empty() ? PICTURE_NONE : PICTURE_FOUND;
+            data.insert(data.end(), chunk.begin(), chunk.begin() + got);
+        }
+        printf("Album art for %s is over %zu bytes, skipped\n", track.uri.c_str(), ART_MAX_BYTES);
+        data.clear();
+        return PICTURE_FOUND;
+    }
+    
+    // Cover for the current song: disk cache first, then cover file, then embedded picture
+    void updateAlbumArt(const TrackMetadata& track) {
+        art_pending = false;
+        AlbumArt art;
+        art.song_id = track.song_id;
+        if (track.uri.empty() || track.uri.find("://") != std::string::npos) {
+            publishArt(art);  // Nothing playing, or a stream
+            return;
+        }
+        
+        std::string album_key = ArtCache::albumKey(track.uri);
+        if (album_key == current_album_key) {
+            AlbumArt same = *art_snapshot.load();
+            same.song_id = track.song_id;
+            publishArt(same);
+            return;
+        }
+        
+        if (!art_cache.load(album_key, art)) {
+            std::vector<uint8_t> data;
+            PictureResult result = fetchPicture(track, false, data);
+            if (result == PICTURE_NONE && conn) result = fetchPicture(track, true, data);
+            if (result == PICTURE_ABORTED || !conn) {
+                art_pending = conn != nullptr;
+                return;
+            }
+            if (result == PICTURE_REFUSED) {
+                publishArt(art);  // No cover for now; asked again on the next song
+                return;
+            }
+            
+            art.present = !data.empty() && CoverDecoder::decode(data, art.bitmap.data());
+            // Only "no cover" from the server is remembered as such; a cover we
+            // could not use (PNG, corrupt, too large) is tried again next time
+            if (art.present || result == PICTURE_NONE) art_cache.store(album_key, art);
+        }
+        current_album_key = album_key;
+        publishArt(art);
+    }
+    
+    // Fetch the next queue entry into the cache ahead of the track boundary,
+    // and publish it so the renderer can rasterize its title in advance
+    void prefetchNext(int next_id, int next_pos, unsigned queue_version) {
+        current_next_id = next_id;
+        
+        std::shared_ptr<const TrackMetadata> track;
+        if (next_id >= 0) {
+            track = track_cache.find(next_id, queue_version);
+            if (!track) {
+                struct mpd_song* song = mpd_run_get_queue_song_pos(conn, next_pos);
+                if (mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
+                    if (song) mpd_song_free(song);
+                    dropConnection("prefetching next song");
+                    return;
+                }
+                if (!song) return;
+                track = makeTrack(song);
+                track_cache.insert(track->song_id, queue_version, track);
+            }
+        }
+        publishUpcoming(track ? *track : TrackMetadata());
+    }
+    
+    void wakeThread() override { wake.signal(); }
+    
+    // Command failures the server reports (no mixer, nothing to seek) only skip that command
+    bool commandOk(bool ok, const char* what) {
+        if (ok) return true;
+        if (mpd_connection_get_error(conn) == MPD_ERROR_SERVER) {
+            std::string message = mpd_connection_get_error_message(conn);  // Gone once cleared
+            if (mpd_connection_clear_error(conn)) {
+                printf("MPD refused %s: %s\n", what, message.c_str());
+                return true;
+            }
+        }
+        dropConnection(what);
+        return false;
+    }
+    
+    // Run everything queued since the last batch, between idle periods
+    void runCommands() {
+        {
+            std::lock_guard<std::mutex> lock(conn_mutex);
+            if (!conn) return;  // Keep them until connected
+            
+            PendingCommands batch = takeCommands();
+            if (batch.empty()) return;
+            
+            bool ok = true;
+            for (int i = 0; ok && i < std::abs(batch.skip); i++) {
+                ok = batch.skip > 0 ? commandOk(mpd_run_next(conn), "next")
+                                    : commandOk(mpd_run_previous(conn), "previous");
+            }
+            if (ok && batch.seek != 0.0f) ok = commandOk(mpd_run_seek_current(conn, batch.seek, true), "seek");
+            if (ok && batch.volume != 0) ok = commandOk(mpd_run_change_volume(conn, batch.volume), "volume");
+            if (ok && batch.toggle_pause) ok = commandOk(mpd_run_toggle_pause(conn), "pause");
+            if (!ok) return;
+            commands_done = batch.sequence;
+        }
+        
+        // Publish the result right away instead of waiting for the idle event
+        updateCurrentSong();
+    }
+    
+    void mpdThreadFunc() {
+        printf("MPD thread started\n");
+        
+        while (thread_running && !shutdown_requested) {
+            // Check if we're sleeping
+            if (is_sleeping) {
+                // Disconnect while sleeping to save resources
+                if (conn) {
+                    printf("MPD entering sleep mode - disconnecting\n");
+                    disconnectMPD();
+                }
+                
+                while (is_sleeping && !shutdown_requested) {
+                    wake.wait(-1);
+                }
+                
+                if (!shutdown_requested) {
+                    printf("MPD waking up - reconnecting\n");
                 }
             }
             
-            // Wait for idle result with timeout
-            struct timeval tv;
-            tv.tv_sec = 1;
-            tv.tv_usec = 0;
+            if (shutdown_requested) break;
+            
+            // Normal operation when not sleeping
+            if (!conn) {
+                if (!connectMPD()) {
+                    wake.wait(RECONNECT_DELAY_SEC * 1000);
+                    continue;
+                }
+                updateCurrentSong();
+            }
             
-            fd_set fds;
-            FD_ZERO(&fds);
+            // Commands go out while no idle is pending, so replies cannot interleave
+            runCommands();
             
             int fd;
             {
                 std::lock_guard<std::mutex> lock(conn_mutex);
-                if (!conn) continue;
+                if (!conn || shutdown_requested || is_sleeping) continue;
+                
+                if (!mpd_send_idle_mask(conn, (enum mpd_idle)(MPD_IDLE_PLAYER | MPD_IDLE_MIXER))) {
+                    printf("MPD failed to send idle\n");
+                    mpd_connection_free(conn);
+                    conn = nullptr;
+                    continue;
+                }
+                
                 fd = mpd_connection_get_fd(conn);
                 if (fd < 0) {
                     mpd_connection_free(conn);
@@ -247,25 +1076,28 @@ private:
                 }
             }
             
-            FD_SET(fd, &fds);
-            
-            int ret = select(fd + 1, &fds, NULL, NULL, &tv);
-            
-            if (shutdown_requested || is_sleeping) {
-                // Cancel idle if we need to sleep or shutdown
-                std::lock_guard<std::mutex> lock(conn_mutex);
-                if (conn) {
-                    mpd_send_noidle(conn);
-                    mpd_response_finish(conn);
-                }
-                continue;
+            // Sleep until MPD reports an event or we are signalled, no timeout
+            struct pollfd fds[2] = {
+                { fd, POLLIN, 0 },
+                { wake.get(), POLLIN, 0 },
+            };
+            int ret = poll(fds, 2, wake.get() < 0 ? 1000 : -1);  // Without eventfd, fall back to polling
+            if (ret < 0 && errno != EINTR) {
+                printf("MPD poll error: %s\n", strerror(errno));
             }
             
-            if (ret > 0) {
+            enum mpd_idle idle_result = (enum mpd_idle)0;
+            {
                 std::lock_guard<std::mutex> lock(conn_mutex);
                 if (!conn) continue;
                 
-                enum mpd_idle idle_result = mpd_recv_idle(conn, false);
+                if (ret > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+                    idle_result = mpd_recv_idle(conn, false);
+                } else {
+                    // Signalled (or interrupted): leave idle, keeping any event that raced it
+                    wake.drain();
+                    idle_result = mpd_run_noidle(conn);
+                }
                 
                 if (idle_result == 0 && mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
                     printf("MPD idle error: %s\n", mpd_connection_get_error_message(conn));
@@ -273,18 +1105,10 @@ private:
                     conn = nullptr;
                     continue;
                 }
-                
-                if (idle_result & MPD_IDLE_PLAYER) {
-                    lock.~lock_guard();
-                    updateCurrentSong();
-                }
-            } else if (ret == 0) {
-                // Timeout - send noidle to keep connection alive
-                std::lock_guard<std::mutex> lock(conn_mutex);
-                if (conn && !is_sleeping) {
-                    mpd_send_noidle(conn);
-                    mpd_response_finish(conn);
-                }
+            }
+            
+            if ((idle_result & (MPD_IDLE_PLAYER | MPD_IDLE_MIXER)) && !shutdown_requested && !is_sleeping) {
+                updateCurrentSong();
             }
         }
         
@@ -295,22 +1119,24 @@ private:
 public:
     MPDClient(const std::string& mpd_host = "localhost", int mpd_port = 6600) 
         : conn(nullptr), thread_running(false), shutdown_requested(false),
-          is_sleeping(false), host(mpd_host), port(mpd_port) {
+          is_sleeping(false), wake("MPD"),
+          current_song_id(-2), current_next_id(-2), current_queue_version(0),
+          host(mpd_host), port(mpd_port) {
         
         // Initialize with default text
-        std::lock_guard<std::mutex> lock(data_mutex);
-        title = "Waiting for MPD...";
-        artist = "";
-        year = "";
-        track_number = "";
-        updateFormattedText();
+        TrackMetadata track;
+        track.title = "Waiting for MPD...";
+        updateFormattedText(track);
+        metadata.publish(track);
     }
     
     ~MPDClient() {
         stop();
     }
     
-    bool start() {
+    const char* name() const override { return "MPD"; }
+    
+    bool start() override {
         if (thread_running) return true;
         
         printf("Starting MPD client...\n");
@@ -320,7 +1146,7 @@ public:
         return true;
     }
     
-    void stop() {
+    void stop() override {
         printf("Stopping MPD client...\n");
         
         if (!thread_running) return;
@@ -331,17 +1157,8 @@ public:
         // Wake from sleep if necessary
         setSleepState(false);
         
-        // Try to break out of idle
-        {
-            std::lock_guard<std::mutex> lock(conn_mutex);
-            if (conn) {
-                struct mpd_connection* cancel_conn = mpd_connection_new(host.c_str(), port, 500);
-                if (cancel_conn) {
-                    mpd_run_noidle(cancel_conn);
-                    mpd_connection_free(cancel_conn);
-                }
-            }
-        }
+        // Break out of poll(); the thread sends noidle itself
+        wake.signal();
         
         if (mpd_thread.joinable()) {
             printf("Waiting for MPD thread to finish...\n");
@@ -353,1816 +1170,7037 @@ public:
     }
     
     // Set sleep state
-    void setSleepState(bool sleeping) {
+    void setSleepState(bool sleeping) override {
         bool was_sleeping = is_sleeping.exchange(sleeping);
         if (was_sleeping != sleeping) {
             printf("MPD sleep state changed to: %s\n", sleeping ? "sleeping" : "awake");
+            if (sleeping) {
+                takeCommands();  // Stale by the time we wake
+            }
+            wake.signal();
         }
     }
     
     // Simple getters
-    std::string getFormattedText() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        return formatted_text;
-    }
-    
-    std::string getTitle() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        return title;
-    }
-    
-    std::string getArtist() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        return artist;
-    }
-    
-    std::string getYear() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        return year;
-    }
-    
-    std::string getTrackNumber() {
-        std::lock_guard<std::mutex> lock(data_mutex);
-        return track_number;
-    }
+    std::string getFormattedText() const { return getMetadata()->formatted_text; }
+    std::string getTitle() const { return getMetadata()->title; }
+    std::string getArtist() const { return getMetadata()->artist; }
+    std::string getYear() const { return getMetadata()->year; }
+    std::string getTrackNumber() const { return getMetadata()->track_number; }
     
     bool isConnected() {
         std::lock_guard<std::mutex> lock(conn_mutex);
         return conn != nullptr;
     }
+    
+    // CPU time used by the MPD thread so far, for benchmarks
+    double threadCPUSeconds() {
+        clockid_t clock;
+        struct timespec ts;
+        if (!mpd_thread.joinable() || pthread_getcpuclockid(mpd_thread.native_handle(), &clock) != 0 ||
+            clock_gettime(clock, &ts) != 0) {
+            return 0.0;
+        }
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
 };
 
-// Font manager class
-class FontManager {
+#ifndef AAV_NO_MPRIS
+// MPRIS players on the D-Bus session bus: desktop and streaming clients, and
+// Bluetooth phones through BlueZ's mpris-proxy. One private connection with
+// match rules for PropertiesChanged, Seeked and NameOwnerChanged, so the
+// thread sleeps in poll() until some player does something. Of several
+// players, the one that most recently started playing is published.
+class MPRISSource : public PlayerSource {
 private:
-    FT_Library library;
-    FT_Face face_regular;
-    FT_Face face_small;
-    FT_Face face_large;
-    bool initialized;
+    static constexpr const char* NAME_PREFIX = "org.mpris.MediaPlayer2.";
+    static constexpr const char* OBJECT_PATH = "/org/mpris/MediaPlayer2";
+    static constexpr const char* PLAYER_INTERFACE = "org.mpris.MediaPlayer2.Player";
+    static constexpr const char* PROPERTIES_INTERFACE = "org.freedesktop.DBus.Properties";
+    static constexpr int CALL_TIMEOUT_MS = 500;
+    static constexpr int RECONNECT_DELAY_SEC = 5;
+    static constexpr size_t ART_MAX_BYTES = 8 * 1024 * 1024;
+    static constexpr int VOLUME_SETTLE_MS = 1000;  // Volume echoes still in flight after a Set
     
-public:
-    FontManager() : library(nullptr), face_regular(nullptr), face_small(nullptr), 
-                   face_large(nullptr), initialized(false) {}
+    // What one player last told us
+    struct Player {
+        std::string bus_name;  // Well-known name, org.mpris.MediaPlayer2.*
+        enum mpd_state state = MPD_STATE_STOP;
+        std::string track_key; // mpris:trackid, or the tags for players that leave it out
+        TrackMetadata track;
+        std::string art_url;
+        int64_t position_us = 0;
+        int64_t length_us = 0;
+        double volume = -1.0;  // 0-1, negative when the player has no volume
+        double volume_target = -1.0;  // Last volume we set, until the player catches up
+        std::chrono::steady_clock::time_point volume_sent;
+        std::chrono::steady_clock::time_point synced;  // When position_us was current
+    };
     
-    ~FontManager() {
-        if (initialized) {
-            if (face_large) FT_Done_Face(face_large);
-            if (face_small) FT_Done_Face(face_small);
-            if (face_regular) FT_Done_Face(face_regular);
-            if (library) FT_Done_FreeType(library);
+    // Which properties one message carried
+    struct Changes {
+        bool state = false;
+        bool track = false;
+        bool volume = false;
+        bool position = false;
+    };
+    
+    DBusConnection* bus;
+    std::thread bus_thread;
+    std::atomic<bool> thread_running;
+    std::atomic<bool> shutdown_requested;
+    WakeEvent wake;
+    std::vector<std::string> ignored;  // Players a dedicated source already covers
+    
+    // Bus thread only
+    std::map<std::string, Player> players;  // By unique name (":1.42"), which signals carry as sender
+    std::string active;                     // Unique name of the published player
+    int next_song_id;
+    std::string current_art_url;
+    
+    bool isIgnored(const std::string& bus_name) const {
+        for (const auto& suffix : ignored) {
+            std::string name = NAME_PREFIX + suffix;
+            if (bus_name == name || bus_name.compare(0, name.size() + 1, name + ".") == 0) return true;
         }
+        return false;
     }
     
-    bool init(const char* font_path) {
-        FT_Error error = FT_Init_FreeType(&library);
-        if (error) {
-            printf("FreeType init error: %d\n", error);
-            return false;
-        }
-        
-        // Load regular size (10px)
-        error = FT_New_Face(library, font_path, 0, &face_regular);
-        if (error) {
-            printf("Font loading error: %d (check path: %s)\n", error, font_path);
-            FT_Done_FreeType(library);
-            library = nullptr;
-            return false;
+    // Variant or plain argument as text; string arrays (xesam:artist) are joined
+    static std::string readString(DBusMessageIter* iter) {
+        int type = dbus_message_iter_get_arg_type(iter);
+        if (type == DBUS_TYPE_VARIANT) {
+            DBusMessageIter inner;
+            dbus_message_iter_recurse(iter, &inner);
+            return readString(&inner);
         }
-        FT_Set_Pixel_Sizes(face_regular, 0, 10);
-        
-        // Load small size (8px)
-        error = FT_New_Face(library, font_path, 0, &face_small);
-        if (!error) {
-            FT_Set_Pixel_Sizes(face_small, 0, 8);
+        if (type == DBUS_TYPE_STRING || type == DBUS_TYPE_OBJECT_PATH) {
+            const char* value = nullptr;
+            dbus_message_iter_get_basic(iter, &value);
+            return value ? value : "";
         }
-        
-        // Load large size (14px)
-        error = FT_New_Face(library, font_path, 0, &face_large);
-        if (!error) {
-            FT_Set_Pixel_Sizes(face_large, 0, 14);
+        if (type == DBUS_TYPE_ARRAY) {
+            std::string joined;
+            DBusMessageIter element;
+            dbus_message_iter_recurse(iter, &element);
+            while (dbus_message_iter_get_arg_type(&element) == DBUS_TYPE_STRING) {
+                if (!joined.empty()) joined += ", ";
+                joined += readString(&element);
+                dbus_message_iter_next(&element);
+            }
+            return joined;
         }
-        
-        initialized = true;
-        printf("Font loaded: %s (8px, 10px, 14px)\n", font_path);
-        return true;
+        return "";
     }
     
-    enum FontSize { SMALL, REGULAR, LARGE };
+    // Variant or plain numeric argument; players disagree on the integer widths
+    static double readNumber(DBusMessageIter* iter) {
+        switch (dbus_message_iter_get_arg_type(iter)) {
+            case DBUS_TYPE_VARIANT: {
+                DBusMessageIter inner;
+                dbus_message_iter_recurse(iter, &inner);
+                return readNumber(&inner);
+            }
+            case DBUS_TYPE_INT64:  { dbus_int64_t v;  dbus_message_iter_get_basic(iter, &v); return (double)v; }
+            case DBUS_TYPE_UINT64: { dbus_uint64_t v; dbus_message_iter_get_basic(iter, &v); return (double)v; }
+            case DBUS_TYPE_INT32:  { dbus_int32_t v;  dbus_message_iter_get_basic(iter, &v); return v; }
+            case DBUS_TYPE_UINT32: { dbus_uint32_t v; dbus_message_iter_get_basic(iter, &v); return v; }
+            case DBUS_TYPE_DOUBLE: { double v;        dbus_message_iter_get_basic(iter, &v); return v; }
+            default: return 0.0;
+        }
+    }
     
-    bool renderText(const char* text, uint8_t* buffer, int buf_width, int buf_height, 
-                   int x, int y, FontSize size = REGULAR, bool invert = false) {
-        if (!initialized || !text) return false;
-        
-        FT_Face face = face_regular;
-        switch (size) {
-            case SMALL: face = face_small ? face_small : face_regular; break;
-            case LARGE: face = face_large ? face_large : face_regular; break;
-            default: break;
+    // a{sv} Metadata into the player's track; a new identity gets a new song id
+    void parseMetadata(DBusMessageIter* variant, Player& player) {
+        DBusMessageIter dict, entry;
+        dbus_message_iter_recurse(variant, &dict);
+        if (dbus_message_iter_get_arg_type(&dict) != DBUS_TYPE_ARRAY) return;
+        dbus_message_iter_recurse(&dict, &entry);
+        
+        TrackMetadata track;
+        std::string track_id;
+        player.art_url.clear();
+        player.length_us = 0;
+        while (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter field;
+            dbus_message_iter_recurse(&entry, &field);
+            std::string key = readString(&field);
+            dbus_message_iter_next(&field);
+            
+            if (key == "xesam:title") track.title = readString(&field);
+            else if (key == "xesam:artist") track.artist = readString(&field);
+            else if (key == "xesam:album") track.album = readString(&field);
+            else if (key == "xesam:url") track.uri = readString(&field);
+            else if (key == "mpris:trackid") track_id = readString(&field);
+            else if (key == "mpris:artUrl") player.art_url = readString(&field);
+            else if (key == "mpris:length") player.length_us = (int64_t)readNumber(&field);
+            else if (key == "xesam:trackNumber") {
+                int number = (int)readNumber(&field);
+                if (number > 0) track.track_number = std::to_string(number);
+            } else if (key == "xesam:contentCreated") {
+                std::string date = readString(&field);
+                if (date.size() >= 4) track.year = date.substr(0, 4);
+            }
+            dbus_message_iter_next(&entry);
         }
         
-        int cursor_x = x;
-        int baseline_y = y;
-        
-        while (*text) {
-            FT_Error error = FT_Load_Char(face, *text, FT_LOAD_RENDER);
-            if (error) {
-                text++;
-                continue;
-            }
-            
-            FT_GlyphSlot slot = face->glyph;
-            FT_Bitmap* bitmap = &slot->bitmap;
-            
-            int start_x = cursor_x + slot->bitmap_left;
-            int start_y = baseline_y - slot->bitmap_top;
+        std::string key = !track_id.empty() ? track_id : track.title + '\n' + track.artist + '\n' + track.album;
+        track.song_id = key == player.track_key ? player.track.song_id : ++next_song_id;
+        player.track_key = key;
+        updateFormattedText(track);
+        player.track = track;
+    }
+    
+    // a{sv} of org.mpris.MediaPlayer2.Player properties (GetAll or PropertiesChanged)
+    Changes parseProperties(DBusMessageIter* iter, Player& player) {
+        Changes changes;
+        if (dbus_message_iter_get_arg_type(iter) != DBUS_TYPE_ARRAY) return changes;
+        DBusMessageIter entry;
+        dbus_message_iter_recurse(iter, &entry);
+        while (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_DICT_ENTRY) {
+            DBusMessageIter field;
+            dbus_message_iter_recurse(&entry, &field);
+            std::string key = readString(&field);
+            dbus_message_iter_next(&field);
             
-            for (unsigned int row = 0; row < bitmap->rows; row++) {
-                for (unsigned int col = 0; col < bitmap->width; col++) {
-                    int px = start_x + col;
-                    int py = start_y + row;
-                    
-                    if (px >= 0 && px < buf_width && py >= 0 && py < buf_height) {
-                        uint8_t gray = bitmap->buffer[row * bitmap->pitch + col];
-                        bool pixel_on = gray > 128;
-                        if (invert) pixel_on = !pixel_on;
-                        
-                        if (pixel_on) {
-                            int page = py / 8;
-                            int bit = py % 8;
-                            buffer[page * buf_width + px] |= (1 << bit);
-                        }
-                    }
-                }
+            if (key == "PlaybackStatus") {
+                std::string state = readString(&field);
+                player.state = state == "Playing" ? MPD_STATE_PLAY : state == "Paused" ? MPD_STATE_PAUSE : MPD_STATE_STOP;
+                changes.state = true;
+            } else if (key == "Metadata") {
+                parseMetadata(&field, player);
+                changes.track = true;
+            } else if (key == "Volume") {
+                player.volume = readNumber(&field);
+                changes.volume = true;
+            } else if (key == "Position") {
+                player.position_us = (int64_t)readNumber(&field);
+                player.synced = std::chrono::steady_clock::now();
+                changes.position = true;
             }
-            
-            cursor_x += slot->advance.x >> 6;
-            text++;
+            dbus_message_iter_next(&entry);
         }
-        
-        return true;
+        return changes;
     }
     
-    int getTextWidth(const char* text, FontSize size = REGULAR) {
-        if (!initialized || !text) return 0;
-        
-        FT_Face face = face_regular;
-        switch (size) {
-            case SMALL: face = face_small ? face_small : face_regular; break;
-            case LARGE: face = face_large ? face_large : face_regular; break;
-            default: break;
+    // Blocking method call (takes the message); null on error or timeout
+    DBusMessage* call(DBusMessage* message) {
+        DBusError error;
+        dbus_error_init(&error);
+        DBusMessage* reply = dbus_connection_send_with_reply_and_block(bus, message, CALL_TIMEOUT_MS, &error);
+        dbus_message_unref(message);
+        if (!reply) {
+            printf("MPRIS call failed: %s\n", error.message ? error.message : "no reply");
+            dbus_error_free(&error);
         }
-        
-        int width = 0;
-        while (*text) {
-            FT_Error error = FT_Load_Char(face, *text, FT_LOAD_DEFAULT);
-            if (!error) {
-                width += face->glyph->advance.x >> 6;
+        return reply;
+    }
+    
+    DBusMessage* getProperty(const std::string& owner, const char* interface, const char* property) {
+        DBusMessage* message = dbus_message_new_method_call(owner.c_str(), OBJECT_PATH, PROPERTIES_INTERFACE,
+                                                            property ? "Get" : "GetAll");
+        if (property) {
+            dbus_message_append_args(message, DBUS_TYPE_STRING, &interface, DBUS_TYPE_STRING, &property,
+                                     DBUS_TYPE_INVALID);
+        } else {
+            dbus_message_append_args(message, DBUS_TYPE_STRING, &interface, DBUS_TYPE_INVALID);
+        }
+        return call(message);
+    }
+    
+    // Position is not signalled while playing, so ask after state and track changes
+    void queryPosition(const std::string& owner, Player& player) {
+        DBusMessage* reply = getProperty(owner, PLAYER_INTERFACE, "Position");
+        player.position_us = 0;
+        if (reply) {
+            DBusMessageIter iter;
+            if (dbus_message_iter_init(reply, &iter)) player.position_us = (int64_t)readNumber(&iter);
+            dbus_message_unref(reply);
+        }
+        player.synced = std::chrono::steady_clock::now();
+    }
+    
+    // file:// cover URLs as local paths; remote covers are not fetched
+    static std::string localPath(const std::string& url) {
+        if (url.compare(0, 7, "file://") != 0) return "";
+        std::string path;
+        for (size_t i = 7; i < url.size(); i++) {
+            if (url[i] == '%' && i + 2 < url.size()) {
+                path += (char)strtol(url.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            } else {
+                path += url[i];
             }
-            text++;
         }
-        return width;
+        return path;
     }
     
-    int getFontHeight(FontSize size = REGULAR) {
-        if (!initialized) return 12;
-        
-        FT_Face face = face_regular;
-        switch (size) {
-            case SMALL: face = face_small ? face_small : face_regular; break;
-            case LARGE: face = face_large ? face_large : face_regular; break;
-            default: break;
+    void updateAlbumArt(const Player& player) {
+        if (player.art_url == current_art_url) {
+            AlbumArt same = *art_snapshot.load();
+            if (same.song_id == player.track.song_id) return;
+            same.song_id = player.track.song_id;
+            publishArt(same);
+            return;
         }
         
-        return face->size->metrics.height >> 6;
+        // Players often rewrite one temporary file per track, so covers are
+        // decoded per URL change and not cached on disk
+        AlbumArt art;
+        art.song_id = player.track.song_id;
+        std::string path = localPath(player.art_url);
+        FILE* file = path.empty() ? nullptr : fopen(path.c_str(), "rb");
+        if (file) {
+            std::vector<uint8_t> data;
+            uint8_t chunk[65536];
+            size_t got;
+            while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0 && data.size() < ART_MAX_BYTES) {
+                data.insert(data.end(), chunk, chunk + got);
+            }
+            fclose(file);
+            art.present = !data.empty() && CoverDecoder::decode(data, art.bitmap.data());
+        }
+        current_art_url = player.art_url;
+        publishArt(art);
     }
     
-    bool isInitialized() const { return initialized; }
-};
-
-// Display class
-class Display {
-private:
-    uint8_t _cs, _dc, _rst;
-    FontManager* font_manager;
-
-public:
-    uint8_t buffer[1024];
-    
-    Display(uint8_t cs, uint8_t dc, uint8_t rst) : _cs(cs), _dc(dc), _rst(rst), font_manager(nullptr) {
-        memset(buffer, 0x00, sizeof(buffer));
+    void publishPlayer(const Player& player, bool track_changed) {
+        PlaybackStatus status;
+        status.state = player.state;
+        status.elapsed_ms = (unsigned)std::max<int64_t>(0, player.position_us / 1000);
+        status.duration_ms = (unsigned)std::max<int64_t>(0, player.length_us / 1000);
+        status.volume = player.volume >= 0.0 ? (int)lround(std::min(player.volume, 1.0) * 100.0) : -1;
+        status.commands_done = commands_done;
+        status.synced = player.synced;
+        publishPlayback(status);
+        
+        if (track_changed) {
+            publishMetadata(player.track);
+            publishUpcoming(TrackMetadata());  // MPRIS has no cheap look at the queue
+            updateAlbumArt(player);
+        }
     }
     
-    bool begin() {
-        bcm2835_gpio_fsel(_cs, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(_dc, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_fsel(_rst, BCM2835_GPIO_FSEL_OUTP);
-        
-        bcm2835_gpio_write(_rst, LOW);
-        bcm2835_delay(10);
-        bcm2835_gpio_write(_rst, HIGH);
-        
-        sendCommand(0xAE);
-        sendCommand(0x20); sendCommand(0x00);
-        sendCommand(0xB0);
-        sendCommand(0xC8);
-        sendCommand(0x00);
-        sendCommand(0x10);
-        sendCommand(0x40);
-        sendCommand(0x81); sendCommand(0x7F);
-        sendCommand(0xA1);
-        sendCommand(0xA6);
-        sendCommand(0xA8); sendCommand(0x3F);
-        sendCommand(0xA4);
-        sendCommand(0xD3); sendCommand(0x00);
-        sendCommand(0xD5); sendCommand(0x80);
-        sendCommand(0xD9); sendCommand(0xF1);
-        sendCommand(0xDA); sendCommand(0x12);
-        sendCommand(0xDB); sendCommand(0x40);
-        sendCommand(0x8D); sendCommand(0x14);
-        sendCommand(0xAF);
-        return true;
+    void publishIdle() {
+        TrackMetadata track;
+        track.title = "No MPRIS player";
+        updateFormattedText(track);
+        publishPlayback(PlaybackStatus());
+        publishMetadata(track);
+        publishUpcoming(TrackMetadata());
+        current_art_url.clear();
+        publishArt(AlbumArt());
     }
     
-    void sendCommand(uint8_t cmd) {
-        bcm2835_gpio_write(_dc, LOW);
-        bcm2835_gpio_write(_cs, LOW);
-        bcm2835_spi_transfer(cmd);
-        bcm2835_gpio_write(_cs, HIGH);
+    void select(const std::string& owner) {
+        active = owner;
+        auto it = players.find(owner);
+        if (it == players.end()) {
+            publishIdle();
+            return;
+        }
+        printf("MPRIS showing %s\n", it->second.bus_name.c_str());
+        publishPlayer(it->second, true);
     }
     
-    void sendData(uint8_t data) {
-        bcm2835_gpio_write(_dc, HIGH);
-        bcm2835_gpio_write(_cs, LOW);
-        bcm2835_spi_transfer(data);
-        bcm2835_gpio_write(_cs, HIGH);
+    std::string playingPlayer() const {
+        for (const auto& entry : players) {
+            if (entry.second.state == MPD_STATE_PLAY) return entry.first;
+        }
+        return "";
     }
     
-    void display() {
-        for (uint8_t page = 0; page < 8; page++) {
-            sendCommand(0xB0 + page);
-            sendCommand(0x00);
-            sendCommand(0x10);
-            for (uint8_t col = 0; col < 128; col++) {
-                sendData(buffer[page * 128 + col]);
-            }
-        }
+    // The active player went away: prefer one that is playing, else any
+    void selectFallback() {
+        std::string fallback = playingPlayer();
+        if (fallback.empty() && !players.empty()) fallback = players.begin()->first;
+        select(fallback);
     }
     
-    void clear() {
-        memset(buffer, 0x00, sizeof(buffer));
+    void addPlayer(const std::string& bus_name, const std::string& owner) {
+        if (isIgnored(bus_name)) return;
+        
+        Player player;
+        player.bus_name = bus_name;
+        DBusMessage* reply = getProperty(owner, PLAYER_INTERFACE, nullptr);
+        if (!reply) return;
+        DBusMessageIter iter;
+        Changes changes;
+        if (dbus_message_iter_init(reply, &iter)) changes = parseProperties(&iter, player);
+        dbus_message_unref(reply);
+        if (!changes.position) player.synced = std::chrono::steady_clock::now();
+        players[owner] = player;
+        printf("MPRIS player appeared: %s\n", bus_name.c_str());
+        
+        // A player that shows up playing has just started, so it wins
+        if (active.empty() || player.state == MPD_STATE_PLAY) {
+            select(owner);
+        }
     }
     
-    void sleep() {
-        sendCommand(0xAE); // Display off
+    void removePlayer(const std::string& owner) {
+        auto it = players.find(owner);
+        if (it == players.end()) return;
+        printf("MPRIS player left: %s\n", it->second.bus_name.c_str());
+        players.erase(it);
+        if (owner == active) selectFallback();
     }
     
-    void wake() {
-        sendCommand(0xAF); // Display on
+    // Players already on the bus when we connect
+    void listPlayers() {
+        DBusMessage* reply = call(dbus_message_new_method_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                               "org.freedesktop.DBus", "ListNames"));
+        if (!reply) return;
+        std::vector<std::string> names;
+        DBusMessageIter iter, element;
+        if (dbus_message_iter_init(reply, &iter) && dbus_message_iter_get_arg_type(&iter) == DBUS_TYPE_ARRAY) {
+            dbus_message_iter_recurse(&iter, &element);
+            while (dbus_message_iter_get_arg_type(&element) == DBUS_TYPE_STRING) {
+                std::string name = readString(&element);
+                if (name.compare(0, strlen(NAME_PREFIX), NAME_PREFIX) == 0) names.push_back(name);
+                dbus_message_iter_next(&element);
+            }
+        }
+        dbus_message_unref(reply);
+        
+        for (const auto& name : names) {
+            DBusMessage* message = dbus_message_new_method_call("org.freedesktop.DBus", "/org/freedesktop/DBus",
+                                                                "org.freedesktop.DBus", "GetNameOwner");
+            const char* name_arg = name.c_str();
+            dbus_message_append_args(message, DBUS_TYPE_STRING, &name_arg, DBUS_TYPE_INVALID);
+            DBusMessage* owner_reply = call(message);
+            if (!owner_reply) continue;
+            const char* owner = nullptr;
+            if (dbus_message_get_args(owner_reply, nullptr, DBUS_TYPE_STRING, &owner, DBUS_TYPE_INVALID)) {
+                addPlayer(name, owner);
+            }
+            dbus_message_unref(owner_reply);
+        }
     }
     
-    void drawPixel(uint8_t x, uint8_t y) {
-        if (x >= 128 || y >= 64) return;
-        buffer[(y / 8) * 128 + x] |= (1 << (y % 8));
+    void handleMessage(DBusMessage* message) {
+        if (dbus_message_is_signal(message, "org.freedesktop.DBus", "NameOwnerChanged")) {
+            const char *name, *old_owner, *new_owner;
+            if (!dbus_message_get_args(message, nullptr, DBUS_TYPE_STRING, &name, DBUS_TYPE_STRING, &old_owner,
+                                       DBUS_TYPE_STRING, &new_owner, DBUS_TYPE_INVALID) ||
+                strncmp(name, NAME_PREFIX, strlen(NAME_PREFIX)) != 0) {
+                return;
+            }
+            if (old_owner[0]) removePlayer(old_owner);
+            if (new_owner[0]) addPlayer(name, new_owner);
+            return;
+        }
+        
+        const char* sender = dbus_message_get_sender(message);
+        auto it = sender ? players.find(sender) : players.end();
+        if (it == players.end()) return;
+        std::string owner = it->first;
+        Player& player = it->second;
+        
+        if (dbus_message_is_signal(message, PROPERTIES_INTERFACE, "PropertiesChanged")) {
+            DBusMessageIter iter;
+            if (!dbus_message_iter_init(message, &iter) || readString(&iter) != PLAYER_INTERFACE) return;
+            dbus_message_iter_next(&iter);
+            
+            enum mpd_state before = player.state;
+            int song_before = player.track.song_id;
+            Changes changes = parseProperties(&iter, player);
+            if ((changes.state || changes.track) && !changes.position) queryPosition(owner, player);
+            
+            std::string playing;
+            if (player.state == MPD_STATE_PLAY && before != MPD_STATE_PLAY && owner != active) {
+                select(owner);
+            } else if (owner == active && before == MPD_STATE_PLAY && player.state != MPD_STATE_PLAY &&
+                       !(playing = playingPlayer()).empty()) {
+                select(playing);  // Paused while another player is still going
+            } else if (owner == active) {
+                publishPlayer(player, player.track.song_id != song_before);
+            }
+        } else if (dbus_message_is_signal(message, PLAYER_INTERFACE, "Seeked")) {
+            dbus_int64_t position;
+            if (!dbus_message_get_args(message, nullptr, DBUS_TYPE_INT64, &position, DBUS_TYPE_INVALID)) return;
+            player.position_us = position;
+            player.synced = std::chrono::steady_clock::now();
+            if (owner == active) publishPlayer(player, false);
+        }
     }
     
-    void clearPixel(uint8_t x, uint8_t y) {
-        if (x >= 128 || y >= 64) return;
-        buffer[(y / 8) * 128 + x] &= ~(1 << (y % 8));
+    void sendToActive(DBusMessage* message) {
+        dbus_message_set_no_reply(message, TRUE);
+        dbus_connection_send(bus, message, nullptr);
+        dbus_message_unref(message);
     }
     
-    void drawLine(int x0, int y0, int x1, int y1) {
-        int dx = abs(x1 - x0), dy = abs(y1 - y0);
-        int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
-        int err = dx - dy;
-        
-        while (true) {
-            drawPixel(x0, y0);
-            if (x0 == x1 && y0 == y1) break;
-            int e2 = 2 * err;
-            if (e2 > -dy) { err -= dy; x0 += sx; }
-            if (e2 < dx) { err += dx; y0 += sy; }
+    // Fire-and-forget method calls; the player answers with PropertiesChanged
+    void runCommands() {
+        PendingCommands batch = takeCommands();
+        if (batch.empty()) return;
+        
+        auto it = players.find(active);
+        if (it != players.end()) {
+            const char* owner = it->first.c_str();
+            Player& player = it->second;
+            for (int i = 0; i < std::abs(batch.skip); i++) {
+                sendToActive(dbus_message_new_method_call(owner, OBJECT_PATH, PLAYER_INTERFACE,
+                                                          batch.skip > 0 ? "Next" : "Previous"));
+            }
+            if (batch.seek != 0.0f) {
+                dbus_int64_t offset = llround(batch.seek * 1e6);
+                DBusMessage* message = dbus_message_new_method_call(owner, OBJECT_PATH, PLAYER_INTERFACE, "Seek");
+                dbus_message_append_args(message, DBUS_TYPE_INT64, &offset, DBUS_TYPE_INVALID);
+                sendToActive(message);
+            }
+            if (batch.volume != 0 && player.volume >= 0.0) {
+                // Players echo every Set, so a quick second burst adds to our
+                // own target rather than to an echo of an older one
+                auto now = std::chrono::steady_clock::now();
+                bool settling = player.volume_target >= 0.0 &&
+                                now - player.volume_sent < std::chrono::milliseconds(VOLUME_SETTLE_MS);
+                double base = settling ? player.volume_target : player.volume;
+                player.volume_target = std::max(0.0, std::min(1.0, base + batch.volume / 100.0));
+                player.volume_sent = now;
+                DBusMessage* message = dbus_message_new_method_call(owner, OBJECT_PATH, PROPERTIES_INTERFACE, "Set");
+                const char* interface = PLAYER_INTERFACE;
+                const char* property = "Volume";
+                DBusMessageIter iter, variant;
+                dbus_message_iter_init_append(message, &iter);
+                dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface);
+                dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &property);
+                dbus_message_iter_open_container(&iter, DBUS_TYPE_VARIANT, DBUS_TYPE_DOUBLE_AS_STRING, &variant);
+                dbus_message_iter_append_basic(&variant, DBUS_TYPE_DOUBLE, &player.volume_target);
+                dbus_message_iter_close_container(&iter, &variant);
+                sendToActive(message);
+            }
+            if (batch.toggle_pause) {
+                sendToActive(dbus_message_new_method_call(owner, OBJECT_PATH, PLAYER_INTERFACE, "PlayPause"));
+            }
+            dbus_connection_flush(bus);
         }
+        commands_done = batch.sequence;  // Reported with the player's answer
     }
     
-    void drawRect(int x, int y, int w, int h, bool filled = false) {
-        if (filled) {
-            for (int i = y; i < y + h && i < 64; i++) {
-                for (int j = x; j < x + w && j < 128; j++) {
-                    drawPixel(j, i);
-                }
+    bool connectBus() {
+        DBusError error;
+        dbus_error_init(&error);
+        bus = dbus_bus_get_private(DBUS_BUS_SESSION, &error);
+        if (!bus) {
+            printf("MPRIS: no session bus: %s\n", error.message ? error.message : "unknown error");
+            dbus_error_free(&error);
+            return false;
+        }
+        dbus_connection_set_exit_on_disconnect(bus, FALSE);
+        
+        const char* rules[] = {
+            "type='signal',interface='org.freedesktop.DBus.Properties',member='PropertiesChanged',"
+            "path='/org/mpris/MediaPlayer2'",
+            "type='signal',interface='org.mpris.MediaPlayer2.Player',member='Seeked',path='/org/mpris/MediaPlayer2'",
+            "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+            "member='NameOwnerChanged',arg0namespace='org.mpris.MediaPlayer2'",
+        };
+        for (const char* rule : rules) {
+            dbus_bus_add_match(bus, rule, &error);
+            if (dbus_error_is_set(&error)) {
+                printf("MPRIS match rule failed: %s\n", error.message);
+                dbus_error_free(&error);
+                disconnectBus();
+                return false;
             }
-        } else {
-            drawLine(x, y, x + w - 1, y);
-            drawLine(x + w - 1, y, x + w - 1, y + h - 1);
-            drawLine(x + w - 1, y + h - 1, x, y + h - 1);
-            drawLine(x, y + h - 1, x, y);
         }
+        
+        printf("MPRIS connected to the session bus\n");
+        listPlayers();
+        return true;
     }
     
-    void drawCircle(int x0, int y0, int radius, bool filled = false) {
-        if (filled) {
-            // For filled circle, we'll draw horizontal lines for each row
-            for (int y = -radius; y <= radius; y++) {
-                int x = (int)sqrt(radius * radius - y * y);
-                drawLine(x0 - x, y0 + y, x0 + x, y0 + y);
+    void disconnectBus() {
+        if (!bus) return;
+        dbus_connection_close(bus);
+        dbus_connection_unref(bus);
+        bus = nullptr;
+        players.clear();
+        active.clear();
+        publishIdle();
+    }
+    
+    void busThreadFunc() {
+        printf("MPRIS thread started\n");
+        
+        while (!shutdown_requested) {
+            if (!bus && !connectBus()) {
+                wake.wait(RECONNECT_DELAY_SEC * 1000);
+                continue;
             }
-        } else {
-            // Bresenham's circle algorithm for outline
-            int x = radius;
-            int y = 0;
-            int err = 0;
             
-            while (x >= y) {
-                // Draw 8 octants
-                drawPixel(x0 + x, y0 + y);
-                drawPixel(x0 + y, y0 + x);
-                drawPixel(x0 - y, y0 + x);
-                drawPixel(x0 - x, y0 + y);
-                drawPixel(x0 - x, y0 - y);
-                drawPixel(x0 - y, y0 - x);
-                drawPixel(x0 + y, y0 - x);
-                drawPixel(x0 + x, y0 - y);
-                
-                if (err <= 0) {
-                    y += 1;
-                    err += 2 * y + 1;
-                }
-                if (err > 0) {
-                    x -= 1;
-                    err -= 2 * x + 1;
-                }
+            runCommands();
+            
+            // Method calls above may have queued signals too, so drain before sleeping
+            while (DBusMessage* message = dbus_connection_pop_message(bus)) {
+                handleMessage(message);
+                dbus_message_unref(message);
+            }
+            if (!dbus_connection_get_is_connected(bus)) {
+                printf("MPRIS: session bus closed\n");
+                disconnectBus();
+                continue;
+            }
+            
+            int fd = -1;
+            dbus_connection_get_unix_fd(bus, &fd);
+            struct pollfd fds[2] = {
+                { fd, POLLIN, 0 },
+                { wake.get(), POLLIN, 0 },
+            };
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+                printf("MPRIS poll error: %s\n", strerror(errno));
             }
+            if (fds[1].revents & POLLIN) wake.drain();
+            if (fds[0].revents) dbus_connection_read_write(bus, 0);
         }
+        
+        disconnectBus();
+        printf("MPRIS thread stopped\n");
     }
-
-    void setFont(FontManager* fm) {
-        font_manager = fm;
+    
+    void wakeThread() override { wake.signal(); }
+    
+public:
+    // ignored_players: name suffixes after org.mpris.MediaPlayer2. to leave out
+    explicit MPRISSource(std::vector<std::string> ignored_players = {})
+        : bus(nullptr), thread_running(false), shutdown_requested(false), wake("MPRIS"),
+          ignored(std::move(ignored_players)), next_song_id(0) {
+        publishIdle();
     }
     
-    // Text drawing using TTF fonts only
-    void drawText(uint8_t x, uint8_t y, const char* text, FontManager::FontSize size = FontManager::REGULAR) {
-        if (!font_manager || !font_manager->isInitialized()) {
-            printf("Warning: Font manager not initialized\n");
-            return;
-        }
-        font_manager->renderText(text, buffer, 128, 64, x, y, size);
+    ~MPRISSource() {
+        stop();
     }
     
-    // Centered text drawing
-    void drawTextCentered(uint8_t y, const char* text, FontManager::FontSize size = FontManager::REGULAR) {
-        if (!font_manager || !font_manager->isInitialized()) return;
-        
-        int text_width = font_manager->getTextWidth(text, size);
-        int x = (128 - text_width) / 2;
-        if (x < 0) x = 0;
-        
-        drawText(x, y, text, size);
+    const char* name() const override { return "MPRIS"; }
+    
+    bool start() override {
+        if (thread_running) return true;
+        thread_running = true;
+        shutdown_requested = false;
+        bus_thread = std::thread(&MPRISSource::busThreadFunc, this);
+        return true;
     }
     
-    // Text with background
-    void drawTextWithBackground(uint8_t x, uint8_t y, const char* text, 
-                               FontManager::FontSize size = FontManager::REGULAR, bool invert = false) {
-        if (!font_manager || !font_manager->isInitialized()) return;
-        
-        int text_width = font_manager->getTextWidth(text, size);
-        int text_height = font_manager->getFontHeight(size);
-        
-        // Draw background
-        drawRect(x - 1, y - text_height - 1, text_width + 2, text_height + 2, !invert);
-        
-        // Draw text
-        if (invert) {
-            // For inverted text, we need to clear the text area first
-            for (int i = 0; i < text_height; i++) {
-                for (int j = 0; j < text_width; j++) {
-                    clearPixel(x + j, y - text_height + i);
-                }
-            }
-        }
-        
-        font_manager->renderText(text, buffer, 128, 64, x, y, size, invert);
+    void stop() override {
+        if (!thread_running) return;
+        shutdown_requested = true;
+        thread_running = false;
+        wake.signal();
+        if (bus_thread.joinable()) bus_thread.join();
+    }
+    
+    // Signals cost nothing while players are idle, so the bus stays connected
+    // through sleep and the state is current on wake
+    void setSleepState(bool sleeping) override {
+        if (sleeping) takeCommands();
     }
 };
+#endif
 
-// Control State
-struct ControlState {
-    std::atomic<bool> running{true};
-    std::atomic<int> current_viz{0};
-    std::atomic<bool> is_sleeping{false};
-};
-
-// Audio Processor with sleep detection
-class AudioProcessor {
+// shairport-sync's metadata pipe (metadata = { enabled = "yes"; include_cover_art = "yes"; }).
+// Every item is <item><type>hex</type><code>hex</code><length>n</length>,
+// followed for n > 0 by <data encoding="base64">...</data>, then </item>.
+// The reader sleeps in poll() on the pipe. AirPlay senders cannot be
+// controlled from here, so transport commands are ignored.
+class ShairportSource : public PlayerSource {
 private:
-    static constexpr int SAMPLE_RATE = 44100;
-    static constexpr int CHANNELS = 2;
-    static constexpr int FRAMES_PER_BUFFER = 2048;
-    static constexpr int FFT_SIZE_BASS = 8192;
-    static constexpr int FFT_SIZE_MID = 2048;
-    static constexpr int FFT_SIZE_TREBLE = 512;
-    static constexpr float SILENCE_THRESHOLD = 0.001f;
-    static constexpr int SLEEP_TIMEOUT_SEC = 10;
-    
-    struct FreqBand {
-        int low, high;
-        float correction;
-    };
-    
-    static constexpr FreqBand FREQ_BANDS[7] = {
-        {63, 120, 0.5f}, {120, 350, 1.0f}, {350, 900, 2.0f},
-        {900, 2000, 3.5f}, {2000, 5000, 5.0f},
-        {5000, 10000, 7.0f}, {10000, 16000, 10.0f}
-    };
+    static constexpr int REOPEN_DELAY_SEC = 5;
+    static constexpr unsigned RTP_RATE = 44100;  // prgr positions are RTP frames
+    static constexpr size_t MAX_BUFFERED = 16 * 1024 * 1024;
     
-    snd_pcm_t* pcm_handle;
-    std::thread audio_thread;
+    std::string pipe_path;
+    int pipe_fd;
+    int keep_fd;  // Our own write end, so a restarting shairport-sync never EOFs the pipe
+    std::thread reader_thread;
     std::atomic<bool> thread_running;
-    std::atomic<bool> is_sleeping{false};
+    std::atomic<bool> shutdown_requested;
+    WakeEvent wake;
     
-    float* circular_buffer_left;
-    float* circular_buffer_right;
-    std::atomic<size_t> write_pos{0};
-    std::mutex buffer_mutex;
+    // Reader thread only
+    std::string buffer;
+    TrackMetadata track;  // Assembled from the current bundle (mdst..mden)
+    bool in_bundle;
+    PlaybackStatus status;
+    int next_song_id;
     
-    fftwf_plan plan_bass, plan_mid, plan_treble;
-    float *fft_in_bass, *fft_in_mid, *fft_in_treble;
-    fftwf_complex *fft_out_bass, *fft_out_mid, *fft_out_treble;
-    float *window_bass, *window_mid, *window_treble;
+    static constexpr uint32_t code(const char (&name)[5]) {
+        return (uint32_t)name[0] << 24 | (uint32_t)name[1] << 16 | (uint32_t)name[2] << 8 | (uint32_t)name[3];
+    }
     
-    std::array<float, 7> prev_left_spectrum{};
-    std::array<float, 7> prev_right_spectrum{};
+    static uint32_t bigEndian(const std::vector<uint8_t>& data) {
+        uint32_t value = 0;
+        for (uint8_t byte : data) value = value << 8 | byte;
+        return value;
+    }
     
-    float noise_reduction = 77.0f;
-    float sensitivity = 100.0f;
-    float integral_factor, gravity_factor, scale_factor;
+    static std::vector<uint8_t> decodeBase64(const char* text, size_t length) {
+        std::vector<uint8_t> out;
+        out.reserve(length * 3 / 4);
+        uint32_t bits = 0;
+        int count = 0;
+        for (size_t i = 0; i < length; i++) {
+            char c = text[i];
+            int value;
+            if (c >= 'A' && c <= 'Z') value = c - 'A';
+            else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+            else if (c >= '0' && c <= '9') value = c - '0' + 52;
+            else if (c == '+') value = 62;
+            else if (c == '/') value = 63;
+            else continue;  // Line breaks and padding
+            bits = bits << 6 | value;
+            if (++count == 4) {
+                out.push_back(bits >> 16);
+                out.push_back(bits >> 8);
+                out.push_back(bits);
+                bits = 0;
+                count = 0;
+            }
+        }
+        if (count == 3) {
+            out.push_back(bits >> 10);
+            out.push_back(bits >> 2);
+        } else if (count == 2) {
+            out.push_back(bits >> 4);
+        }
+        return out;
+    }
     
-    // Sleep detection
-    std::chrono::steady_clock::time_point last_audio_time;
-    std::atomic<float> max_amplitude{0.0f};
+    // Text between <tag> and </tag> inside [begin, end), empty when missing
+    static std::string element(const std::string& text, size_t begin, size_t end, const char* tag) {
+        std::string open = std::string("<") + tag + ">";
+        size_t start = text.find(open, begin);
+        if (start == std::string::npos || start >= end) return "";
+        start += open.size();
+        size_t stop = text.find(std::string("</") + tag + ">", start);
+        return stop == std::string::npos || stop > end ? "" : text.substr(start, stop - start);
+    }
     
-    void createHannWindow(float* window, int size) {
-        for (int i = 0; i < size; i++) {
-            window[i] = 0.5f * (1.0f - cosf(2.0f * M_PI * i / (size - 1)));
-        }
+    void setState(enum mpd_state state) {
+        auto now = std::chrono::steady_clock::now();
+        status.elapsed_ms = (unsigned)(status.elapsedAt(now) * 1000.0f);
+        status.synced = now;
+        status.state = state;
+        publishPlayback(status);
     }
     
-    void audioThreadFunc() {
-        int16_t* audio_buffer = new int16_t[FRAMES_PER_BUFFER * CHANNELS];
-        
-        while (thread_running) {
-            // Use smaller buffer during sleep for faster wake detection
-            int frames_to_read = is_sleeping ? 256 : FRAMES_PER_BUFFER;
-            
-            int frames = snd_pcm_readi(pcm_handle, audio_buffer, frames_to_read);
-            if (frames < 0) frames = snd_pcm_recover(pcm_handle, frames, 0);
-            if (frames < 0) continue;
-            
-            float frame_max = 0.0f;
-            
-            // During sleep, only calculate max amplitude (skip buffer updates)
-            if (is_sleeping) {
-                for (int i = 0; i < frames * CHANNELS; i++) {
-                    frame_max = std::max(frame_max, std::abs(audio_buffer[i] / 32768.0f));
+    void publishTrack() {
+        auto published = metadata.load();
+        bool same = track.title == published->title && track.artist == published->artist &&
+                    track.album == published->album;
+        track.song_id = same ? published->song_id : ++next_song_id;
+        updateFormattedText(track);
+        publishMetadata(track);
+        if (!same) {
+            AlbumArt art;  // Until the PICT item for this song arrives
+            art.song_id = track.song_id;
+            publishArt(art);
+        }
+    }
+    
+    void handleItem(uint32_t type, uint32_t item_code, const std::vector<uint8_t>& data) {
+        std::string text(data.begin(), data.end());
+        
+        if (type == code("core")) {
+            switch (item_code) {
+                case code("minm"): track.title = text; break;
+                case code("asar"): track.artist = text; break;
+                case code("asal"): track.album = text; break;
+                case code("astn"): {
+                    uint32_t number = bigEndian(data);
+                    track.track_number = number > 0 ? std::to_string(number) : "";
+                    break;
                 }
-                max_amplitude = frame_max;
-                if (frame_max > SILENCE_THRESHOLD) {
-                    last_audio_time = std::chrono::steady_clock::now();
+                case code("asyr"): {
+                    uint32_t year = bigEndian(data);
+                    track.year = year > 0 ? std::to_string(year) : "";
+                    break;
                 }
-                continue;  // Skip buffer writes during sleep
+                case code("astm"): status.duration_ms = bigEndian(data); break;
+                default: return;
+            }
+            if (!in_bundle) publishTrack();
+            return;
+        }
+        if (type != code("ssnc")) return;
+        
+        switch (item_code) {
+            case code("mdst"):
+                track = TrackMetadata();
+                in_bundle = true;
+                break;
+            case code("mden"):
+                in_bundle = false;
+                publishTrack();
+                break;
+            case code("PICT"): {
+                AlbumArt art;
+                art.song_id = metadata.load()->song_id;
+                art.present = !data.empty() && CoverDecoder::decode(data, art.bitmap.data());
+                publishArt(art);
+                break;
+            }
+            case code("pbeg"): case code("prsm"): case code("pres"):
+                setState(MPD_STATE_PLAY);
+                break;
+            case code("pfls"): case code("paus"):
+                setState(MPD_STATE_PAUSE);
+                break;
+            case code("pend"): case code("aend"):
+                setState(MPD_STATE_STOP);
+                break;
+            case code("prgr"): {
+                // "start/current/end" RTP timestamps, which wrap at 2^32
+                unsigned start, current, end;
+                if (sscanf(text.c_str(), "%u/%u/%u", &start, &current, &end) != 3) break;
+                status.elapsed_ms = (unsigned)((uint64_t)(uint32_t)(current - start) * 1000 / RTP_RATE);
+                status.duration_ms = (unsigned)((uint64_t)(uint32_t)(end - start) * 1000 / RTP_RATE);
+                status.synced = std::chrono::steady_clock::now();
+                publishPlayback(status);
+                break;
+            }
+            case code("pvol"): {
+                // "airplay,volume,lowest,highest"; AirPlay volume is -30..0 dB, -144 muted
+                float airplay;
+                if (sscanf(text.c_str(), "%f", &airplay) != 1) break;
+                status.volume = airplay <= -30.0f ? 0 : (int)lroundf((airplay + 30.0f) * 100.0f / 30.0f);
+                publishPlayback(status);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    
+    // Handle every complete item in the buffer, keeping a partial one for later
+    void parseItems() {
+        size_t pos = 0;
+        while (true) {
+            size_t start = buffer.find("<item>", pos);
+            if (start == std::string::npos) {
+                // Keep a tail that could be the start of a split "<item>"
+                pos = buffer.size() > 5 ? buffer.size() - 5 : 0;
+                break;
+            }
+            size_t end = buffer.find("</item>", start);
+            if (end == std::string::npos) {
+                pos = start;
+                break;
             }
             
-            // Normal processing when awake
-            std::lock_guard<std::mutex> lock(buffer_mutex);
-            size_t pos = write_pos;
+            std::string type = element(buffer, start, end, "type");
+            std::string item_code = element(buffer, start, end, "code");
+            std::vector<uint8_t> data;
+            size_t data_start = buffer.find("<data encoding=\"base64\">", start);
+            if (data_start < end) {
+                data_start += strlen("<data encoding=\"base64\">");
+                size_t data_end = buffer.find("</data>", data_start);
+                if (data_end < end) data = decodeBase64(buffer.data() + data_start, data_end - data_start);
+            }
+            handleItem((uint32_t)strtoul(type.c_str(), nullptr, 16), (uint32_t)strtoul(item_code.c_str(), nullptr, 16),
+                       data);
+            pos = end + strlen("</item>");
+        }
+        buffer.erase(0, pos);
+        if (buffer.size() > MAX_BUFFERED) {
+            printf("shairport-sync item too large, dropping %zu bytes\n", buffer.size());
+            buffer.clear();
+        }
+    }
+    
+    bool openPipe() {
+        pipe_fd = open(pipe_path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (pipe_fd < 0) return false;  // shairport-sync not installed or not started yet
+        
+        struct stat st;
+        if (fstat(pipe_fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+            printf("shairport-sync metadata: %s is not a FIFO\n", pipe_path.c_str());
+            closePipe();
+            return false;
+        }
+        keep_fd = open(pipe_path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+        buffer.clear();
+        in_bundle = false;
+        printf("Reading shairport-sync metadata from %s\n", pipe_path.c_str());
+        return true;
+    }
+    
+    void closePipe() {
+        if (pipe_fd >= 0) close(pipe_fd);
+        if (keep_fd >= 0) close(keep_fd);
+        pipe_fd = keep_fd = -1;
+    }
+    
+    void readerThreadFunc() {
+        while (!shutdown_requested) {
+            if (pipe_fd < 0 && !openPipe()) {
+                wake.wait(REOPEN_DELAY_SEC * 1000);
+                continue;
+            }
             
-            for (int i = 0; i < frames; i++) {
-                circular_buffer_left[pos] = audio_buffer[i * CHANNELS] / 32768.0f;
-                circular_buffer_right[pos] = (CHANNELS > 1) ? 
-                    audio_buffer[i * CHANNELS + 1] / 32768.0f : circular_buffer_left[pos];
-                
-                frame_max = std::max(frame_max, std::abs(circular_buffer_left[pos]));
-                frame_max = std::max(frame_max, std::abs(circular_buffer_right[pos]));
-                
-                pos = (pos + 1) % (FFT_SIZE_BASS * 2);
+            struct pollfd fds[2] = {
+                { pipe_fd, POLLIN, 0 },
+                { wake.get(), POLLIN, 0 },
+            };
+            if (poll(fds, 2, -1) < 0 && errno != EINTR) {
+                printf("shairport-sync poll error: %s\n", strerror(errno));
             }
-            write_pos = pos;
+            if (fds[1].revents & POLLIN) wake.drain();
             
-            // Update max amplitude for sleep detection
-            max_amplitude = frame_max;
-            if (frame_max > SILENCE_THRESHOLD) {
-                last_audio_time = std::chrono::steady_clock::now();
+            if (fds[0].revents & POLLIN) {
+                char chunk[16384];
+                ssize_t got;
+                while ((got = read(pipe_fd, chunk, sizeof(chunk))) > 0) {
+                    buffer.append(chunk, got);
+                }
+                if (got == 0) closePipe();  // No write end of our own (keep_fd failed)
+                else parseItems();
+            } else if (fds[0].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                closePipe();
+                wake.wait(REOPEN_DELAY_SEC * 1000);
             }
         }
-        
-        delete[] audio_buffer;
-    }
-
-    void updateParameters() {
-        float nr_normalized = noise_reduction / 100.0f;
-        integral_factor = nr_normalized * 0.95f;
-        gravity_factor = 1.0f - (nr_normalized * 0.8f);
-        gravity_factor = std::max(gravity_factor, 0.2f);
-        scale_factor = (sensitivity / 100.0f) * 2.2f;
+        closePipe();
     }
     
 public:
-    AudioProcessor() : pcm_handle(nullptr), thread_running(false) {
-        int buffer_size = FFT_SIZE_BASS * 2;
-        circular_buffer_left = new float[buffer_size]();
-        circular_buffer_right = new float[buffer_size]();
-        
-        // Allocate FFT resources
-        fft_in_bass = (float*)fftwf_malloc(sizeof(float) * FFT_SIZE_BASS);
-        fft_out_bass = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (FFT_SIZE_BASS/2 + 1));
-        plan_bass = fftwf_plan_dft_r2c_1d(FFT_SIZE_BASS, fft_in_bass, fft_out_bass, FFTW_ESTIMATE);
-        
-        fft_in_mid = (float*)fftwf_malloc(sizeof(float) * FFT_SIZE_MID);
-        fft_out_mid = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (FFT_SIZE_MID/2 + 1));
-        plan_mid = fftwf_plan_dft_r2c_1d(FFT_SIZE_MID, fft_in_mid, fft_out_mid, FFTW_ESTIMATE);
-        
-        fft_in_treble = (float*)fftwf_malloc(sizeof(float) * FFT_SIZE_TREBLE);
-        fft_out_treble = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * (FFT_SIZE_TREBLE/2 + 1));
-        plan_treble = fftwf_plan_dft_r2c_1d(FFT_SIZE_TREBLE, fft_in_treble, fft_out_treble, FFTW_ESTIMATE);
-        
-        // Create windows
-        window_bass = new float[FFT_SIZE_BASS];
-        window_mid = new float[FFT_SIZE_MID];
-        window_treble = new float[FFT_SIZE_TREBLE];
-        createHannWindow(window_bass, FFT_SIZE_BASS);
-        createHannWindow(window_mid, FFT_SIZE_MID);
-        createHannWindow(window_treble, FFT_SIZE_TREBLE);
-        
-        updateParameters();
-        last_audio_time = std::chrono::steady_clock::now();
+    explicit ShairportSource(const std::string& path = "/tmp/shairport-sync-metadata")
+        : pipe_path(path), pipe_fd(-1), keep_fd(-1), thread_running(false), shutdown_requested(false),
+          wake("shairport-sync"), in_bundle(false), next_song_id(0) {
+        TrackMetadata idle;
+        idle.title = "No AirPlay stream";
+        updateFormattedText(idle);
+        publishMetadata(idle);
+        publishPlayback(status);
     }
     
-    ~AudioProcessor() {
+    ~ShairportSource() {
         stop();
-        delete[] circular_buffer_left;
-        delete[] circular_buffer_right;
-        delete[] window_bass;
-        delete[] window_mid;
-        delete[] window_treble;
-        
-        fftwf_destroy_plan(plan_bass);
-        fftwf_destroy_plan(plan_mid);
-        fftwf_destroy_plan(plan_treble);
-        fftwf_free(fft_in_bass);
-        fftwf_free(fft_out_bass);
-        fftwf_free(fft_in_mid);
-        fftwf_free(fft_out_mid);
-        fftwf_free(fft_in_treble);
-        fftwf_free(fft_out_treble);
     }
     
-    bool start() {
-        int err = snd_pcm_open(&pcm_handle, "cava", SND_PCM_STREAM_CAPTURE, 0);
-        if (err < 0) {
-            err = snd_pcm_open(&pcm_handle, "hw:Loopback,1", SND_PCM_STREAM_CAPTURE, 0);
-        }
-        if (err < 0) return false;
-        
-        snd_pcm_hw_params_t* hw_params;
-        snd_pcm_hw_params_alloca(&hw_params);
-        snd_pcm_hw_params_any(pcm_handle, hw_params);
-        snd_pcm_hw_params_set_access(pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-        snd_pcm_hw_params_set_format(pcm_handle, hw_params, SND_PCM_FORMAT_S16_LE);
-        snd_pcm_hw_params_set_channels(pcm_handle, hw_params, CHANNELS);
-        
-        unsigned int rate = SAMPLE_RATE;
-        snd_pcm_hw_params_set_rate_near(pcm_handle, hw_params, &rate, 0);
-        
-        if (snd_pcm_hw_params(pcm_handle, hw_params) < 0) {
-            snd_pcm_close(pcm_handle);
-            return false;
-        }
-        
+    const char* name() const override { return "AirPlay"; }
+    
+    bool start() override {
+        if (thread_running) return true;
         thread_running = true;
-        audio_thread = std::thread(&AudioProcessor::audioThreadFunc, this);
+        shutdown_requested = false;
+        reader_thread = std::thread(&ShairportSource::readerThreadFunc, this);
         return true;
     }
-
-    void setSleepState(bool sleeping) {
-    is_sleeping = sleeping;
-    }
     
-    void stop() {
-        if (thread_running) {
-            thread_running = false;
-            if (audio_thread.joinable()) audio_thread.join();
-        }
-        if (pcm_handle) {
-            snd_pcm_close(pcm_handle);
-            pcm_handle = nullptr;
-        }
+    void stop() override {
+        if (!thread_running) return;
+        shutdown_requested = true;
+        thread_running = false;
+        wake.signal();
+        if (reader_thread.joinable()) reader_thread.join();
     }
     
-    bool checkForAudio() {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_audio_time).count();
-        return elapsed < SLEEP_TIMEOUT_SEC;
+    void setSleepState(bool sleeping) override {}  // Keeps reading so the state is right on wake
+    
+    uint64_t skipTracks(int tracks) override { return 0; }
+    uint64_t changeVolume(int delta) override { return 0; }
+    uint64_t seekBy(float seconds) override { return 0; }
+    uint64_t togglePause() override { return 0; }
+};
+
+// Mirrors one of several sources into its own snapshots, so renderers and
+// controls see a single player. The source that most recently started playing
+// is shown; when it stops, another playing source takes over, otherwise it
+// stays on screen. Sources report through their listener on their own
+// threads, so switching follows player events instead of polling.
+class PlayerArbiter : public PlayerSource {
+private:
+    struct Entry {
+        std::unique_ptr<PlayerSource> source;
+        bool playing;
+    };
+    
+    std::vector<Entry> sources;
+    std::mutex mutex;
+    std::atomic<PlayerSource*> active;
+    
+    // Snapshot versions of the active source last copied (under mutex)
+    uint64_t mirrored_metadata;
+    uint64_t mirrored_playback;
+    uint64_t mirrored_upcoming;
+    uint64_t mirrored_art;
+    
+    static bool isPlaying(const PlayerSource* source) {
+        auto status = source->getPlayback();
+        return status && status->state == MPD_STATE_PLAY;
     }
     
-    void getSpectrumData(std::array<int, 7>& left_out, std::array<int, 7>& right_out) {
-        std::array<float, 7> left_bands{}, right_bands{};
-        
-        // Get buffer data
-        float* temp_left = new float[FFT_SIZE_BASS];
-        float* temp_right = new float[FFT_SIZE_BASS];
-        
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex);
-            size_t read_pos = (write_pos + FFT_SIZE_BASS * 2 - FFT_SIZE_BASS) % (FFT_SIZE_BASS * 2);
-            for (int i = 0; i < FFT_SIZE_BASS; i++) {
-                temp_left[i] = circular_buffer_left[read_pos];
-                temp_right[i] = circular_buffer_right[read_pos];
-                read_pos = (read_pos + 1) % (FFT_SIZE_BASS * 2);
-            }
+    // Copy what changed; on a switch copy everything, clearing what the new source lacks
+    void mirror(PlayerSource* source, bool all) {
+        if (all || source->getMetadataVersion() != mirrored_metadata) {
+            auto track = source->getMetadata();
+            mirrored_metadata = track ? track->version : 0;
+            publishMetadata(track ? *track : TrackMetadata());
         }
-        
-        // Process FFTs (simplified - just using bass FFT for all bands)
-        for (int i = 0; i < FFT_SIZE_BASS; i++) {
-            fft_in_bass[i] = temp_left[i] * window_bass[i];
+        if (all || source->getPlaybackVersion() != mirrored_playback) {
+            auto status = source->getPlayback();
+            mirrored_playback = status ? status->version : 0;
+            publishPlayback(status ? *status : PlaybackStatus());
         }
-        fftwf_execute(plan_bass);
-        
-        // Process left channel
-        for (int i = 0; i < 7; i++) {
-            int low_idx = FREQ_BANDS[i].low * FFT_SIZE_BASS / SAMPLE_RATE;
-            int high_idx = FREQ_BANDS[i].high * FFT_SIZE_BASS / SAMPLE_RATE;
-            
-            float sum = 0.0f;
-            for (int j = low_idx; j < high_idx && j < FFT_SIZE_BASS/2; j++) {
-                float mag = sqrtf(fft_out_bass[j][0] * fft_out_bass[j][0] + 
-                                 fft_out_bass[j][1] * fft_out_bass[j][1]);
-                sum += mag * mag;
-            }
-            
-            left_bands[i] = sqrtf(sum / (high_idx - low_idx)) * scale_factor * FREQ_BANDS[i].correction;
+        if (all || source->getUpcomingVersion() != mirrored_upcoming) {
+            auto next = source->getUpcoming();
+            mirrored_upcoming = next ? next->version : 0;
+            publishUpcoming(next ? *next : TrackMetadata());
         }
-        
-        // Process right channel
-        for (int i = 0; i < FFT_SIZE_BASS; i++) {
-            fft_in_bass[i] = temp_right[i] * window_bass[i];
+        if (all || source->getAlbumArtVersion() != mirrored_art) {
+            auto art = source->getAlbumArt();
+            mirrored_art = art ? art->version : 0;
+            publishArt(art ? *art : AlbumArt());
         }
-        fftwf_execute(plan_bass);
-        
-        for (int i = 0; i < 7; i++) {
-            int low_idx = FREQ_BANDS[i].low * FFT_SIZE_BASS / SAMPLE_RATE;
-            int high_idx = FREQ_BANDS[i].high * FFT_SIZE_BASS / SAMPLE_RATE;
-            
-            float sum = 0.0f;
-            for (int j = low_idx; j < high_idx && j < FFT_SIZE_BASS/2; j++) {
-                float mag = sqrtf(fft_out_bass[j][0] * fft_out_bass[j][0] + 
-                                 fft_out_bass[j][1] * fft_out_bass[j][1]);
-                sum += mag * mag;
-            }
-            
-            right_bands[i] = sqrtf(sum / (high_idx - low_idx)) * scale_factor * FREQ_BANDS[i].correction;
+    }
+    
+    void onSourceChanged(PlayerSource* source) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry* entry = nullptr;
+        for (auto& candidate : sources) {
+            if (candidate.source.get() == source) entry = &candidate;
         }
-        
-        // Apply smoothing
-        for (int i = 0; i < 7; i++) {
-            float smoothed_left = integral_factor * prev_left_spectrum[i] + 
-                                 (1.0f - integral_factor) * left_bands[i];
-            float smoothed_right = integral_factor * prev_right_spectrum[i] + 
-                                  (1.0f - integral_factor) * right_bands[i];
-            
-            if (smoothed_left < prev_left_spectrum[i]) {
-                float fall = (prev_left_spectrum[i] - smoothed_left) * gravity_factor;
-                prev_left_spectrum[i] -= fall;
-                prev_left_spectrum[i] = std::max(prev_left_spectrum[i], smoothed_left);
-            } else {
-                prev_left_spectrum[i] = smoothed_left;
-            }
-            
-            if (smoothed_right < prev_right_spectrum[i]) {
-                float fall = (prev_right_spectrum[i] - smoothed_right) * gravity_factor;
-                prev_right_spectrum[i] -= fall;
-                prev_right_spectrum[i] = std::max(prev_right_spectrum[i], smoothed_right);
-            } else {
-                prev_right_spectrum[i] = smoothed_right;
+        if (!entry) return;
+        
+        bool playing = isPlaying(source);
+        bool started = playing && !entry->playing;
+        entry->playing = playing;
+        
+        PlayerSource* current = active.load();
+        PlayerSource* next = current;
+        if (started) {
+            next = source;
+        } else if (source == current && !playing) {
+            for (auto& candidate : sources) {
+                if (candidate.playing) {
+                    next = candidate.source.get();
+                    break;
+                }
             }
-            
-            left_out[i] = std::min(255, std::max(0, (int)prev_left_spectrum[i]));
-            right_out[i] = std::min(255, std::max(0, (int)prev_right_spectrum[i]));
         }
         
-        delete[] temp_left;
-        delete[] temp_right;
+        if (next != current) {
+            printf("Player switched to %s\n", next->name());
+            active.store(next);
+            mirror(next, true);
+        } else if (source == current) {
+            mirror(current, false);
+        }
     }
     
-    void getVUMeterData(int& left_out, int& right_out) {
-        std::array<int, 7> left_spectrum, right_spectrum;
-        getSpectrumData(left_spectrum, right_spectrum);
-        
-        int left_sum = 0, right_sum = 0;
-        for (int i = 0; i < 7; i++) {
-            left_sum += left_spectrum[i];
-            right_sum += right_spectrum[i];
-        }
-        
-        left_out = left_sum / 7;
-        right_out = right_sum / 7;
+public:
+    PlayerArbiter()
+        : active(nullptr), mirrored_metadata(0), mirrored_playback(0), mirrored_upcoming(0), mirrored_art(0) {}
+    
+    ~PlayerArbiter() {
+        stop();  // Join the source threads before their listener goes away
     }
     
-    void getWaveformData(float* out, int samples, bool left_channel) {
-        std::lock_guard<std::mutex> lock(buffer_mutex);
-        size_t read_pos = (write_pos + FFT_SIZE_BASS * 2 - samples) % (FFT_SIZE_BASS * 2);
-        
-        for (int i = 0; i < samples; i++) {
-            out[i] = left_channel ? circular_buffer_left[read_pos] : circular_buffer_right[read_pos];
-            read_pos = (read_pos + 1) % (FFT_SIZE_BASS * 2);
+    // Before start(); the first source is shown until another starts playing
+    void addSource(std::unique_ptr<PlayerSource> source) {
+        source->setListener([this](PlayerSource* changed) { onSourceChanged(changed); });
+        std::lock_guard<std::mutex> lock(mutex);
+        bool first = sources.empty();
+        sources.push_back({ std::move(source), false });
+        sources.back().playing = isPlaying(sources.back().source.get());
+        if (first) {
+            active.store(sources.back().source.get());
+            mirror(active.load(), true);
         }
     }
     
-    void getStereoAnalysis(float& phase, float& correlation) {
-        const int ANALYSIS_SAMPLES = 512;
-        float left[ANALYSIS_SAMPLES], right[ANALYSIS_SAMPLES];
-        
-        {
-            std::lock_guard<std::mutex> lock(buffer_mutex);
-            size_t read_pos = (write_pos + FFT_SIZE_BASS * 2 - ANALYSIS_SAMPLES) % (FFT_SIZE_BASS * 2);
-            
-            for (int i = 0; i < ANALYSIS_SAMPLES; i++) {
-                left[i] = circular_buffer_left[read_pos];
-                right[i] = circular_buffer_right[read_pos];
-                read_pos = (read_pos + 1) % (FFT_SIZE_BASS * 2);
-            }
-        }
-        
-        // Calculate phase difference
-        float sum_phase = 0.0f;
-        for (int i = 0; i < ANALYSIS_SAMPLES; i++) {
-            if (std::abs(left[i]) > 0.01f && std::abs(right[i]) > 0.01f) {
-                sum_phase += atan2f(right[i], left[i]);
-            }
-        }
-        phase = sum_phase / ANALYSIS_SAMPLES;
-        
-        // Calculate correlation
-        float sum_l = 0, sum_r = 0, sum_lr = 0, sum_l2 = 0, sum_r2 = 0;
-        for (int i = 0; i < ANALYSIS_SAMPLES; i++) {
-            sum_l += left[i];
-            sum_r += right[i];
-            sum_lr += left[i] * right[i];
-            sum_l2 += left[i] * left[i];
-            sum_r2 += right[i] * right[i];
-        }
-        
-        float n = ANALYSIS_SAMPLES;
-        float num = n * sum_lr - sum_l * sum_r;
-        float den = sqrtf((n * sum_l2 - sum_l * sum_l) * (n * sum_r2 - sum_r * sum_r));
-        
-        correlation = (den > 0) ? num / den : 0.0f;
-        correlation = std::max(-1.0f, std::min(1.0f, correlation));
+    const char* name() const override {
+        PlayerSource* current = active.load();
+        return current ? current->name() : "none";
     }
     
-    void setSensitivity(int value) {
-        sensitivity = std::max(10.0f, std::min(300.0f, (float)value));
-        updateParameters();
+    bool start() override {
+        for (auto& entry : sources) entry.source->start();
+        return !sources.empty();
     }
-
-    void setNoiseReduction(int value) {
-        noise_reduction = std::max(0.0f, std::min(100.0f, (float)value));
-        updateParameters();
+    
+    void stop() override {
+        for (auto& entry : sources) entry.source->stop();
     }
     
-    int getSensitivity() const { return (int)sensitivity; }
-    int getNoiseReduction() const { return (int)noise_reduction; }
+    void setSleepState(bool sleeping) override {
+        for (auto& entry : sources) entry.source->setSleepState(sleeping);
+    }
+    
+    // Transport controls go to whichever player is shown
+    uint64_t skipTracks(int tracks) override {
+        PlayerSource* current = active.load();
+        return current ? current->skipTracks(tracks) : 0;
+    }
+    
+    uint64_t changeVolume(int delta) override {
+        PlayerSource* current = active.load();
+        return current ? current->changeVolume(delta) : 0;
+    }
+    
+    uint64_t seekBy(float seconds) override {
+        PlayerSource* current = active.load();
+        return current ? current->seekBy(seconds) : 0;
+    }
+    
+    uint64_t togglePause() override {
+        PlayerSource* current = active.load();
+        return current ? current->togglePause() : 0;
+    }
 };
 
-// Improved TextScroller with smooth pixel-based scrolling
-class TextScroller {
+// Font manager class
+class FontManager {
 private:
-    std::string current_text;
-    float scroll_position;  // Now uses float for sub-pixel precision
-    std::chrono::steady_clock::time_point last_scroll_time;
-    int pause_counter;
-    int text_width_pixels;
-    bool needs_scrolling;
-    
-    static constexpr float SCROLL_SPEED_PIXELS_PER_SECOND = 30.0f;  // Adjustable speed
-    static constexpr int SCROLL_PAUSE_MS = 2000;  // Pause at start/end
-    static constexpr int SCROLL_GAP_PIXELS = 1;  // Gap between text repetitions
-    
-    enum ScrollState {
-        PAUSED_AT_START,
-        SCROLLING,
-        PAUSED_AT_END
-    } scroll_state;
+    FT_Library library;
+    FT_Face face_regular;
+    FT_Face face_small;
+    FT_Face face_large;
+    bool initialized;
     
 public:
-    TextScroller() : scroll_position(0.0f), pause_counter(0), 
-                     text_width_pixels(0), needs_scrolling(false),
-                     scroll_state(PAUSED_AT_START) {
-        last_scroll_time = std::chrono::steady_clock::now();
-    }
+    FontManager() : library(nullptr), face_regular(nullptr), face_small(nullptr), 
+                   face_large(nullptr), initialized(false) {}
     
-    void setText(const std::string& text) {
-        if (text != current_text) {
-            current_text = text;
-            scroll_position = 0.0f;
-            scroll_state = PAUSED_AT_START;
-            pause_counter = SCROLL_PAUSE_MS;
-            text_width_pixels = 0;
-            needs_scrolling = false;
+    ~FontManager() {
+        if (initialized) {
+            if (face_large) FT_Done_Face(face_large);
+            if (face_small) FT_Done_Face(face_small);
+            if (face_regular) FT_Done_Face(face_regular);
+            if (library) FT_Done_FreeType(library);
         }
     }
     
-    std::string getScrollingText(int max_width, FontManager* font_manager, 
-                                FontManager::FontSize font_size = FontManager::SMALL) {
-        if (!font_manager || !font_manager->isInitialized() || current_text.empty()) {
-            return current_text;
+    bool init(const char* font_path) {
+        FT_Error error = FT_Init_FreeType(&library);
+        if (error) {
+            printf("FreeType init error: %d\n", error);
+            return false;
         }
         
-        // Calculate text width if not done yet
-        if (text_width_pixels == 0) {
-            text_width_pixels = font_manager->getTextWidth(current_text.c_str(), font_size);
-            needs_scrolling = text_width_pixels > max_width;
-            
-            if (!needs_scrolling) {
-                return current_text;  // Text fits, no scrolling needed
-            }
+        // Load regular size (10px)
+        error = FT_New_Face(library, font_path, 0, &face_regular);
+        if (error) {
+            printf("Font loading error: %d (check path: %s)\n", error, font_path);
+            FT_Done_FreeType(library);
+            library = nullptr;
+            return false;
         }
+        FT_Set_Pixel_Sizes(face_regular, 0, 10);
         
-        if (!needs_scrolling) {
-            return current_text;
+        // Load small size (8px)
+        error = FT_New_Face(library, font_path, 0, &face_small);
+        if (!error) {
+            FT_Set_Pixel_Sizes(face_small, 0, 8);
         }
         
-        // Handle scrolling timing
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_scroll_time).count();
-        last_scroll_time = now;
+        // Load large size (14px)
+        error = FT_New_Face(library, font_path, 0, &face_large);
+        if (!error) {
+            FT_Set_Pixel_Sizes(face_large, 0, 14);
+        }
+        
+        initialized = true;
+        printf("Font loaded: %s (8px, 10px, 14px)\n", font_path);
+        return true;
+    }
+    
+    enum FontSize { SMALL, REGULAR, LARGE };
+    
+    bool renderText(const char* text, uint8_t* buffer, int buf_width, int buf_height, 
+                   int x, int y, FontSize size = REGULAR, bool invert = false) {
+        if (!initialized || !text) return false;
+        
+        FT_Face face = face_regular;
+        switch (size) {
+            case SMALL: face = face_small ? face_small : face_regular; break;
+            case LARGE: face = face_large ? face_large : face_regular; break;
+            default: break;
+        }
+        
+        int cursor_x = x;
+        int baseline_y = y;
+        
+        while (*text) {
+            FT_Error error = FT_Load_Char(face, *text, FT_LOAD_RENDER);
+            if (error) {
+                text++;
+                continue;
+            }
+            
+            FT_GlyphSlot slot = face->glyph;
+            FT_Bitmap* bitmap = &slot->bitmap;
+            
+            int start_x = cursor_x + slot->bitmap_left;
+            int start_y = baseline_y - slot->bitmap_top;
+            
+            for (unsigned int row = 0; row < bitmap->rows; row++) {
+                for (unsigned int col = 0; col < bitmap->width; col++) {
+                    int px = start_x + col;
+                    int py = start_y + row;
+                    
+                    if (px >= 0 && px < buf_width && py >= 0 && py < buf_height) {
+                        uint8_t gray = bitmap->buffer[row * bitmap->pitch + col];
+                        bool pixel_on = gray > 128;
+                        if (invert) pixel_on = !pixel_on;
+                        
+                        if (pixel_on) {
+                            int page = py / 8;
+                            int bit = py % 8;
+                            buffer[page * buf_width + px] |= (1 << bit);
+                        }
+                    }
+                }
+            }
+            
+            cursor_x += slot->advance.x >> 6;
+            text++;
+        }
+        
+        return true;
+    }
+    
+    int getTextWidth(const char* text, FontSize size = REGULAR) {
+        if (!initialized || !text) return 0;
+        
+        FT_Face face = face_regular;
+        switch (size) {
+            case SMALL: face = face_small ? face_small : face_regular; break;
+            case LARGE: face = face_large ? face_large : face_regular; break;
+            default: break;
+        }
+        
+        int width = 0;
+        while (*text) {
+            FT_Error error = FT_Load_Char(face, *text, FT_LOAD_DEFAULT);
+            if (!error) {
+                width += face->glyph->advance.x >> 6;
+            }
+            text++;
+        }
+        return width;
+    }
+    
+    int getFontHeight(FontSize size = REGULAR) {
+        if (!initialized) return 12;
+        
+        FT_Face face = face_regular;
+        switch (size) {
+            case SMALL: face = face_small ? face_small : face_regular; break;
+            case LARGE: face = face_large ? face_large : face_regular; break;
+            default: break;
+        }
+        
+        return face->size->metrics.height >> 6;
+    }
+    
+    bool isInitialized() const { return initialized; }
+};
+
+// Display class
+// One byte of the page buffer touched by a precomputed shape
+struct PixelSpan {
+    uint16_t offset;  // page * 128 + column
+    uint8_t mask;
+};
+
+class Display {
+private:
+    uint8_t _cs, _dc, _rst;
+    FontManager* font_manager;
+
+public:
+    uint8_t buffer[1024];
+    
+    Display(uint8_t cs, uint8_t dc, uint8_t rst) : _cs(cs), _dc(dc), _rst(rst), font_manager(nullptr) {
+        memset(buffer, 0x00, sizeof(buffer));
+    }
+    
+    bool begin() {
+        bcm2835_gpio_fsel(_cs, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(_dc, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_fsel(_rst, BCM2835_GPIO_FSEL_OUTP);
+        
+        bcm2835_gpio_write(_rst, LOW);
+        bcm2835_delay(10);
+        bcm2835_gpio_write(_rst, HIGH);
+        
+        sendCommand(0xAE);
+        sendCommand(0x20); sendCommand(0x00);
+        sendCommand(0xB0);
+        sendCommand(0xC8);
+        sendCommand(0x00);
+        sendCommand(0x10);
+        sendCommand(0x40);
+        sendCommand(0x81); sendCommand(0x7F);
+        sendCommand(0xA1);
+        sendCommand(0xA6);
+        sendCommand(0xA8); sendCommand(0x3F);
+        sendCommand(0xA4);
+        sendCommand(0xD3); sendCommand(0x00);
+        sendCommand(0xD5); sendCommand(0x80);
+        sendCommand(0xD9); sendCommand(0xF1);
+        sendCommand(0xDA); sendCommand(0x12);
+        sendCommand(0xDB); sendCommand(0x40);
+        sendCommand(0x8D); sendCommand(0x14);
+        sendCommand(0xAF);
+        return true;
+    }
+    
+    void sendCommand(uint8_t cmd) {
+        bcm2835_gpio_write(_dc, LOW);
+        bcm2835_gpio_write(_cs, LOW);
+        bcm2835_spi_transfer(cmd);
+        bcm2835_gpio_write(_cs, HIGH);
+    }
+    
+    void sendData(uint8_t data) {
+        bcm2835_gpio_write(_dc, HIGH);
+        bcm2835_gpio_write(_cs, LOW);
+        bcm2835_spi_transfer(data);
+        bcm2835_gpio_write(_cs, HIGH);
+    }
+    
+    void display() {
+        // Reset the addressing window a previous displayRegion() narrowed
+        sendCommand(0x21); sendCommand(0x00); sendCommand(0x7F);
+        sendCommand(0x22); sendCommand(0x00); sendCommand(0x07);
+        for (uint8_t page = 0; page < 8; page++) {
+            sendCommand(0xB0 + page);
+            sendCommand(0x00);
+            sendCommand(0x10);
+            for (uint8_t col = 0; col < 128; col++) {
+                sendData(buffer[page * 128 + col]);
+            }
+        }
+    }
+    
+    // Push only a column/page window; horizontal addressing wraps inside it
+    void displayRegion(uint8_t col_lo, uint8_t col_hi, uint8_t page_lo, uint8_t page_hi) {
+        sendCommand(0x21); sendCommand(col_lo); sendCommand(col_hi);
+        sendCommand(0x22); sendCommand(page_lo); sendCommand(page_hi);
+        for (int page = page_lo; page <= page_hi; page++) {
+            for (int col = col_lo; col <= col_hi; col++) {
+                sendData(buffer[page * 128 + col]);
+            }
+        }
+    }
+    
+    void clear() {
+        memset(buffer, 0x00, sizeof(buffer));
+    }
+    
+    void orSpans(const PixelSpan* spans, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            buffer[spans[i].offset] |= spans[i].mask;
+        }
+    }
+    
+    void sleep() {
+        sendCommand(0xAE); // Display off
+    }
+    
+    void wake() {
+        sendCommand(0xAF); // Display on
+    }
+    
+    void drawPixel(uint8_t x, uint8_t y) {
+        if (x >= 128 || y >= 64) return;
+        buffer[(y / 8) * 128 + x] |= (1 << (y % 8));
+    }
+    
+    void clearPixel(uint8_t x, uint8_t y) {
+        if (x >= 128 || y >= 64) return;
+        buffer[(y / 8) * 128 + x] &= ~(1 << (y % 8));
+    }
+    
+    void drawLine(int x0, int y0, int x1, int y1) {
+        int dx = abs(x1 - x0), dy = abs(y1 - y0);
+        int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+        int err = dx - dy;
+        
+        while (true) {
+            drawPixel(x0, y0);
+            if (x0 == x1 && y0 == y1) break;
+            int e2 = 2 * err;
+            if (e2 > -dy) { err -= dy; x0 += sx; }
+            if (e2 < dx) { err += dx; y0 += sy; }
+        }
+    }
+    
+    void drawRect(int x, int y, int w, int h, bool filled = false) {
+        if (filled) {
+            for (int i = y; i < y + h && i < 64; i++) {
+                for (int j = x; j < x + w && j < 128; j++) {
+                    drawPixel(j, i);
+                }
+            }
+        } else {
+            drawLine(x, y, x + w - 1, y);
+            drawLine(x + w - 1, y, x + w - 1, y + h - 1);
+            drawLine(x + w - 1, y + h - 1, x, y + h - 1);
+            drawLine(x, y + h - 1, x, y);
+        }
+    }
+    
+    void drawCircle(int x0, int y0, int radius, bool filled = false) {
+        if (filled) {
+            // For filled circle, we'll draw horizontal lines for each row
+            for (int y = -radius; y <= radius; y++) {
+                int x = (int)sqrt(radius * radius - y * y);
+                drawLine(x0 - x, y0 + y, x0 + x, y0 + y);
+            }
+        } else {
+            // Bresenham's circle algorithm for outline
+            int x = radius;
+            int y = 0;
+            int err = 0;
+            
+            while (x >= y) {
+                // Draw 8 octants
+                drawPixel(x0 + x, y0 + y);
+                drawPixel(x0 + y, y0 + x);
+                drawPixel(x0 - y, y0 + x);
+                drawPixel(x0 - x, y0 + y);
+                drawPixel(x0 - x, y0 - y);
+                drawPixel(x0 - y, y0 - x);
+                drawPixel(x0 + y, y0 - x);
+                drawPixel(x0 + x, y0 - y);
+                
+                if (err <= 0) {
+                    y += 1;
+                    err += 2 * y + 1;
+                }
+                if (err > 0) {
+                    x -= 1;
+                    err -= 2 * x + 1;
+                }
+            }
+        }
+    }
+
+    void setFont(FontManager* fm) {
+        font_manager = fm;
+    }
+    
+    // Text drawing using TTF fonts only
+    void drawText(uint8_t x, uint8_t y, const char* text, FontManager::FontSize size = FontManager::REGULAR) {
+        if (!font_manager || !font_manager->isInitialized()) {
+            printf("Warning: Font manager not initialized\n");
+            return;
+        }
+        font_manager->renderText(text, buffer, 128, 64, x, y, size);
+    }
+    
+    // Centered text drawing
+    void drawTextCentered(uint8_t y, const char* text, FontManager::FontSize size = FontManager::REGULAR) {
+        if (!font_manager || !font_manager->isInitialized()) return;
+        
+        int text_width = font_manager->getTextWidth(text, size);
+        int x = (128 - text_width) / 2;
+        if (x < 0) x = 0;
+        
+        drawText(x, y, text, size);
+    }
+    
+    // Text with background
+    void drawTextWithBackground(uint8_t x, uint8_t y, const char* text, 
+                               FontManager::FontSize size = FontManager::REGULAR, bool invert = false) {
+        if (!font_manager || !font_manager->isInitialized()) return;
+        
+        int text_width = font_manager->getTextWidth(text, size);
+        int text_height = font_manager->getFontHeight(size);
+        
+        // Draw background
+        drawRect(x - 1, y - text_height - 1, text_width + 2, text_height + 2, !invert);
+        
+        // Draw text
+        if (invert) {
+            // For inverted text, we need to clear the text area first
+            for (int i = 0; i < text_height; i++) {
+                for (int j = 0; j < text_width; j++) {
+                    clearPixel(x + j, y - text_height + i);
+                }
+            }
+        }
+        
+        font_manager->renderText(text, buffer, 128, 64, x, y, size, invert);
+    }
+};
+
+// Control State
+struct ControlState {
+    std::atomic<bool> running{true};
+    std::atomic<int> current_viz{0};
+    std::atomic<bool> is_sleeping{false};
+};
+
+// Compile-time math for generating band tables
+namespace BandMath {
+    constexpr double LN2 = 0.69314718055994530942;
+    
+    constexpr double ln(double x) {
+        // x = m * 2^k with m in [0.5, 1), then ln(m) = 2 atanh((m - 1) / (m + 1))
+        int k = 0;
+        while (x >= 1.0) { x /= 2.0; k++; }
+        while (x < 0.5) { x *= 2.0; k--; }
+        double y = (x - 1.0) / (x + 1.0);
+        double term = y, sum = 0.0;
+        for (int i = 1; i < 41; i += 2) {
+            sum += term / i;
+            term *= y * y;
+        }
+        return 2.0 * sum + k * LN2;
+    }
+    
+    constexpr double exp(double x) {
+        // x = k ln2 + r, Taylor series for e^r
+        int k = (int)(x / LN2);
+        double r = x - k * LN2;
+        double term = 1.0, sum = 1.0;
+        for (int i = 1; i < 30; i++) {
+            term *= r / i;
+            sum += term;
+        }
+        for (; k > 0; k--) sum *= 2.0;
+        for (; k < 0; k++) sum /= 2.0;
+        return sum;
+    }
+}
+
+// Spectrum band layout, fixed at compile time with -DAAV_BANDS=7|16|32|64.
+// 7 bands keep the original hand-tuned table; other counts are log-spaced
+// over the same 63 Hz - 16 kHz range, with correction factors interpolated
+// from the original table and labels generated from the band centres.
+template <int N>
+struct BandLayout {
+    static_assert(N == 7 || N == 16 || N == 32 || N == 64, "AAV_BANDS must be 7, 16, 32 or 64");
+    
+    typedef std::array<char, 6> Label;
+    
+    struct Table {
+        std::array<int, N> low{};
+        std::array<int, N> high{};
+        std::array<float, N> correction{};
+        std::array<Label, N> labels{};
+    };
+    
+    static constexpr int COUNT = N;
+    static constexpr int BAR_PITCH = N == 7 ? 19 : 128 / N;
+    static constexpr int BAR_WIDTH = N == 7 ? 12 : std::max(1, BAR_PITCH * 3 / 4);
+    static constexpr int LABEL_STRIDE = (19 + BAR_PITCH - 1) / BAR_PITCH;
+    
+private:
+    static constexpr int LEGACY_LOW[7] = { 63, 120, 350, 900, 2000, 5000, 10000 };
+    static constexpr int LEGACY_HIGH[7] = { 120, 350, 900, 2000, 5000, 10000, 16000 };
+    static constexpr float LEGACY_CORRECTION[7] = { 0.5f, 1.0f, 2.0f, 3.5f, 5.0f, 7.0f, 10.0f };
+    static constexpr const char* LEGACY_LABELS[7] = { "63", "160", "400", "1K", "2.5K", "6.3K", "16K" };
+    
+    static constexpr Label makeLabel(const char* text) {
+        Label label{};
+        for (int i = 0; i < 5 && text[i]; i++) label[i] = text[i];
+        return label;
+    }
+    
+    // "87", "1.3K", "13K"
+    static constexpr Label formatFrequency(double hz) {
+        Label label{};
+        int pos = 0;
+        int value = hz < 1000.0 ? (int)(hz + 0.5) : (int)(hz / 100.0 + 0.5);  // Hz or tenths of kHz
+        bool khz = hz >= 1000.0;
+        int whole = khz ? value / 10 : value;
+        char digits[4] = {};
+        int count = 0;
+        do {
+            digits[count++] = '0' + whole % 10;
+            whole /= 10;
+        } while (whole > 0 && count < 4);
+        while (count > 0) label[pos++] = digits[--count];
+        if (khz && value < 100 && value % 10 != 0) {
+            label[pos++] = '.';
+            label[pos++] = '0' + value % 10;
+        }
+        if (khz) label[pos++] = 'K';
+        return label;
+    }
+    
+    // Interpolate the original corrections on a log-frequency axis
+    static constexpr float interpolateCorrection(double hz) {
+        double x = BandMath::ln(hz);
+        double prev_x = BandMath::ln(LEGACY_LOW[0] * (double)LEGACY_HIGH[0]) / 2.0;
+        if (x <= prev_x) return LEGACY_CORRECTION[0];
+        for (int i = 1; i < 7; i++) {
+            double next_x = BandMath::ln(LEGACY_LOW[i] * (double)LEGACY_HIGH[i]) / 2.0;
+            if (x <= next_x) {
+                double t = (x - prev_x) / (next_x - prev_x);
+                return (float)(LEGACY_CORRECTION[i - 1] + t * (LEGACY_CORRECTION[i] - LEGACY_CORRECTION[i - 1]));
+            }
+            prev_x = next_x;
+        }
+        return LEGACY_CORRECTION[6];
+    }
+    
+    static constexpr Table build() {
+        Table table{};
+        if (N == 7) {
+            for (int i = 0; i < N; i++) {
+                table.low[i] = LEGACY_LOW[i];
+                table.high[i] = LEGACY_HIGH[i];
+                table.correction[i] = LEGACY_CORRECTION[i];
+                table.labels[i] = makeLabel(LEGACY_LABELS[i]);
+            }
+            return table;
+        }
+        
+        double log_low = BandMath::ln(LEGACY_LOW[0]);
+        double log_high = BandMath::ln(LEGACY_HIGH[6]);
+        for (int i = 0; i < N; i++) {
+            double lo = BandMath::exp(log_low + (log_high - log_low) * i / N);
+            double hi = BandMath::exp(log_low + (log_high - log_low) * (i + 1) / N);
+            double centre = BandMath::exp((BandMath::ln(lo) + BandMath::ln(hi)) / 2.0);
+            table.low[i] = (int)(lo + 0.5);
+            table.high[i] = std::max(table.low[i] + 1, (int)(hi + 0.5));
+            table.correction[i] = interpolateCorrection(centre);
+            table.labels[i] = formatFrequency(centre);
+        }
+        return table;
+    }
+    
+public:
+    static constexpr Table TABLE = build();
+};
+
+constexpr int BAND_COUNT = AAV_BANDS;
+typedef BandLayout<BAND_COUNT> Bands;
+
+// Fixed pool of pinned threads for fork-join work inside one analysis hop.
+// run() hands out task indices to the workers and the calling thread alike
+// and returns once all of them have finished, so a pool of size 1 simply
+// runs everything inline on the caller.
+class WorkerPool {
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    
+    // Current job, published under the mutex by bumping generation. A worker
+    // still draining the previous job may claim tasks of the next one, so
+    // next_task is reset last and the other two are atomics.
+    std::atomic<const std::function<void(int)>*> job{nullptr};
+    std::atomic<int> job_count{0};
+    uint64_t generation = 0;
+    std::atomic<int> next_task{0};
+    int busy_workers = 0;
+    bool stopping = false;
+    
+    void drain() {
+        for (int task = next_task++; task < job_count; task = next_task++) {
+            (*job.load())(task);
+        }
+    }
+    
+    static void pinToCore(std::thread& thread, int core) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(core, &cpus);
+        if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) != 0) {
+            printf("Warning: could not pin analysis worker to core %d\n", core);
+        }
+    }
+    
+    void workerLoop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            start_cv.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            busy_workers++;
+            
+            lock.unlock();
+            drain();
+            lock.lock();
+            
+            if (--busy_workers == 0) {
+                done_cv.notify_one();
+            }
+        }
+    }
+    
+public:
+    // size counts the calling thread; extra workers go to cores 1, 2, ...
+    explicit WorkerPool(int size) {
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        for (int i = 1; i < size; i++) {
+            threads.emplace_back(&WorkerPool::workerLoop, this);
+            pinToCore(threads.back(), i % cores);
+        }
+    }
+    
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+    
+    int size() const { return (int)threads.size() + 1; }
+    
+    // Run fn(0) .. fn(count - 1) across the pool and wait for all of them
+    void run(int count, const std::function<void(int)>& fn) {
+        if (threads.empty()) {
+            for (int i = 0; i < count; i++) fn(i);
+            return;
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &fn;
+            job_count = count;
+            next_task = 0;
+            generation++;
+        }
+        start_cv.notify_all();
+        drain();
+        
+        // Tasks are all claimed once drain returns; wait for the ones in flight
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [&] { return busy_workers == 0; });
+        job = nullptr;
+    }
+};
+
+// Lock-free single-producer/single-consumer triple buffer.
+// The producer fills the back slot and swaps it with the middle one; the
+// consumer only swaps the middle slot into the front when a newer value has
+// been published, so neither side ever waits on the other.
+template <typename T>
+class TripleBuffer {
+private:
+    static constexpr uint8_t INDEX_MASK = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+    
+    std::array<T, 3> slots{};
+    std::atomic<uint8_t> middle{1};  // Middle slot index | FRESH
+    uint8_t back = 0;                // Owned by the producer
+    uint8_t front = 2;               // Owned by the consumer
+    
+public:
+    // Producer side: slot to fill (holds stale data, overwrite every field)
+    T& writeBuffer() { return slots[back]; }
+    
+    void publish() {
+        uint8_t prev = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = prev & INDEX_MASK;
+    }
+    
+    // Consumer side: latest published value
+    const T& read() {
+        if (middle.load(std::memory_order_acquire) & FRESH) {
+            uint8_t prev = middle.exchange(front, std::memory_order_acq_rel);
+            front = prev & INDEX_MASK;
+        }
+        return slots[front];
+    }
+};
+
+// Analysis products a visualization can ask for. The capture thread only
+// runs the nodes needed for the requested set, see featureClosure.
+enum AnalysisFeature : uint32_t {
+    FEATURE_SPECTRUM    = 1u << 0,  // Smoothed band levels
+    FEATURE_LEVELS      = 1u << 1,  // VU / PPM ballistics
+    FEATURE_WAVEFORM    = 1u << 2,  // Recent samples
+    FEATURE_CORRELATION = 1u << 3,  // Broadband correlation and phase
+    FEATURE_ONSET       = 1u << 4,  // Spectral flux onset detection
+    FEATURE_COHERENCE   = 1u << 5,  // Per-band coherence and balance
+    FEATURE_NEEDLE      = 1u << 6,  // Simulated VU needle positions
+    FEATURE_ALL         = (1u << 7) - 1,
+    
+    // Shared intermediates, never requested directly
+    NODE_BAND_POWER     = 1u << 8,  // Raw band levels from the active engine, once per hop
+};
+
+// Edges of the analysis graph: a node and the nodes it consumes
+struct FeatureDependency {
+    uint32_t node;
+    uint32_t inputs;
+};
+
+constexpr FeatureDependency FEATURE_DEPENDENCIES[] = {
+    { FEATURE_SPECTRUM,  NODE_BAND_POWER },
+    { FEATURE_ONSET,     NODE_BAND_POWER },
+    { FEATURE_COHERENCE, NODE_BAND_POWER },
+    { FEATURE_NEEDLE,    FEATURE_LEVELS },
+};
+
+// Requested features plus every node they transitively depend on
+constexpr uint32_t featureClosure(uint32_t features) {
+    uint32_t closure = features;
+    for (bool grew = true; grew;) {
+        grew = false;
+        for (const FeatureDependency& dep : FEATURE_DEPENDENCIES) {
+            if ((closure & dep.node) && (closure & dep.inputs) != dep.inputs) {
+                closure |= dep.inputs;
+                grew = true;
+            }
+        }
+    }
+    return closure;
+}
+
+// One complete analysis result, published by the capture thread every hop
+struct AnalysisFrame {
+    static constexpr int WAVEFORM_SAMPLES = 128;
+    
+    std::array<int, BAND_COUNT> left_bands{};
+    std::array<int, BAND_COUNT> right_bands{};
+    float left_peak = 0.0f, right_peak = 0.0f;     // Sample peak over the hop
+    float left_rms = 0.0f, right_rms = 0.0f;       // RMS over the hop
+    float left_vu = -60.0f, right_vu = -60.0f;     // VU reading, dB relative to 0 VU
+    float left_ppm = -60.0f, right_ppm = -60.0f;   // PPM reading, dB relative to 0 VU
+    float phase = 0.0f;
+    float correlation = 0.0f;
+    float onset_strength = 0.0f;                    // Positive spectral flux, log units per band
+    bool onset = false;                             // Flux peaked above its running mean
+    std::array<float, BAND_COUNT> band_coherence{}; // Magnitude-squared coherence, 0-1 (FFT engine only)
+    std::array<float, BAND_COUNT> band_balance{};   // (L - R) / (L + R) band power, -1..1 (FFT engine only)
+    float left_needle = 0.0f, right_needle = 0.0f;  // Needle position on the VU scale (0-1)
+    float left_needle_prev = 0.0f, right_needle_prev = 0.0f;  // One needle_interval earlier
+    float needle_interval = 0.0f;                   // Seconds between the two needle states
+    std::chrono::steady_clock::time_point needle_time;  // When the newer needle state was taken
+    uint32_t features = 0;                          // FEATURE_* bits computed for this frame
+    std::array<float, WAVEFORM_SAMPLES> left_wave{};
+    std::array<float, WAVEFORM_SAMPLES> right_wave{};
+    uint64_t sequence = 0;
+};
+
+// Band energy engines selectable per configuration
+enum class BandEngine { FFT, GOERTZEL, IIR };
+
+inline const char* bandEngineName(BandEngine engine) {
+    switch (engine) {
+        case BandEngine::GOERTZEL: return "goertzel";
+        case BandEngine::IIR: return "iir";
+        default: return "fft";
+    }
+}
+
+inline bool parseBandEngine(const char* name, BandEngine& engine) {
+    if (strcmp(name, "fft") == 0) { engine = BandEngine::FFT; return true; }
+    if (strcmp(name, "goertzel") == 0) { engine = BandEngine::GOERTZEL; return true; }
+    if (strcmp(name, "iir") == 0) { engine = BandEngine::IIR; return true; }
+    return false;
+}
+
+// 4-lane float vector (NEON on the Pi, SSE on x86, scalar otherwise)
+typedef float float4 __attribute__((vector_size(16)));
+
+// Bank of Goertzel filters covering a small fixed set of bands.
+// Each band is probed at PROBES_PER_BAND evenly spaced frequencies with a
+// block length matching the probe spacing, so the probes tile the band the
+// same way FFT bins do. Filters are updated per sample block in the capture
+// thread and a band's power is refreshed whenever its block completes;
+// reading levels is just an array lookup.
+class GoertzelBank {
+public:
+    static constexpr int BANDS = BAND_COUNT;
+    static constexpr int PROBES_PER_BAND = std::max(1, 28 / BANDS);  // ~28 filters per channel, one per band past 28 bands
+    
+private:
+    static constexpr int FILTERS = BANDS * PROBES_PER_BAND;
+    
+    std::array<float, FILTERS> coeff{};
+    std::array<float, FILTERS> s1_left{}, s2_left{};
+    std::array<float, FILTERS> s1_right{}, s2_right{};
+    
+    std::array<int, BANDS> block_length{};
+    std::array<int, BANDS> block_pos{};
+    std::array<float, BANDS> power_scale{};
+    std::array<float, BANDS> power_left{};
+    std::array<float, BANDS> power_right{};
+    
+    void finishBand(int band) {
+        float sum_left = 0.0f, sum_right = 0.0f;
+        for (int p = 0; p < PROBES_PER_BAND; p++) {
+            int f = band * PROBES_PER_BAND + p;
+            sum_left += s1_left[f] * s1_left[f] + s2_left[f] * s2_left[f] - coeff[f] * s1_left[f] * s2_left[f];
+            sum_right += s1_right[f] * s1_right[f] + s2_right[f] * s2_right[f] - coeff[f] * s1_right[f] * s2_right[f];
+            s1_left[f] = s2_left[f] = 0.0f;
+            s1_right[f] = s2_right[f] = 0.0f;
+        }
+        power_left[band] = sum_left / PROBES_PER_BAND * power_scale[band];
+        power_right[band] = sum_right / PROBES_PER_BAND * power_scale[band];
+        block_pos[band] = 0;
+    }
+    
+public:
+    // Place the probes for one band. Powers are scaled to match the mean
+    // bin power of a Hann-windowed FFT of reference_fft_size points.
+    void configure(int band, float low_hz, float high_hz, int sample_rate, int reference_fft_size) {
+        float spacing = (high_hz - low_hz) / PROBES_PER_BAND;
+        int length = std::max(PROBES_PER_BAND, (int)lroundf(sample_rate / spacing));
+        
+        block_length[band] = length;
+        for (int p = 0; p < PROBES_PER_BAND; p++) {
+            float freq = low_hz + (p + 0.5f) * spacing;
+            coeff[band * PROBES_PER_BAND + p] = 2.0f * cosf(2.0f * M_PI * freq / sample_rate);
+        }
+        
+        // Hann bin power is 3N/8 per unit noise power, rectangular is M
+        power_scale[band] = 3.0f * reference_fft_size / (8.0f * length);
+        reset();
+    }
+    
+    void reset() {
+        s1_left.fill(0.0f); s2_left.fill(0.0f);
+        s1_right.fill(0.0f); s2_right.fill(0.0f);
+        block_pos.fill(0);
+        power_left.fill(0.0f);
+        power_right.fill(0.0f);
+    }
+    
+    void process(const float* left, const float* right, int count) {
+        while (count > 0) {
+            // Run until the next band completes its block
+            int run = count;
+            for (int b = 0; b < BANDS; b++) {
+                run = std::min(run, block_length[b] - block_pos[b]);
+            }
+            
+            for (int n = 0; n < run; n++) {
+                float xl = left[n], xr = right[n];
+                for (int f = 0; f < FILTERS; f++) {
+                    float s0 = xl + coeff[f] * s1_left[f] - s2_left[f];
+                    s2_left[f] = s1_left[f];
+                    s1_left[f] = s0;
+                }
+                for (int f = 0; f < FILTERS; f++) {
+                    float s0 = xr + coeff[f] * s1_right[f] - s2_right[f];
+                    s2_right[f] = s1_right[f];
+                    s1_right[f] = s0;
+                }
+            }
+            
+            for (int b = 0; b < BANDS; b++) {
+                block_pos[b] += run;
+                if (block_pos[b] == block_length[b]) finishBand(b);
+            }
+            
+            left += run;
+            right += run;
+            count -= run;
+        }
+    }
+    
+    float leftPower(int band) const { return power_left[band]; }
+    float rightPower(int band) const { return power_right[band]; }
+};
+
+// Time-domain band-pass filter bank, like an analog analyzer.
+// Every band is a cascade of two RBJ band-pass biquads followed by a mean
+// square envelope follower whose time constant spans a few cycles of the
+// band's lowest frequency. Bands and channels are interleaved across vector lanes
+// (lane = band * 2 + channel) so one pass over VECTORS 4-wide biquads filters
+// all bands of both channels per sample.
+class BiquadBank {
+public:
+    static constexpr int BANDS = BAND_COUNT;
+    
+private:
+    static constexpr int SECTIONS = 2;
+    static constexpr int LANES = BANDS * 2;
+    static constexpr int VECTORS = (LANES + 3) / 4;
+    static constexpr float MIN_ENVELOPE_MS = 5.0f;
+    static constexpr float ENVELOPE_CYCLES = 3.0f;
+    
+    // Transposed direct form II, b1 = 0 and b2 = -b0 for a band-pass
+    float4 b0[SECTIONS][VECTORS];
+    float4 a1[SECTIONS][VECTORS];
+    float4 a2[SECTIONS][VECTORS];
+    float4 z1[SECTIONS][VECTORS];
+    float4 z2[SECTIONS][VECTORS];
+    float4 envelope[VECTORS];
+    float4 envelope_coeff[VECTORS];
+    
+    std::array<float, BANDS> power_scale{};
+    
+    static void setLane(float4* v, int index, float value) {
+        v[index / 4][index % 4] = value;
+    }
+    
+    static float getLane(const float4* v, int index) {
+        return v[index / 4][index % 4];
+    }
+    
+    static double sectionResponse(double b0, double a1, double a2, double w) {
+        // |H(e^jw)|^2 of (b0 - b0 z^-2) / (1 + a1 z^-1 + a2 z^-2)
+        std::complex<double> z1 = std::polar(1.0, -w), z2 = z1 * z1;
+        std::complex<double> h = (b0 - b0 * z2) / (1.0 + a1 * z1 + a2 * z2);
+        return std::norm(h);
+    }
+    
+public:
+    BiquadBank() {
+        memset(b0, 0, sizeof(b0));
+        memset(a1, 0, sizeof(a1));
+        memset(a2, 0, sizeof(a2));
+        memset(envelope_coeff, 0, sizeof(envelope_coeff));
+        reset();
+    }
+    
+    // Set up one band. Powers are scaled to match the mean bin power of a
+    // Hann-windowed FFT of reference_fft_size points for broadband input.
+    void configure(int band, float low_hz, float high_hz, int sample_rate, int reference_fft_size) {
+        // Two identical sections narrow the -3 dB bandwidth by ~0.64
+        float centre = sqrtf(low_hz * high_hz);
+        float bandwidth = (high_hz - low_hz) / 0.6436f;
+        float w0 = 2.0f * M_PI * centre / sample_rate;
+        float alpha = sinf(w0) * bandwidth / (2.0f * centre);
+        float a0 = 1.0f + alpha;
+        float envelope_ms = std::max(MIN_ENVELOPE_MS, ENVELOPE_CYCLES * 1000.0f / low_hz);
+        
+        for (int ch = 0; ch < 2; ch++) {
+            int l = band * 2 + ch;
+            for (int s = 0; s < SECTIONS; s++) {
+                setLane(b0[s], l, alpha / a0);
+                setLane(a1[s], l, -2.0f * cosf(w0) / a0);
+                setLane(a2[s], l, (1.0f - alpha) / a0);
+            }
+            setLane(envelope_coeff, l, 1.0f - expf(-1000.0f / (envelope_ms * sample_rate)));
+        }
+        
+        // Equivalent noise bandwidth of the cascade, integrated numerically
+        const int STEPS = 4096;
+        double enbw = 0.0;
+        for (int i = 0; i < STEPS; i++) {
+            double w = M_PI * (i + 0.5) / STEPS;
+            double h = sectionResponse(alpha / a0, -2.0 * cos(w0) / a0, (1.0 - alpha) / a0, w);
+            enbw += h * h;
+        }
+        enbw /= STEPS;  // Fraction of the noise power passed
+        
+        // Hann bin power is 3N/8 per unit noise power
+        power_scale[band] = (float)(3.0 * reference_fft_size / 8.0 / enbw);
+    }
+    
+    void reset() {
+        memset(z1, 0, sizeof(z1));
+        memset(z2, 0, sizeof(z2));
+        memset(envelope, 0, sizeof(envelope));
+    }
+    
+    void process(const float* left, const float* right, int count) {
+        for (int n = 0; n < count; n++) {
+            const float4 in = { left[n], right[n], left[n], right[n] };
+            
+            for (int v = 0; v < VECTORS; v++) {
+                float4 x = in;
+                for (int s = 0; s < SECTIONS; s++) {
+                    float4 y = b0[s][v] * x + z1[s][v];
+                    z1[s][v] = z2[s][v] - a1[s][v] * y;
+                    z2[s][v] = -b0[s][v] * x - a2[s][v] * y;
+                    x = y;
+                }
+                
+                envelope[v] += envelope_coeff[v] * (x * x - envelope[v]);
+            }
+        }
+        
+        // Flush denormals left behind by silence
+        for (int s = 0; s < SECTIONS; s++) {
+            for (int v = 0; v < VECTORS; v++) {
+                for (int l = 0; l < 4; l++) {
+                    if (std::abs(z1[s][v][l]) < 1e-15f) z1[s][v][l] = 0.0f;
+                    if (std::abs(z2[s][v][l]) < 1e-15f) z2[s][v][l] = 0.0f;
+                }
+            }
+        }
+    }
+    
+    float leftPower(int band) const { return getLane(envelope, band * 2) * power_scale[band]; }
+    float rightPower(int band) const { return getLane(envelope, band * 2 + 1) * power_scale[band]; }
+};
+
+// Anti-aliasing decimator for the bass path.
+// A Blackman-windowed sinc low-pass applied polyphase-style: only every
+// FACTOR-th output is computed, so the cost is TAPS / FACTOR multiply-adds
+// per input sample. The history is stored twice so every dot product reads
+// a contiguous window.
+class Decimator {
+public:
+    static constexpr int FACTOR = 8;
+    static constexpr int TAPS = 64;
+    
+private:
+    std::array<float, TAPS> taps{};
+    std::array<float, TAPS * 2> history{};
+    int pos = 0;
+    int phase = 0;
+    
+public:
+    // Cutoff is chosen so that nothing aliases into 0 .. protect_hz
+    void configure(int sample_rate, float protect_hz) {
+        float output_rate = (float)sample_rate / FACTOR;
+        float cutoff = 0.5f * (output_rate - protect_hz) / sample_rate;
+        float sum = 0.0f;
+        for (int i = 0; i < TAPS; i++) {
+            float m = i - (TAPS - 1) / 2.0f;
+            float sinc = (m == 0.0f) ? 2.0f * cutoff : sinf(2.0f * M_PI * cutoff * m) / (M_PI * m);
+            float window = 0.42f - 0.5f * cosf(2.0f * M_PI * i / (TAPS - 1)) +
+                           0.08f * cosf(4.0f * M_PI * i / (TAPS - 1));
+            taps[i] = sinc * window;
+            sum += taps[i];
+        }
+        for (float& t : taps) t /= sum;  // Unity gain at DC
+        reset();
+    }
+    
+    void reset() {
+        history.fill(0.0f);
+        pos = 0;
+        phase = 0;
+    }
+    
+    // Consume `count` input samples, write decimated samples to the ring.
+    // Returns the new ring write position.
+    size_t process(const float* in, int count, float* ring, size_t ring_size, size_t ring_pos) {
+        for (int n = 0; n < count; n++) {
+            history[pos] = in[n];
+            history[pos + TAPS] = in[n];
+            pos = (pos + 1) % TAPS;
+            
+            if (++phase == FACTOR) {
+                phase = 0;
+                const float* window = &history[pos];  // Oldest sample first
+                float acc = 0.0f;
+                for (int t = 0; t < TAPS; t++) {
+                    acc += window[t] * taps[TAPS - 1 - t];
+                }
+                ring[ring_pos] = acc;
+                ring_pos = (ring_pos + 1) % ring_size;
+            }
+        }
+        return ring_pos;
+    }
+};
+
+// Real-input FFT implementations selectable per configuration
+enum class FFTKind { FFTW, Q15 };
+
+#ifdef AAV_NO_FFTW
+constexpr FFTKind DEFAULT_FFT = FFTKind::Q15;
+#else
+constexpr FFTKind DEFAULT_FFT = FFTKind::FFTW;
+#endif
+
+inline const char* fftKindName(FFTKind kind) {
+    return kind == FFTKind::Q15 ? "q15" : "fftw";
+}
+
+inline bool parseFFTKind(const char* name, FFTKind& kind) {
+#ifndef AAV_NO_FFTW
+    if (strcmp(name, "fftw") == 0) { kind = FFTKind::FFTW; return true; }
+#endif
+    if (strcmp(name, "q15") == 0) { kind = FFTKind::Q15; return true; }
+    return false;
+}
+
+// 32-byte aligned float storage for transform buffers, release with free()
+inline float* allocFloats(size_t count) {
+    size_t bytes = (count * sizeof(float) + 31) & ~(size_t)31;
+    return (float*)aligned_alloc(32, bytes);
+}
+
+// Forward real FFT of one fixed size. Output follows FFTW's r2c layout and
+// unnormalized scaling (size/2 + 1 interleaved re, im bins), so the band
+// tables and level calibration do not depend on the backend. Each instance
+// owns its scratch space; use one per concurrent caller.
+class FFTBackend {
+public:
+    virtual ~FFTBackend() = default;
+    virtual void forward(float* in, float* out) = 0;
+};
+
+#ifndef AAV_NO_FFTW
+class FFTWBackend : public FFTBackend {
+private:
+    fftwf_plan plan;
+    
+public:
+    // Planned on the buffers it will be run on
+    FFTWBackend(int size, float* in, float* out)
+        : plan(fftwf_plan_dft_r2c_1d(size, in, (fftwf_complex*)out, FFTW_ESTIMATE)) {}
+    
+    ~FFTWBackend() override {
+        fftwf_destroy_plan(plan);
+    }
+    
+    void forward(float* in, float* out) override {
+        fftwf_execute_dft_r2c(plan, in, (fftwf_complex*)out);
+    }
+};
+#endif
+
+// Fixed-point real FFT. The real input is packed into a half-size complex
+// sequence, transformed with Q15 Stockham radix-4 passes (plus one radix-2
+// pass when needed), then split into the real spectrum in float.
+// Every pass halves or quarters its outputs, so no stage can overflow and
+// the complex transform is scaled by 1 / (size / 2); the split undoes that.
+// The input is first shifted up by a block exponent so its peak uses the
+// full Q15 range, which keeps quiet passages above the rounding noise.
+// Passes with a stride of 8 or more run 8 lanes at a time on NEON and
+// produce bit-identical results to the scalar code.
+class Q15FFT : public FFTBackend {
+private:
+    struct Pass {
+        int n, s;   // Sub-transform length and stride
+        std::vector<int16_t> w1_re, w1_im, w2_re, w2_im, w3_re, w3_im;  // Twiddles per p (radix-4)
+    };
+    
+    int size;
+    int half;
+    std::vector<Pass> passes;
+    std::vector<int16_t> buf_re[2], buf_im[2];
+    std::vector<float> split_cos, split_sin;
+    
+    static int16_t sat16(int v) { return (int16_t)std::max(-32768, std::min(32767, v)); }
+    static int16_t hadd(int a, int b) { return (int16_t)((a + b) >> 1); }
+    static int16_t hsub(int a, int b) { return (int16_t)((a - b) >> 1); }
+    static int16_t mulq15(int a, int b) { return sat16((a * b + 0x4000) >> 15); }
+    
+    static void twiddle(int16_t tr, int16_t ti, int16_t wr, int16_t wi, int16_t& yr, int16_t& yi) {
+        yr = sat16(mulq15(tr, wr) - mulq15(ti, wi));
+        yi = sat16(mulq15(tr, wi) + mulq15(ti, wr));
+    }
+    
+    static int16_t toQ15(float v) {
+        return sat16((int)lrintf(v * 32767.0f));
+    }
+    
+    void radix4(const Pass& pass, const int16_t* x_re, const int16_t* x_im, int16_t* y_re, int16_t* y_im) const {
+        const int s = pass.s;
+        const int n1 = pass.n / 4;
+        
+        for (int p = 0; p < n1; p++) {
+            const int16_t w1r = pass.w1_re[p], w1i = pass.w1_im[p];
+            const int16_t w2r = pass.w2_re[p], w2i = pass.w2_im[p];
+            const int16_t w3r = pass.w3_re[p], w3i = pass.w3_im[p];
+            const int in = s * p;
+            const int out = s * 4 * p;
+            int q = 0;
+            
+#if defined(__ARM_NEON)
+            for (; q + 8 <= s; q += 8) {
+                int16x8_t ar = vld1q_s16(x_re + in + q), ai = vld1q_s16(x_im + in + q);
+                int16x8_t br = vld1q_s16(x_re + in + s * n1 + q), bi = vld1q_s16(x_im + in + s * n1 + q);
+                int16x8_t cr = vld1q_s16(x_re + in + s * 2 * n1 + q), ci = vld1q_s16(x_im + in + s * 2 * n1 + q);
+                int16x8_t dr = vld1q_s16(x_re + in + s * 3 * n1 + q), di = vld1q_s16(x_im + in + s * 3 * n1 + q);
+                
+                int16x8_t Ar = vhaddq_s16(ar, cr), Ai = vhaddq_s16(ai, ci);
+                int16x8_t Br = vhsubq_s16(ar, cr), Bi = vhsubq_s16(ai, ci);
+                int16x8_t Cr = vhaddq_s16(br, dr), Ci = vhaddq_s16(bi, di);
+                int16x8_t Dr = vhsubq_s16(br, dr), Di = vhsubq_s16(bi, di);
+                
+                vst1q_s16(y_re + out + q, vhaddq_s16(Ar, Cr));
+                vst1q_s16(y_im + out + q, vhaddq_s16(Ai, Ci));
+                
+                int16x8_t t1r = vhaddq_s16(Br, Di), t1i = vhsubq_s16(Bi, Dr);
+                int16x8_t t2r = vhsubq_s16(Ar, Cr), t2i = vhsubq_s16(Ai, Ci);
+                int16x8_t t3r = vhsubq_s16(Br, Di), t3i = vhaddq_s16(Bi, Dr);
+                
+                int16x8_t v1r = vdupq_n_s16(w1r), v1i = vdupq_n_s16(w1i);
+                int16x8_t v2r = vdupq_n_s16(w2r), v2i = vdupq_n_s16(w2i);
+                int16x8_t v3r = vdupq_n_s16(w3r), v3i = vdupq_n_s16(w3i);
+                vst1q_s16(y_re + out + s + q, vqsubq_s16(vqrdmulhq_s16(t1r, v1r), vqrdmulhq_s16(t1i, v1i)));
+                vst1q_s16(y_im + out + s + q, vqaddq_s16(vqrdmulhq_s16(t1r, v1i), vqrdmulhq_s16(t1i, v1r)));
+                vst1q_s16(y_re + out + 2 * s + q, vqsubq_s16(vqrdmulhq_s16(t2r, v2r), vqrdmulhq_s16(t2i, v2i)));
+                vst1q_s16(y_im + out + 2 * s + q, vqaddq_s16(vqrdmulhq_s16(t2r, v2i), vqrdmulhq_s16(t2i, v2r)));
+                vst1q_s16(y_re + out + 3 * s + q, vqsubq_s16(vqrdmulhq_s16(t3r, v3r), vqrdmulhq_s16(t3i, v3i)));
+                vst1q_s16(y_im + out + 3 * s + q, vqaddq_s16(vqrdmulhq_s16(t3r, v3i), vqrdmulhq_s16(t3i, v3r)));
+            }
+#endif
+            
+            for (; q < s; q++) {
+                int a = in + q, b = a + s * n1, c = b + s * n1, d = c + s * n1;
+                int16_t Ar = hadd(x_re[a], x_re[c]), Ai = hadd(x_im[a], x_im[c]);
+                int16_t Br = hsub(x_re[a], x_re[c]), Bi = hsub(x_im[a], x_im[c]);
+                int16_t Cr = hadd(x_re[b], x_re[d]), Ci = hadd(x_im[b], x_im[d]);
+                int16_t Dr = hsub(x_re[b], x_re[d]), Di = hsub(x_im[b], x_im[d]);
+                
+                y_re[out + q] = hadd(Ar, Cr);
+                y_im[out + q] = hadd(Ai, Ci);
+                twiddle(hadd(Br, Di), hsub(Bi, Dr), w1r, w1i, y_re[out + s + q], y_im[out + s + q]);
+                twiddle(hsub(Ar, Cr), hsub(Ai, Ci), w2r, w2i, y_re[out + 2 * s + q], y_im[out + 2 * s + q]);
+                twiddle(hsub(Br, Di), hadd(Bi, Dr), w3r, w3i, y_re[out + 3 * s + q], y_im[out + 3 * s + q]);
+            }
+        }
+    }
+    
+    // Last pass when log2(half) is odd: n = 2, no twiddles
+    static void radix2(int s, const int16_t* x_re, const int16_t* x_im, int16_t* y_re, int16_t* y_im) {
+        int q = 0;
+#if defined(__ARM_NEON)
+        for (; q + 8 <= s; q += 8) {
+            int16x8_t ar = vld1q_s16(x_re + q), ai = vld1q_s16(x_im + q);
+            int16x8_t br = vld1q_s16(x_re + s + q), bi = vld1q_s16(x_im + s + q);
+            vst1q_s16(y_re + q, vhaddq_s16(ar, br));
+            vst1q_s16(y_im + q, vhaddq_s16(ai, bi));
+            vst1q_s16(y_re + s + q, vhsubq_s16(ar, br));
+            vst1q_s16(y_im + s + q, vhsubq_s16(ai, bi));
+        }
+#endif
+        for (; q < s; q++) {
+            int16_t ar = x_re[q], ai = x_im[q], br = x_re[s + q], bi = x_im[s + q];
+            y_re[q] = hadd(ar, br);
+            y_im[q] = hadd(ai, bi);
+            y_re[s + q] = hsub(ar, br);
+            y_im[s + q] = hsub(ai, bi);
+        }
+    }
+    
+public:
+    // size must be a power of two, at least 4
+    explicit Q15FFT(int size) : size(size), half(size / 2) {
+        for (int n = half, s = 1; n > 1; s *= 4) {
+            Pass pass;
+            pass.n = n >= 4 ? n : 2;
+            pass.s = s;
+            if (n >= 4) {
+                for (int p = 0; p < n / 4; p++) {
+                    for (int k = 1; k <= 3; k++) {
+                        double angle = -2.0 * M_PI * p * k / n;
+                        int16_t wr = sat16((int)lrint(cos(angle) * 32767.0));
+                        int16_t wi = sat16((int)lrint(sin(angle) * 32767.0));
+                        (k == 1 ? pass.w1_re : k == 2 ? pass.w2_re : pass.w3_re).push_back(wr);
+                        (k == 1 ? pass.w1_im : k == 2 ? pass.w2_im : pass.w3_im).push_back(wi);
+                    }
+                }
+            }
+            passes.push_back(pass);
+            n = n >= 4 ? n / 4 : 1;
+        }
+        
+        for (int i = 0; i < 2; i++) {
+            buf_re[i].resize(half);
+            buf_im[i].resize(half);
+        }
+        for (int k = 0; k <= half; k++) {
+            split_cos.push_back(cosf(2.0f * M_PI * k / size));
+            split_sin.push_back(sinf(2.0f * M_PI * k / size));
+        }
+    }
+    
+    void forward(float* in, float* out) override {
+        float peak = 0.0f;
+        for (int i = 0; i < size; i++) {
+            peak = std::max(peak, std::abs(in[i]));
+        }
+        int exponent = 0;
+        while (exponent < 15 && peak * (2 << exponent) <= 1.0f) {
+            exponent++;
+        }
+        const float gain = (float)(1 << exponent);
+        
+        // Even samples as real part, odd as imaginary
+        for (int n = 0; n < half; n++) {
+            buf_re[0][n] = toQ15(in[2 * n] * gain);
+            buf_im[0][n] = toQ15(in[2 * n + 1] * gain);
+        }
+        
+        int src = 0;
+        for (const Pass& pass : passes) {
+            if (pass.n == 2) {
+                radix2(pass.s, buf_re[src].data(), buf_im[src].data(), buf_re[1 - src].data(), buf_im[1 - src].data());
+            } else {
+                radix4(pass, buf_re[src].data(), buf_im[src].data(), buf_re[1 - src].data(), buf_im[1 - src].data());
+            }
+            src = 1 - src;
+        }
+        
+        // Split the half-size spectrum Z into the real spectrum X:
+        // X[k] = (Z[k] + conj Z[h-k]) / 2 - i e^(-2 pi i k / N) (Z[k] - conj Z[h-k]) / 2
+        const int16_t* z_re = buf_re[src].data();
+        const int16_t* z_im = buf_im[src].data();
+        const float scale = 0.5f * half / 32767.0f / gain;
+        for (int k = 0; k <= half; k++) {
+            int a = k % half, b = (half - k) % half;
+            float er = (float)(z_re[a] + z_re[b]), ei = (float)(z_im[a] - z_im[b]);
+            float or_ = (float)(z_re[a] - z_re[b]), oi = (float)(z_im[a] + z_im[b]);
+            float c = split_cos[k], sn = split_sin[k];
+            out[2 * k] = scale * (er + c * oi - sn * or_);
+            out[2 * k + 1] = scale * (ei - c * or_ - sn * oi);
+        }
+    }
+};
+
+inline std::unique_ptr<FFTBackend> createFFT(FFTKind kind, int size, float* in, float* out) {
+#ifndef AAV_NO_FFTW
+    if (kind == FFTKind::FFTW) {
+        return std::unique_ptr<FFTBackend>(new FFTWBackend(size, in, out));
+    }
+#endif
+    return std::unique_ptr<FFTBackend>(new Q15FFT(size));
+}
+
+// Weighted band power over interleaved (re, im) spectra.
+// Each band's bin range and edge weights (the fraction of every bin that
+// falls inside the band) are precomputed once. Power is summed directly as
+// re^2 + im^2, four floats at a time, for both channels in one pass. Works
+// for any band layout; bands may overlap and be added in any order.
+class BandEnergyKernel {
+private:
+    struct Band {
+        int output;         // Index written in the output arrays
+        int first;          // First float of the range (2 * bin)
+        int count;          // Floats in the range
+        int weight_offset;  // One weight per float
+        float scale;        // power_scale / sum of bin weights
+    };
+    
+    std::vector<Band> bands;
+    std::vector<float> weights;
+    
+    static float4 load4(const float* p) {
+        float4 v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    
+public:
+    void clear() {
+        bands.clear();
+        weights.clear();
+    }
+    
+    // Band covering [low_bin, high_bin) with bin k spanning [k - 0.5, k + 0.5)
+    void addBand(int output, float low_bin, float high_bin, float power_scale) {
+        int first_bin = std::max(0, (int)floorf(low_bin - 0.5f) + 1);
+        int last_bin = std::max(first_bin, (int)ceilf(high_bin + 0.5f) - 1);
+        
+        Band band;
+        band.output = output;
+        band.first = first_bin * 2;
+        band.count = (last_bin - first_bin + 1) * 2;
+        band.weight_offset = (int)weights.size();
+        
+        float weight_sum = 0.0f;
+        for (int k = first_bin; k <= last_bin; k++) {
+            float w = std::min(k + 0.5f, high_bin) - std::max(k - 0.5f, low_bin);
+            w = std::max(0.0f, std::min(1.0f, w));
+            weights.push_back(w);  // re
+            weights.push_back(w);  // im
+            weight_sum += w;
+        }
+        if (weight_sum <= 0.0f) {
+            // Band narrower than a bin and between centres: take the nearest
+            weights[band.weight_offset] = weights[band.weight_offset + 1] = 1.0f;
+            weight_sum = 1.0f;
+        }
+        band.scale = power_scale / weight_sum;
+        bands.push_back(band);
+    }
+    
+    void run(const float* left, const float* right, float* left_out, float* right_out) const {
+        runBands<false>(left, right, left_out, right_out, nullptr, nullptr);
+    }
+    
+    // Also sums the cross-spectrum L * conj(R) per band, same weights and scale
+    void run(const float* left, const float* right, float* left_out, float* right_out,
+             float* cross_re_out, float* cross_im_out) const {
+        runBands<true>(left, right, left_out, right_out, cross_re_out, cross_im_out);
+    }
+    
+private:
+    template<bool CROSS>
+    void runBands(const float* left, const float* right, float* left_out, float* right_out,
+                  float* cross_re_out, float* cross_im_out) const {
+        typedef int int4 __attribute__((vector_size(16)));
+        const int4 swap_pairs = {1, 0, 3, 2};
+        
+        for (const Band& band : bands) {
+            const float* l = left + band.first;
+            const float* r = right + band.first;
+            const float* w = weights.data() + band.weight_offset;
+            
+            float4 acc_left = {0, 0, 0, 0}, acc_right = {0, 0, 0, 0};
+            float4 acc_re = {0, 0, 0, 0}, acc_im = {0, 0, 0, 0};
+            int i = 0;
+            for (; i + 4 <= band.count; i += 4) {
+                float4 wv = load4(w + i), lv = load4(l + i), rv = load4(r + i);
+                acc_left += wv * lv * lv;
+                acc_right += wv * rv * rv;
+                if (CROSS) {
+                    // (lre*rre, lim*rim) and (lre*rim, lim*rre) lane pairs
+                    acc_re += wv * lv * rv;
+                    acc_im += wv * lv * __builtin_shuffle(rv, swap_pairs);
+                }
+            }
+            
+            float sum_left = acc_left[0] + acc_left[1] + acc_left[2] + acc_left[3];
+            float sum_right = acc_right[0] + acc_right[1] + acc_right[2] + acc_right[3];
+            float sum_re = acc_re[0] + acc_re[1] + acc_re[2] + acc_re[3];
+            float sum_im = (acc_im[1] + acc_im[3]) - (acc_im[0] + acc_im[2]);
+            for (; i < band.count; i++) {
+                sum_left += w[i] * l[i] * l[i];
+                sum_right += w[i] * r[i] * r[i];
+                if (CROSS) {
+                    // Tail is whole bins, i even here is re and i + 1 is im
+                    int pair = i ^ 1;
+                    sum_re += w[i] * l[i] * r[i];
+                    sum_im += (i & 1 ? 1.0f : -1.0f) * w[i] * l[i] * r[pair];
+                }
+            }
+            
+            left_out[band.output] = sum_left * band.scale;
+            right_out[band.output] = sum_right * band.scale;
+            if (CROSS) {
+                cross_re_out[band.output] = sum_re * band.scale;
+                cross_im_out[band.output] = sum_im * band.scale;
+            }
+        }
+    }
+};
+
+// Broadcast-style level ballistics, advanced once per block from the block's
+// mean square and sample peak, so no per-sample work beyond the sums the
+// capture loop already does.
+//   VU:  mean-square integrator reaching 99% of a step in 300 ms
+//   PPM: attack within one block (close to the 10 ms Type II integration
+//        time at 512 frames), falling 20 dB in 1.7 s
+class LevelMeter {
+private:
+    float mean_square = 0.0f;
+    float peak = 0.0f;
+    
+    static float toDB(float power) {
+        return 10.0f * log10f(std::max(power, 1e-12f));
+    }
+    
+public:
+    static constexpr float VU_RISE_TIME = 0.3f;
+    static constexpr float PPM_FALL_DB_PER_SEC = 20.0f / 1.7f;
+    
+    void update(float block_mean_square, float block_peak, float dt) {
+        float alpha = 1.0f - expf(-dt * logf(100.0f) / VU_RISE_TIME);
+        mean_square += alpha * (block_mean_square - mean_square);
+        
+        float fall = powf(10.0f, -PPM_FALL_DB_PER_SEC * dt / 20.0f);
+        peak = std::max(block_peak, peak * fall);
+    }
+    
+    float rmsDB() const { return toDB(mean_square); }     // dBFS
+    float peakDB() const { return toDB(peak * peak); }    // dBFS
+};
+
+// Damped spring-mass model of a meter movement, stepped at a fixed 1 ms
+// rate however the audio arrives. Position is in scale units (0 at -20 dB,
+// 1 at +3 dB) and the needle stops against pins just outside the scale.
+// The "direct" preset has no mechanics and follows the VU reading; the
+// others are driven by the short-term level and supply their own ballistics.
+class NeedleModel {
+public:
+    struct Preset {
+        const char* name;
+        float frequency;    // Undamped natural frequency, Hz (0: direct)
+        float damping;      // Damping ratio
+        float restitution;  // Velocity kept when bouncing off a pin
+    };
+    
+    static constexpr int PRESET_COUNT = 4;
+    static constexpr Preset PRESETS[PRESET_COUNT] = {
+        { "direct",  0.0f, 0.0f, 0.0f },
+        { "vu",      2.1f, 0.8f, 0.2f },   // IEC 60268-17: 99% in 300 ms, ~1.5% overshoot
+        { "vintage", 1.3f, 0.6f, 0.35f },  // Heavy movement, visible overshoot
+        { "fast",    5.0f, 0.7f, 0.1f },   // Light movement, quick with a small bounce
+    };
+    
+    static constexpr float STEP = 0.001f;
+    static constexpr float SCALE_MIN_DB = -20.0f;
+    static constexpr float SCALE_MAX_DB = 3.0f;
+    static constexpr float PIN_LOW = -0.04f;
+    static constexpr float PIN_HIGH = 1.06f;
+    
+private:
+    float x = 0.0f;
+    float v = 0.0f;
+    float pending = 0.0f;  // Simulated time owed, less than one step
+    
+public:
+    static float scalePosition(float db) {
+        return (db - SCALE_MIN_DB) / (SCALE_MAX_DB - SCALE_MIN_DB);
+    }
+    
+    float position() const { return x; }
+    
+    void advance(float target, float dt, const Preset& preset) {
+        // The drive saturates at the pins: silence pulls no harder than a
+        // level just off the scale, so falls take the same time at any depth
+        target = std::max(PIN_LOW, std::min(PIN_HIGH, target));
+        if (preset.frequency <= 0.0f) {
+            x = target;
+            v = 0.0f;
+            pending = 0.0f;
+            return;
+        }
+        
+        const float w = 2.0f * M_PI * preset.frequency;
+        const float stiffness = w * w;
+        const float friction = 2.0f * preset.damping * w;
+        
+        // Semi-implicit Euler: a handful of flops per step
+        for (pending += dt; pending >= STEP; pending -= STEP) {
+            v += (stiffness * (target - x) - friction * v) * STEP;
+            x += v * STEP;
+            if (x < PIN_LOW) {
+                x = PIN_LOW;
+                v = -v * preset.restitution;
+            } else if (x > PIN_HIGH) {
+                x = PIN_HIGH;
+                v = -v * preset.restitution;
+            }
+        }
+    }
+};
+
+// Stereo correlation and mean L/R phase angle from exponentially weighted
+// running sums (sum l, r, lr, l^2, r^2 and atan2(r, l)). The sums decay once
+// per block and take the block's contribution, so each hop costs one pass
+// over its new samples only, four at a time.
+class StereoMeter {
+private:
+    typedef int int4 __attribute__((vector_size(16)));
+    
+    static constexpr float GATE = 0.01f;  // Both channels must exceed this for a phase sample
+    
+    double weight = 0.0;
+    double sum_l = 0.0, sum_r = 0.0, sum_lr = 0.0, sum_l2 = 0.0, sum_r2 = 0.0;
+    double sum_phase = 0.0;
+    
+    static float4 abs4(float4 v) {
+        int4 bits = (int4)v & 0x7fffffff;
+        return (float4)bits;
+    }
+    
+    static float hsum(float4 v) {
+        return v[0] + v[1] + v[2] + v[3];
+    }
+    
+public:
+    static constexpr float TIME_CONSTANT = 0.015f;  // Seconds, close to the old 512-sample window
+    
+    // atan2 approximation, max error about 2e-4 rad
+    static float4 fastAtan2(float4 y, float4 x) {
+        const float4 half_pi = {1.5707963f, 1.5707963f, 1.5707963f, 1.5707963f};
+        const float4 pi = half_pi + half_pi;
+        const float4 tiny = {1e-30f, 1e-30f, 1e-30f, 1e-30f};
+        const float4 zero = {0, 0, 0, 0};
+        
+        float4 ax = abs4(x), ay = abs4(y);
+        float4 mn = ax < ay ? ax : ay;
+        float4 mx = ax < ay ? ay : ax;
+        float4 a = mn / (mx + tiny);
+        float4 s = a * a;
+        float4 r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+        r = ay > ax ? half_pi - r : r;
+        r = x < zero ? pi - r : r;
+        return y < zero ? -r : r;
+    }
+    
+    void decay(float dt) {
+        double d = exp(-dt / TIME_CONSTANT);
+        weight *= d;
+        sum_l *= d;
+        sum_r *= d;
+        sum_lr *= d;
+        sum_l2 *= d;
+        sum_r2 *= d;
+        sum_phase *= d;
+    }
+    
+    // Add a contiguous run of samples
+    void accumulate(const float* left, const float* right, int count) {
+        const float4 gate = {GATE, GATE, GATE, GATE};
+        const float4 zero = {0, 0, 0, 0};
+        float4 l1 = zero, r1 = zero, lr = zero, l2 = zero, r2 = zero, ph = zero;
+        
+        for (int i = 0; i < count; i += 4) {
+            // Zero-padded tail: zeros fail the gate and add nothing to the sums
+            float4 l = zero, r = zero;
+            int n = std::min(4, count - i);
+            memcpy(&l, left + i, n * sizeof(float));
+            memcpy(&r, right + i, n * sizeof(float));
+            
+            l1 += l;
+            r1 += r;
+            lr += l * r;
+            l2 += l * l;
+            r2 += r * r;
+            
+            float4 angle = fastAtan2(r, l);
+            ph += (abs4(l) > gate) & (abs4(r) > gate) ? angle : zero;
+        }
+        
+        weight += count;
+        sum_l += hsum(l1);
+        sum_r += hsum(r1);
+        sum_lr += hsum(lr);
+        sum_l2 += hsum(l2);
+        sum_r2 += hsum(r2);
+        sum_phase += hsum(ph);
+    }
+    
+    float correlation() const {
+        double num = weight * sum_lr - sum_l * sum_r;
+        double den = sqrt(std::max(0.0, (weight * sum_l2 - sum_l * sum_l) * (weight * sum_r2 - sum_r * sum_r)));
+        float c = den > 0.0 ? (float)(num / den) : 0.0f;
+        return std::max(-1.0f, std::min(1.0f, c));
+    }
+    
+    // Mean angle over all samples, ungated ones counting as zero
+    float phase() const {
+        return weight > 0.0 ? (float)(sum_phase / weight) : 0.0f;
+    }
+};
+
+// Bin range of a spectrum band in the FFT that serves it
+enum FFTResolution { RES_BASS, RES_MID, RES_TREBLE };
+
+struct BandBins {
+    FFTResolution resolution;
+    float low_bin, high_bin;  // Band edges in bins of that FFT
+    float power_scale;        // Mean bin power relative to the reference FFT
+};
+
+// Assign every band to a transform and compute its bin edges at compile
+// time: decimated bass FFT below bass_max_hz, mid FFT below mid_max_hz,
+// treble FFT above. Full-rate bin power scales with N; the decimated path
+// also loses the decimation factor in noise bandwidth.
+constexpr std::array<BandBins, BAND_COUNT> makeBandBins(int sample_rate, int reference_size,
+                                                        int bass_size, int decimation, int bass_max_hz,
+                                                        int mid_size, int mid_max_hz, int treble_size) {
+    std::array<BandBins, BAND_COUNT> table{};
+    for (int i = 0; i < BAND_COUNT; i++) {
+        BandBins& bins = table[i];
+        int size = treble_size, rate_divider = 1;
+        bins.resolution = RES_TREBLE;
+        if (Bands::TABLE.low[i] < bass_max_hz) {
+            bins.resolution = RES_BASS;
+            size = bass_size;
+            rate_divider = decimation;
+        } else if (Bands::TABLE.low[i] < mid_max_hz) {
+            bins.resolution = RES_MID;
+            size = mid_size;
+        }
+        bins.low_bin = (float)Bands::TABLE.low[i] * size * rate_divider / sample_rate;
+        bins.high_bin = std::min((float)(size / 2), (float)Bands::TABLE.high[i] * size * rate_divider / sample_rate);
+        bins.power_scale = (float)reference_size / size * rate_divider;
+    }
+    return table;
+}
+
+// Sample format of a PCM stream, in MPD's "rate:bits:channels" notation.
+// bits is 8, 16, 24 (MPD pads these to 32-bit words), 32 or 'f' for float.
+struct PCMFormat {
+    int rate = 44100;
+    int bits = 16;      // 0 for float
+    int channels = 2;
+    
+    int sampleBytes() const { return bits == 8 ? 1 : bits == 16 ? 2 : 4; }
+    int frameBytes() const { return sampleBytes() * channels; }
+};
+
+bool parsePCMFormat(const char* text, PCMFormat& format) {
+    PCMFormat parsed;
+    char bits[8];
+    if (sscanf(text, "%d:%7[^:]:%d", &parsed.rate, bits, &parsed.channels) != 3) return false;
+    if (strcmp(bits, "f") == 0) {
+        parsed.bits = 0;
+    } else {
+        parsed.bits = atoi(bits);
+        if (parsed.bits != 8 && parsed.bits != 16 && parsed.bits != 24 && parsed.bits != 32) return false;
+    }
+    if (parsed.rate < 8000 || parsed.rate > 384000 || parsed.channels < 1 || parsed.channels > 8) return false;
+    format = parsed;
+    return true;
+}
+
+// PCM straight from MPD's fifo output, instead of a second pass through ALSA
+// and the snd-aloop loopback:
+//   audio_output { type "fifo"  name "Visualizer"  path "/tmp/mpd.fifo"  format "44100:16:2" }
+// The format must be fixed in mpd.conf, otherwise it follows each song.
+// Samples arrive host-endian; read() converts them to interleaved 16-bit
+// stereo at the capture rate, keeping partial frames across reads. Higher
+// rates (48k to 192k) are low-passed below the capture Nyquist before the
+// linear resampler, so ultrasonic content does not fold into the top bands.
+// When MPD stops writing (pause, stop, between outputs) read() returns
+// silence at the real-time rate, so meters fall and sleep mode kicks in. MPD
+// empties the pipe itself when it falls behind, so whatever comes after a gap
+// starts on a frame boundary; a backlog from a slow reader is skipped so the
+// display stays in step with the speakers.
+class FifoCapture {
+private:
+    static constexpr int REOPEN_DELAY_MS = 1000;
+    static constexpr int MAX_BACKLOG_MS = 100;
+    static constexpr int RESYNC_GAP_MS = 100;
+    static constexpr float ANTI_ALIAS_CUTOFF = 0.45f;  // Of the output rate, under its Nyquist
+    
+    // RBJ low-pass section, transposed direct form II
+    struct LowPass {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+        float z1 = 0.0f, z2 = 0.0f;
+        
+        void configure(float cutoff, float sample_rate, float q) {
+            float w0 = 2.0f * M_PI * cutoff / sample_rate;
+            float alpha = sinf(w0) / (2.0f * q);
+            float a0 = 1.0f + alpha;
+            b0 = (1.0f - cosf(w0)) / 2.0f / a0;
+            b1 = (1.0f - cosf(w0)) / a0;
+            b2 = b0;
+            a1 = -2.0f * cosf(w0) / a0;
+            a2 = (1.0f - alpha) / a0;
+        }
+        
+        float process(float x) {
+            float y = b0 * x + z1;
+            z1 = b1 * x - a1 * y + z2;
+            z2 = b2 * x - a2 * y;
+            return y;
+        }
+    };
+    
+    std::string path;
+    PCMFormat format;
+    int output_rate;
+    int fd;
+    bool waiting_logged;
+    std::chrono::steady_clock::time_point next_open;
+    std::chrono::steady_clock::time_point last_data;
+    
+    std::vector<uint8_t> input;  // Bytes read but not converted yet
+    
+    // Linear resampler state, used when the rates differ
+    double phase;                // Next output frame between `previous` (0) and `current` (1)
+    float previous[2], current[2];
+    bool anti_alias;             // Input rate above the output rate
+    LowPass filters[2][2];       // Per channel, two sections: 4th-order Butterworth
+    
+    float sampleAt(const uint8_t* p) const {
+        switch (format.bits) {
+            case 8: return (int8_t)*p / 128.0f;
+            case 16: { int16_t s; memcpy(&s, p, 2); return s / 32768.0f; }
+            case 24: { int32_t s; memcpy(&s, p, 4); return s / 8388608.0f; }
+            case 32: { int32_t s; memcpy(&s, p, 4); return s / 2147483648.0f; }
+            default: { float s; memcpy(&s, p, 4); return s; }
+        }
+    }
+    
+    static int16_t toS16(float value) {
+        value = std::max(-1.0f, std::min(1.0f, value));
+        return (int16_t)lrintf(value * 32767.0f);
+    }
+    
+    bool openFifo() {
+        fd = ::open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            if (!waiting_logged) printf("Waiting for MPD fifo %s\n", path.c_str());
+            waiting_logged = true;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+            printf("MPD fifo: %s is not a FIFO\n", path.c_str());
+            closeFifo();
+            return false;
+        }
+        printf("Reading PCM from %s (%d Hz, %s bit, %d channels)\n", path.c_str(), format.rate,
+               format.bits ? std::to_string(format.bits).c_str() : "float", format.channels);
+        waiting_logged = false;
+        resync();
+        return true;
+    }
+    
+    void closeFifo() {
+        if (fd >= 0) close(fd);
+        fd = -1;
+    }
+    
+    // Drop a partial frame and resampler history after a gap
+    void resync() {
+        input.clear();
+        phase = 2.0;  // Two frames in before the first output
+        for (auto& channel : filters) {
+            for (LowPass& section : channel) section.z1 = section.z2 = 0.0f;
+        }
+    }
+    
+    // Skip queued input beyond MAX_BACKLOG_MS, in whole frames
+    void skipBacklog() {
+        int queued = 0;
+        if (ioctl(fd, FIONREAD, &queued) != 0) return;
+        int frame_bytes = format.frameBytes();
+        int limit = (int)((int64_t)format.rate * MAX_BACKLOG_MS / 1000) * frame_bytes;
+        int excess = (queued - limit) / frame_bytes * frame_bytes;
+        uint8_t scratch[4096];
+        while (excess > 0) {
+            ssize_t got = ::read(fd, scratch, std::min<int>(excess, sizeof(scratch)));
+            if (got <= 0) break;
+            excess -= got;
+        }
+    }
+    
+    // Convert whole frames from `input`, returns output frames written
+    int convert(int16_t* out, int max_frames) {
+        int frame_bytes = format.frameBytes();
+        int sample_bytes = format.sampleBytes();
+        size_t frames_in = input.size() / frame_bytes;
+        size_t used = 0;
+        int produced = 0;
+        double step = (double)format.rate / output_rate;
+        
+        if (format.rate == output_rate) {
+            for (; used < frames_in && produced < max_frames; used++, produced++) {
+                const uint8_t* frame = input.data() + used * frame_bytes;
+                float left = sampleAt(frame);
+                out[produced * 2] = toS16(left);
+                out[produced * 2 + 1] = toS16(format.channels > 1 ? sampleAt(frame + sample_bytes) : left);
+            }
+        }
+        
+        // Resampling: take input frames until the output position falls
+        // between `previous` and `current`, then emit until it passes `current`
+        while (format.rate != output_rate && produced < max_frames) {
+            if (phase >= 1.0) {
+                if (used == frames_in) break;
+                const uint8_t* frame = input.data() + used * frame_bytes;
+                float left = sampleAt(frame);
+                float right = format.channels > 1 ? sampleAt(frame + sample_bytes) : left;
+                used++;
+                if (anti_alias) {
+                    left = filters[0][1].process(filters[0][0].process(left));
+                    right = filters[1][1].process(filters[1][0].process(right));
+                }
+                previous[0] = current[0];
+                previous[1] = current[1];
+                current[0] = left;
+                current[1] = right;
+                phase -= 1.0;
+                continue;
+            }
+            float t = (float)phase;
+            out[produced * 2] = toS16(previous[0] + (current[0] - previous[0]) * t);
+            out[produced * 2 + 1] = toS16(previous[1] + (current[1] - previous[1]) * t);
+            produced++;
+            phase += step;
+        }
+        input.erase(input.begin(), input.begin() + used * frame_bytes);
+        return produced;
+    }
+    
+public:
+    FifoCapture(const std::string& fifo_path, const PCMFormat& fifo_format, int rate)
+        : path(fifo_path), format(fifo_format), output_rate(rate), fd(-1), waiting_logged(false),
+          phase(2.0), previous{}, current{}, anti_alias(fifo_format.rate > rate) {
+        if (anti_alias) {
+            const float q[2] = { 0.5412f, 1.3066f };  // Butterworth pole pairs
+            for (auto& channel : filters) {
+                for (int i = 0; i < 2; i++) {
+                    channel[i].configure(ANTI_ALIAS_CUTOFF * rate, (float)format.rate, q[i]);
+                }
+            }
+        }
+    }
+    
+    ~FifoCapture() {
+        closeFifo();
+    }
+    
+    // Fails only when the path is something other than a FIFO; a missing
+    // FIFO (MPD not started yet) is retried from read()
+    bool open() {
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && !S_ISFIFO(st.st_mode)) {
+            printf("MPD fifo: %s is not a FIFO\n", path.c_str());
+            return false;
+        }
+        openFifo();
+        return true;
+    }
+    
+    // Fill `out` with up to `frames` stereo frames. Returns early with what
+    // it has once the stream has been quiet for the block's duration, and
+    // with a block of silence if nothing arrived at all.
+    int read(int16_t* out, int frames) {
+        auto now = std::chrono::steady_clock::now();
+        auto deadline = now + std::chrono::microseconds((int64_t)frames * 1000000 / output_rate);
+        int produced = 0;
+        
+        while (produced < frames) {
+            produced += convert(out + produced * 2, frames - produced);
+            if (produced == frames) break;
+            
+            now = std::chrono::steady_clock::now();
+            if (fd < 0) {
+                if (now >= next_open) {
+                    next_open = now + std::chrono::milliseconds(REOPEN_DELAY_MS);
+                    if (openFifo()) continue;
+                }
+                std::this_thread::sleep_until(deadline);
+                break;
+            }
+            
+            int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int ready = poll(&pfd, 1, std::max(0, timeout));
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                printf("MPD fifo poll error: %s\n", strerror(errno));
+                closeFifo();
+                break;
+            }
+            if (ready == 0) {
+                // The rest of a frame we hold a part of would be in the pipe
+                // already, so after a pause it was drained by MPD
+                if (now - last_data > std::chrono::milliseconds(RESYNC_GAP_MS)) resync();
+                break;
+            }
+            
+            if (pfd.revents & POLLIN) {
+                skipBacklog();
+                uint8_t chunk[8192];
+                ssize_t got = ::read(fd, chunk, sizeof(chunk));
+                if (got > 0) {
+                    input.insert(input.end(), chunk, chunk + got);
+                    last_data = now;
+                    continue;
+                }
+                if (got < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            }
+            // MPD closed its end (output closed on pause or stop, or MPD
+            // exited). A fresh open waits for the next writer without
+            // reporting hangup, and drops the old stream's partial frame.
+            closeFifo();
+            next_open = now;
+        }
+        
+        if (produced == 0) {
+            memset(out, 0, frames * 2 * sizeof(int16_t));
+            produced = frames;
+        }
+        return produced;
+    }
+};
+
+// Audio Processor with sleep detection
+class AudioProcessor {
+private:
+    static constexpr int SAMPLE_RATE = 44100;
+    static constexpr int CHANNELS = 2;
+    static constexpr int FRAMES_PER_BUFFER = 512;  // One analysis hop (~11.6 ms)
+    static constexpr int REFERENCE_FFT_SIZE = 8192;  // Resolution the corrections were tuned at
+    static constexpr int FFT_SIZE_BASS = 1024;       // At SAMPLE_RATE / Decimator::FACTOR
+    static constexpr int FFT_SIZE_MID = 2048;
+    static constexpr int FFT_SIZE_TREBLE = 512;
+    static constexpr int RING_SIZE = FFT_SIZE_MID * 2;
+    static constexpr int BASS_RING_SIZE = FFT_SIZE_BASS * 2;
+    static constexpr int BASS_MAX_HZ = 350;   // Bands below this use the bass FFT
+    static constexpr int MID_MAX_HZ = 2000;   // Bands below this use the mid FFT
+    static constexpr float VU_REFERENCE_DBFS = -18.0f;  // RMS level reading 0 VU at sensitivity 100
+    static constexpr float REFERENCE_HOP_SECONDS = (float)FRAMES_PER_BUFFER / SAMPLE_RATE;
+    static constexpr float COHERENCE_TIME_CONSTANT = 0.1f;  // Seconds of cross-spectrum averaging
+    static constexpr float ONSET_TIME_CONSTANT = 0.25f;     // Seconds of flux averaging for the threshold
+    static constexpr float ONSET_RATIO = 1.5f;              // Flux over its mean that counts as an onset
+    static constexpr float ONSET_FLOOR = 0.1f;              // Minimum flux, keeps noise from triggering
+    static constexpr float SILENCE_THRESHOLD = 0.001f;
+    static constexpr int SLEEP_TIMEOUT_SEC = 10;
+    
+    static constexpr std::array<BandBins, BAND_COUNT> BAND_BINS =
+        makeBandBins(SAMPLE_RATE, REFERENCE_FFT_SIZE, FFT_SIZE_BASS, Decimator::FACTOR, BASS_MAX_HZ,
+                     FFT_SIZE_MID, MID_MAX_HZ, FFT_SIZE_TREBLE);
+    
+    snd_pcm_t* pcm_handle;
+    std::unique_ptr<FifoCapture> fifo;  // Replaces the ALSA capture when set
+    std::thread audio_thread;
+    std::atomic<bool> thread_running;
+    std::atomic<bool> is_sleeping{false};
+    
+    // Only touched by the capture thread
+    float* circular_buffer_left;
+    float* circular_buffer_right;
+    size_t write_pos = 0;
+    
+    // Decimated history for the bass FFT
+    Decimator decimator_left, decimator_right;
+    float* bass_buffer_left;
+    float* bass_buffer_right;
+    size_t bass_write_pos = 0;
+    
+    // One transform size serving a group of bands, both channels side by side
+    struct FFTStage {
+        int size;
+        int stride;            // Complex bins per channel, padded so both start 32-byte aligned
+        std::unique_ptr<FFTBackend> fft[2];  // Per channel, so both can run at once
+        float* in;             // Left then right, size floats each
+        float* out;            // Left then right, stride interleaved bins each
+        float* window;
+        BandEnergyKernel kernel;
+    };
+    FFTStage stages[3];        // Indexed by FFTResolution
+    std::unique_ptr<WorkerPool> fft_pool;
+    FFTKind fft_kind = DEFAULT_FFT;
+    
+    std::array<float, BAND_COUNT> prev_left_spectrum{};
+    std::array<float, BAND_COUNT> prev_right_spectrum{};
+    
+    std::atomic<BandEngine> band_engine{BandEngine::FFT};
+    BandEngine active_engine = BandEngine::FFT;
+    GoertzelBank goertzel;
+    BiquadBank biquads;
+    
+    // Written by the control thread, picked up by the capture thread
+    std::atomic<float> noise_reduction{77.0f};
+    std::atomic<float> sensitivity{100.0f};
+    std::atomic<bool> parameters_changed{true};
+    std::atomic<uint32_t> requested_features{FEATURE_ALL};
+    uint32_t active_nodes = 0;
+    float attack_time, release_time, scale_factor;  // Smoothing time constants in seconds
+    float level_offset_db;
+    
+    LevelMeter meter_left, meter_right;
+    NeedleModel needle_left, needle_right;
+    std::atomic<int> needle_preset{1};
+    StereoMeter stereo;
+    
+    // Per-band auto and cross spectra from the last FFT pass, and their
+    // running averages (coherence of a single snapshot is always 1)
+    std::array<float, BAND_COUNT> band_power_left{}, band_power_right{};
+    std::array<float, BAND_COUNT> band_cross_re{}, band_cross_im{};
+    std::array<float, BAND_COUNT> avg_power_left{}, avg_power_right{};
+    std::array<float, BAND_COUNT> avg_cross_re{}, avg_cross_im{};
+    
+    // Spectral flux onset detection
+    std::array<float, BAND_COUNT> prev_onset_levels{};
+    float flux_mean = 0.0f;
+    bool onset_primed = false;  // prev_onset_levels holds a real hop
+    
+    TripleBuffer<AnalysisFrame> analysis_frames;
+    uint64_t frame_sequence = 0;
+    
+    // Sleep detection
+    std::chrono::steady_clock::time_point last_audio_time;
+    std::atomic<float> max_amplitude{0.0f};
+    
+    void createTransforms() {
+        for (FFTStage& stage : stages) {
+            for (int channel = 0; channel < 2; channel++) {
+                stage.fft[channel] = createFFT(fft_kind, stage.size, stage.in + channel * stage.size,
+                                               stage.out + channel * stage.stride * 2);
+            }
+        }
+    }
+    
+    void createHannWindow(float* window, int size) {
+        for (int i = 0; i < size; i++) {
+            window[i] = 0.5f * (1.0f - cosf(2.0f * M_PI * i / (size - 1)));
+        }
+    }
+    
+    void audioThreadFunc() {
+        int16_t* audio_buffer = new int16_t[FRAMES_PER_BUFFER * CHANNELS];
+        
+        while (thread_running) {
+            // Use smaller buffer during sleep for faster wake detection
+            int frames_to_read = is_sleeping ? 256 : FRAMES_PER_BUFFER;
+            
+            int frames;
+            if (fifo) {
+                frames = fifo->read(audio_buffer, frames_to_read);
+            } else {
+                frames = snd_pcm_readi(pcm_handle, audio_buffer, frames_to_read);
+                if (frames < 0) frames = snd_pcm_recover(pcm_handle, frames, 0);
+                if (frames < 0) continue;
+            }
+            
+            // During sleep, only calculate max amplitude (skip buffer updates)
+            if (is_sleeping) {
+                float frame_max = 0.0f;
+                for (int i = 0; i < frames * CHANNELS; i++) {
+                    frame_max = std::max(frame_max, std::abs(audio_buffer[i] / 32768.0f));
+                }
+                max_amplitude = frame_max;
+                if (frame_max > SILENCE_THRESHOLD) {
+                    last_audio_time = std::chrono::steady_clock::now();
+                }
+                continue;  // Skip buffer writes during sleep
+            }
+            
+            processBlock(audio_buffer, frames);
+        }
+        
+        delete[] audio_buffer;
+    }
+    
+    // Feed a span of the ring buffer to a time-domain band engine
+    template <typename Engine>
+    void feedEngine(Engine& engine, size_t start, int count) {
+        int first = std::min(count, (int)(RING_SIZE - start));
+        engine.process(circular_buffer_left + start, circular_buffer_right + start, first);
+        if (count > first) {
+            engine.process(circular_buffer_left, circular_buffer_right, count - first);
+        }
+    }
+    
+    // Low-pass and downsample a span of the ring into the bass ring
+    void feedDecimators(size_t start, int count) {
+        size_t bass_pos = bass_write_pos;
+        while (count > 0) {
+            int run = std::min(count, (int)(RING_SIZE - start));
+            decimator_left.process(circular_buffer_left + start, run,
+                                   bass_buffer_left, BASS_RING_SIZE, bass_pos);
+            bass_pos = decimator_right.process(circular_buffer_right + start, run,
+                                               bass_buffer_right, BASS_RING_SIZE, bass_pos);
+            start = (start + run) % RING_SIZE;
+            count -= run;
+        }
+        bass_write_pos = bass_pos;
+    }
+    
+    // Copy the newest `size` samples of a ring with the window applied
+    static void loadWindowed(const float* ring, size_t ring_size, size_t ring_pos,
+                             const float* window, int size, float* out) {
+        size_t read_pos = (ring_pos + ring_size - size) % ring_size;
+        for (int i = 0; i < size; i++) {
+            out[i] = ring[read_pos] * window[i];
+            read_pos = (read_pos + 1) % ring_size;
+        }
+    }
+    
+public:
+    // Append one block of interleaved samples and publish a new analysis frame.
+    // Called by the capture thread (or by the offline benchmark).
+    void processBlock(const int16_t* samples, int frames) {
+        float frame_max = 0.0f;
+        float left_peak = 0.0f, right_peak = 0.0f;
+        float left_sq = 0.0f, right_sq = 0.0f;
+        size_t pos = write_pos;
+        
+        for (int i = 0; i < frames; i++) {
+            float l = samples[i * CHANNELS] / 32768.0f;
+            float r = (CHANNELS > 1) ? samples[i * CHANNELS + 1] / 32768.0f : l;
+            circular_buffer_left[pos] = l;
+            circular_buffer_right[pos] = r;
+            
+            left_peak = std::max(left_peak, std::abs(l));
+            right_peak = std::max(right_peak, std::abs(r));
+            left_sq += l * l;
+            right_sq += r * r;
+            
+            pos = (pos + 1) % RING_SIZE;
+        }
+        size_t block_start = write_pos;
+        write_pos = pos;
+        frame_max = std::max(left_peak, right_peak);
+        
+        // Update max amplitude for sleep detection
+        max_amplitude = frame_max;
+        if (frame_max > SILENCE_THRESHOLD) {
+            last_audio_time = std::chrono::steady_clock::now();
+        }
+        
+        if (parameters_changed.exchange(false)) {
+            updateParameters();
+        }
+        
+        // Only the nodes feeding the requested features run this hop
+        uint32_t nodes = featureClosure(requested_features);
+        BandEngine engine = band_engine;
+        if (engine != active_engine || ((nodes & NODE_BAND_POWER) && !(active_nodes & NODE_BAND_POWER))) {
+            active_engine = engine;
+            resetBandState();
+        }
+        active_nodes = nodes;
+        
+        if (nodes & NODE_BAND_POWER) {
+            if (active_engine == BandEngine::FFT) {
+                feedDecimators(block_start, frames);
+            } else if (active_engine == BandEngine::GOERTZEL) {
+                feedEngine(goertzel, block_start, frames);
+            } else if (active_engine == BandEngine::IIR) {
+                feedEngine(biquads, block_start, frames);
+            }
+        }
+        
+        float dt = (float)frames / SAMPLE_RATE;
+        AnalysisFrame& frame = analysis_frames.writeBuffer();
+        frame.features = nodes & FEATURE_ALL;
+        if (active_engine != BandEngine::FFT) {
+            frame.features &= ~FEATURE_COHERENCE;
+        }
+        
+        float left_ms = frames > 0 ? left_sq / frames : 0.0f;
+        float right_ms = frames > 0 ? right_sq / frames : 0.0f;
+        frame.left_peak = left_peak;
+        frame.right_peak = right_peak;
+        frame.left_rms = sqrtf(left_ms);
+        frame.right_rms = sqrtf(right_ms);
+        
+        if (nodes & NODE_BAND_POWER) {
+            std::array<float, BAND_COUNT> left_bands{}, right_bands{};
+            computeBandLevels(left_bands, right_bands);
+            
+            if (nodes & FEATURE_SPECTRUM) {
+                smoothSpectrum(left_bands, right_bands, frame.left_bands, frame.right_bands, dt);
+            }
+            if (nodes & FEATURE_ONSET) {
+                computeOnset(left_bands, right_bands, frame, dt);
+            }
+            if (frame.features & FEATURE_COHERENCE) {
+                computeBandStereo(frame, dt);
+            }
+        }
+        
+        if (nodes & FEATURE_LEVELS) {
+            meter_left.update(left_ms, left_peak, dt);
+            meter_right.update(right_ms, right_peak, dt);
+            frame.left_vu = meter_left.rmsDB() + level_offset_db;
+            frame.right_vu = meter_right.rmsDB() + level_offset_db;
+            frame.left_ppm = meter_left.peakDB() + level_offset_db;
+            frame.right_ppm = meter_right.peakDB() + level_offset_db;
+        }
+        
+        if (nodes & FEATURE_NEEDLE) {
+            const NeedleModel::Preset& preset = NeedleModel::PRESETS[needle_preset];
+            bool direct = preset.frequency <= 0.0f;
+            
+            // Mechanical presets are driven by the block level, not the VU integrator
+            float left_db = direct ? frame.left_vu : 10.0f * log10f(std::max(left_ms, 1e-12f)) + level_offset_db;
+            float right_db = direct ? frame.right_vu : 10.0f * log10f(std::max(right_ms, 1e-12f)) + level_offset_db;
+            
+            frame.left_needle_prev = needle_left.position();
+            frame.right_needle_prev = needle_right.position();
+            needle_left.advance(NeedleModel::scalePosition(left_db), dt, preset);
+            needle_right.advance(NeedleModel::scalePosition(right_db), dt, preset);
+            frame.left_needle = needle_left.position();
+            frame.right_needle = needle_right.position();
+            frame.needle_interval = dt;
+            frame.needle_time = std::chrono::steady_clock::now();
+        }
+        
+        if (nodes & FEATURE_CORRELATION) {
+            updateStereo(block_start, frames);
+            frame.phase = stereo.phase();
+            frame.correlation = stereo.correlation();
+        }
+        
+        if (nodes & FEATURE_WAVEFORM) {
+            size_t read_pos = (write_pos + RING_SIZE - AnalysisFrame::WAVEFORM_SAMPLES) % RING_SIZE;
+            for (int i = 0; i < AnalysisFrame::WAVEFORM_SAMPLES; i++) {
+                frame.left_wave[i] = circular_buffer_left[read_pos];
+                frame.right_wave[i] = circular_buffer_right[read_pos];
+                read_pos = (read_pos + 1) % RING_SIZE;
+            }
+        }
+        
+        frame.sequence = ++frame_sequence;
+        analysis_frames.publish();
+    }
+    
+private:
+    // Seconds for a per-hop retention factor to act like it did at the
+    // original fixed hop rate; 0 retention means no smoothing at all
+    static float timeConstant(float retention) {
+        return retention > 0.0f ? -REFERENCE_HOP_SECONDS / logf(retention) : 0.0f;
+    }
+    
+    static float retention(float time_constant, float dt) {
+        return time_constant > 0.0f ? expf(-dt / time_constant) : 0.0f;
+    }
+    
+    void updateParameters() {
+        // The noise reduction control was tuned as per-hop integral and
+        // gravity factors. Together they amount to an exponential approach
+        // with the integral factor on rises and 1 - gravity * (1 - integral)
+        // on falls; keep exactly that at the reference hop, scaled by real time.
+        float nr_normalized = noise_reduction / 100.0f;
+        float integral_factor = nr_normalized * 0.95f;
+        float gravity_factor = std::max(1.0f - nr_normalized * 0.8f, 0.2f);
+        attack_time = timeConstant(integral_factor);
+        release_time = timeConstant(1.0f - gravity_factor * (1.0f - integral_factor));
+        scale_factor = (sensitivity / 100.0f) * 2.2f;
+        level_offset_db = 20.0f * log10f(sensitivity / 100.0f) - VU_REFERENCE_DBFS;
+    }
+    
+    void computeFFTBands(std::array<float, BAND_COUNT>& left_bands, std::array<float, BAND_COUNT>& right_bands) {
+        // Window and transform every (size, channel) pair as its own task,
+        // largest transforms first so the pool finishes together
+        static constexpr int TASK_ORDER[3] = { RES_MID, RES_BASS, RES_TREBLE };
+        fft_pool->run(6, [this](int task) {
+            int resolution = TASK_ORDER[task / 2];
+            int channel = task % 2;
+            FFTStage& stage = stages[resolution];
+            float* in = stage.in + channel * stage.size;
+            float* out = stage.out + channel * stage.stride * 2;
+            if (resolution == RES_BASS) {
+                loadWindowed(channel == 0 ? bass_buffer_left : bass_buffer_right, BASS_RING_SIZE,
+                             bass_write_pos, stage.window, stage.size, in);
+            } else {
+                loadWindowed(channel == 0 ? circular_buffer_left : circular_buffer_right, RING_SIZE,
+                             write_pos, stage.window, stage.size, in);
+            }
+            stage.fft[channel]->forward(in, out);
+        });
+        
+        // Band energy reads both channels in one pass and costs well under a
+        // microsecond, so it runs here after the join rather than as tasks
+        for (FFTStage& stage : stages) {
+            stage.kernel.run(stage.out, stage.out + stage.stride * 2,
+                             band_power_left.data(), band_power_right.data(),
+                             band_cross_re.data(), band_cross_im.data());
+        }
+        
+        for (int i = 0; i < BAND_COUNT; i++) {
+            left_bands[i] = sqrtf(band_power_left[i]) * scale_factor * Bands::TABLE.correction[i];
+            right_bands[i] = sqrtf(band_power_right[i]) * scale_factor * Bands::TABLE.correction[i];
+        }
+    }
+    
+    // Raw (unsmoothed) band levels from the active engine
+    void computeBandLevels(std::array<float, BAND_COUNT>& left_bands, std::array<float, BAND_COUNT>& right_bands) {
+        if (active_engine == BandEngine::GOERTZEL) {
+            for (int i = 0; i < BAND_COUNT; i++) {
+                left_bands[i] = sqrtf(goertzel.leftPower(i)) * scale_factor * Bands::TABLE.correction[i];
+                right_bands[i] = sqrtf(goertzel.rightPower(i)) * scale_factor * Bands::TABLE.correction[i];
+            }
+        } else if (active_engine == BandEngine::IIR) {
+            for (int i = 0; i < BAND_COUNT; i++) {
+                left_bands[i] = sqrtf(biquads.leftPower(i)) * scale_factor * Bands::TABLE.correction[i];
+                right_bands[i] = sqrtf(biquads.rightPower(i)) * scale_factor * Bands::TABLE.correction[i];
+            }
+        } else {
+            computeFFTBands(left_bands, right_bands);
+        }
+    }
+    
+    void smoothSpectrum(const std::array<float, BAND_COUNT>& left_bands, const std::array<float, BAND_COUNT>& right_bands,
+                        std::array<int, BAND_COUNT>& left_out, std::array<int, BAND_COUNT>& right_out, float dt) {
+        // Exponential approach to the new level, slower on the way down
+        float attack = retention(attack_time, dt);
+        float release = retention(release_time, dt);
+        for (int i = 0; i < BAND_COUNT; i++) {
+            float left = left_bands[i], right = right_bands[i];
+            prev_left_spectrum[i] = left + (prev_left_spectrum[i] - left) * (left > prev_left_spectrum[i] ? attack : release);
+            prev_right_spectrum[i] = right + (prev_right_spectrum[i] - right) * (right > prev_right_spectrum[i] ? attack : release);
+            
+            left_out[i] = std::min(255, std::max(0, (int)prev_left_spectrum[i]));
+            right_out[i] = std::min(255, std::max(0, (int)prev_right_spectrum[i]));
+        }
+    }
+    
+    // Half-wave rectified change of log band level, summed over bands and channels
+    void computeOnset(const std::array<float, BAND_COUNT>& left_bands, const std::array<float, BAND_COUNT>& right_bands,
+                      AnalysisFrame& frame, float dt) {
+        float flux = 0.0f;
+        for (int i = 0; i < BAND_COUNT; i++) {
+            float level = log1pf(left_bands[i] + right_bands[i]);
+            flux += std::max(0.0f, level - prev_onset_levels[i]);
+            prev_onset_levels[i] = level;
+        }
+        flux = onset_primed ? flux / BAND_COUNT : 0.0f;
+        onset_primed = true;
+        
+        frame.onset_strength = flux;
+        frame.onset = flux > flux_mean * ONSET_RATIO + ONSET_FLOOR;
+        flux_mean += (1.0f - expf(-dt / ONSET_TIME_CONSTANT)) * (flux - flux_mean);
+    }
+    
+    // Band engines and everything averaged from their output start over when
+    // the engine changes or band power resumes after not being needed
+    void resetBandState() {
+        goertzel.reset();
+        biquads.reset();
+        decimator_left.reset();
+        decimator_right.reset();
+        std::fill(bass_buffer_left, bass_buffer_left + BASS_RING_SIZE, 0.0f);
+        std::fill(bass_buffer_right, bass_buffer_right + BASS_RING_SIZE, 0.0f);
+        avg_power_left.fill(0.0f);
+        avg_power_right.fill(0.0f);
+        avg_cross_re.fill(0.0f);
+        avg_cross_im.fill(0.0f);
+        flux_mean = 0.0f;
+        onset_primed = false;
+    }
+    
+    // Smooth the band spectra from computeFFTBands and derive coherence and balance
+    void computeBandStereo(AnalysisFrame& frame, float dt) {
+        float alpha = 1.0f - expf(-dt / COHERENCE_TIME_CONSTANT);
+        for (int i = 0; i < BAND_COUNT; i++) {
+            avg_power_left[i] += alpha * (band_power_left[i] - avg_power_left[i]);
+            avg_power_right[i] += alpha * (band_power_right[i] - avg_power_right[i]);
+            avg_cross_re[i] += alpha * (band_cross_re[i] - avg_cross_re[i]);
+            avg_cross_im[i] += alpha * (band_cross_im[i] - avg_cross_im[i]);
+            
+            float auto_product = avg_power_left[i] * avg_power_right[i];
+            float cross_sq = avg_cross_re[i] * avg_cross_re[i] + avg_cross_im[i] * avg_cross_im[i];
+            float total = avg_power_left[i] + avg_power_right[i];
+            
+            frame.band_coherence[i] = auto_product > 1e-20f ? std::min(1.0f, cross_sq / auto_product) : 0.0f;
+            frame.band_balance[i] = total > 1e-10f ? (avg_power_left[i] - avg_power_right[i]) / total : 0.0f;
+        }
+    }
+    
+    void updateStereo(size_t start, int count) {
+        stereo.decay((float)count / SAMPLE_RATE);
+        while (count > 0) {
+            int run = std::min(count, (int)(RING_SIZE - start));
+            stereo.accumulate(circular_buffer_left + start, circular_buffer_right + start, run);
+            start = (start + run) % RING_SIZE;
+            count -= run;
+        }
+    }
+    
+public:
+    AudioProcessor() : pcm_handle(nullptr), thread_running(false), fft_pool(new WorkerPool(1)) {
+        circular_buffer_left = new float[RING_SIZE]();
+        circular_buffer_right = new float[RING_SIZE]();
+        bass_buffer_left = new float[BASS_RING_SIZE]();
+        bass_buffer_right = new float[BASS_RING_SIZE]();
+        decimator_left.configure(SAMPLE_RATE, BASS_MAX_HZ);
+        decimator_right.configure(SAMPLE_RATE, BASS_MAX_HZ);
+        
+        // Allocate FFT resources, one plan per transform size
+        const int sizes[3] = { FFT_SIZE_BASS, FFT_SIZE_MID, FFT_SIZE_TREBLE };
+        for (int r = 0; r < 3; r++) {
+            FFTStage& stage = stages[r];
+            stage.size = sizes[r];
+            stage.stride = stage.size / 2 + 4;
+            stage.in = allocFloats(stage.size * 2);
+            stage.out = allocFloats(stage.stride * 4);
+            stage.window = new float[stage.size];
+            createHannWindow(stage.window, stage.size);
+        }
+        createTransforms();
+        
+        for (int i = 0; i < BAND_COUNT; i++) {
+            const BandBins& bins = BAND_BINS[i];
+            stages[bins.resolution].kernel.addBand(i, bins.low_bin, bins.high_bin, bins.power_scale);
+        }
+        
+        for (int i = 0; i < BAND_COUNT; i++) {
+            goertzel.configure(i, Bands::TABLE.low[i], Bands::TABLE.high[i], SAMPLE_RATE, REFERENCE_FFT_SIZE);
+            biquads.configure(i, Bands::TABLE.low[i], Bands::TABLE.high[i], SAMPLE_RATE, REFERENCE_FFT_SIZE);
+        }
+        
+        updateParameters();
+        last_audio_time = std::chrono::steady_clock::now();
+    }
+    
+    ~AudioProcessor() {
+        stop();
+        delete[] circular_buffer_left;
+        delete[] circular_buffer_right;
+        delete[] bass_buffer_left;
+        delete[] bass_buffer_right;
+        
+        for (FFTStage& stage : stages) {
+            stage.fft[0].reset();
+            stage.fft[1].reset();
+            free(stage.in);
+            free(stage.out);
+            delete[] stage.window;
+        }
+    }
+    
+    bool start() {
+        if (fifo) {
+            if (!fifo->open()) return false;
+            thread_running = true;
+            audio_thread = std::thread(&AudioProcessor::audioThreadFunc, this);
+            return true;
+        }
+        
+        int err = snd_pcm_open(&pcm_handle, "cava", SND_PCM_STREAM_CAPTURE, 0);
+        if (err < 0) {
+            err = snd_pcm_open(&pcm_handle, "hw:Loopback,1", SND_PCM_STREAM_CAPTURE, 0);
+        }
+        if (err < 0) return false;
+        
+        snd_pcm_hw_params_t* hw_params;
+        snd_pcm_hw_params_alloca(&hw_params);
+        snd_pcm_hw_params_any(pcm_handle, hw_params);
+        snd_pcm_hw_params_set_access(pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
+        snd_pcm_hw_params_set_format(pcm_handle, hw_params, SND_PCM_FORMAT_S16_LE);
+        snd_pcm_hw_params_set_channels(pcm_handle, hw_params, CHANNELS);
+        
+        unsigned int rate = SAMPLE_RATE;
+        snd_pcm_hw_params_set_rate_near(pcm_handle, hw_params, &rate, 0);
+        
+        if (snd_pcm_hw_params(pcm_handle, hw_params) < 0) {
+            snd_pcm_close(pcm_handle);
+            return false;
+        }
+        
+        thread_running = true;
+        audio_thread = std::thread(&AudioProcessor::audioThreadFunc, this);
+        return true;
+    }
+
+    void setSleepState(bool sleeping) {
+    is_sleeping = sleeping;
+    }
+    
+    // Read MPD's fifo output instead of ALSA. Call before start().
+    void setFifoSource(const std::string& path, const PCMFormat& format) {
+        fifo.reset(new FifoCapture(path, format, SAMPLE_RATE));
+    }
+    
+    bool usesFifo() const { return fifo != nullptr; }
+    
+    void stop() {
+        if (thread_running) {
+            thread_running = false;
+            if (audio_thread.joinable()) audio_thread.join();
+        }
+        if (pcm_handle) {
+            snd_pcm_close(pcm_handle);
+            pcm_handle = nullptr;
+        }
+    }
+    
+    bool checkForAudio() {
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(now - last_audio_time).count();
+        return elapsed < SLEEP_TIMEOUT_SEC;
+    }
+    
+    // Latest published analysis frame. Render thread only: the snapshot
+    // stays valid until the next call.
+    const AnalysisFrame& getFrame() {
+        return analysis_frames.read();
+    }
+    
+    void setSensitivity(int value) {
+        sensitivity = std::max(10.0f, std::min(300.0f, (float)value));
+        parameters_changed = true;
+    }
+
+    void setNoiseReduction(int value) {
+        noise_reduction = std::max(0.0f, std::min(100.0f, (float)value));
+        parameters_changed = true;
+    }
+    
+    void setBandEngine(BandEngine engine) {
+        band_engine = engine;
+    }
+    
+    BandEngine getBandEngine() const { return band_engine; }
+    
+    // Threads sharing the per-channel FFT work, counting the capture thread.
+    // Call before start().
+    void setWorkers(int workers) {
+        fft_pool.reset(new WorkerPool(std::max(1, workers)));
+    }
+    
+    int getWorkers() const { return fft_pool->size(); }
+    
+    // Transform used by the FFT band engine. Call before start().
+    void setFFTKind(FFTKind kind) {
+        fft_kind = kind;
+        createTransforms();
+    }
+    
+    FFTKind getFFTKind() const { return fft_kind; }
+    
+    void setNeedlePreset(int preset) {
+        needle_preset = std::max(0, std::min(NeedleModel::PRESET_COUNT - 1, preset));
+    }
+    
+    int cycleNeedlePreset() {
+        int preset = (needle_preset + 1) % NeedleModel::PRESET_COUNT;
+        needle_preset = preset;
+        return preset;
+    }
+    
+    // Analysis products the active visualization consumes (FEATURE_* bits)
+    void setFeatures(uint32_t features) {
+        requested_features = features;
+    }
+    
+    int getSensitivity() const { return (int)sensitivity; }
+    int getNoiseReduction() const { return (int)noise_reduction; }
+};
+
+// Improved TextScroller with smooth pixel-based scrolling
+class TextScroller {
+private:
+    std::string current_text;
+    float scroll_position;  // Now uses float for sub-pixel precision
+    std::chrono::steady_clock::time_point last_scroll_time;
+    int pause_counter;
+    
+    static constexpr float SCROLL_SPEED_PIXELS_PER_SECOND = 30.0f;  // Adjustable speed
+    static constexpr int SCROLL_PAUSE_MS = 2000;  // Pause at start/end
+    
+    enum ScrollState {
+        PAUSED_AT_START,
+        SCROLLING,
+        PAUSED_AT_END
+    } scroll_state;
+    
+public:
+    static constexpr int SCROLL_GAP_PIXELS = 1;  // Gap between text repetitions
+    
+    TextScroller() : scroll_position(0.0f), pause_counter(0), 
+                     scroll_state(PAUSED_AT_START) {
+        last_scroll_time = std::chrono::steady_clock::now();
+    }
+    
+    void setText(const std::string& text) {
+        if (text != current_text) {
+            current_text = text;
+            scroll_position = 0.0f;
+            scroll_state = PAUSED_AT_START;
+            pause_counter = SCROLL_PAUSE_MS;
+        }
+    }
+    
+    // Pixel offset into a looping strip of text_width + SCROLL_GAP_PIXELS
+    // columns for this frame; 0 while the text fits or is paused
+    int scrollOffset(int text_width, int max_width) {
+        if (text_width <= max_width) {
+            return 0;
+        }
+        
+        // Handle scrolling timing
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_scroll_time).count();
+        last_scroll_time = now;
+        
+        // Update based on state
+        switch (scroll_state) {
+            case PAUSED_AT_START:
+                pause_counter -= elapsed_ms;
+                if (pause_counter <= 0) {
+                    scroll_state = SCROLLING;
+                    pause_counter = 0;
+                }
+                break;
+                
+            case SCROLLING:
+                // Smooth pixel-based scrolling
+                scroll_position += (SCROLL_SPEED_PIXELS_PER_SECOND * elapsed_ms) / 1000.0f;
+                
+                // Check if we've scrolled the full text + gap
+                if (scroll_position >= text_width + SCROLL_GAP_PIXELS) {
+                    scroll_position = 0.0f;
+                    scroll_state = PAUSED_AT_START;
+                    pause_counter = SCROLL_PAUSE_MS;
+                }
+                break;
+                
+            case PAUSED_AT_END:
+                // Not used in continuous loop, but could be added for ping-pong scrolling
+                break;
+        }
+        
+        return (int)scroll_position;
+    }
+    
+    void reset() {
+        scroll_position = 0.0f;
+        scroll_state = PAUSED_AT_START;
+        pause_counter = SCROLL_PAUSE_MS;
+        last_scroll_time = std::chrono::steady_clock::now();
+    }
+};
+
+// One line of text pre-rendered as page-0 column bytes (rows 0-7), so
+// scrolling is a column copy with no FreeType work
+struct TitleStrip {
+    std::string text;
+    int baseline;
+    int width;                     // Advance width in pixels
+    std::vector<uint8_t> columns;  // At least width entries
+};
+
+// Renders title strips off the render thread. FreeType faces must not be
+// shared between threads, so the worker loads its own copy of the font.
+class TitleRasterizer {
+private:
+    FontManager fonts;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<std::pair<std::string, int>> pending;
+    std::vector<std::shared_ptr<const TitleStrip>> ready;  // Oldest first
+    bool running;
+    
+    static constexpr size_t CAPACITY = 8;  // Current and next titles, a few views' worth
+    
+    void workerFunc() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            if (pending.empty()) {
+                wake.wait(lock);
+                continue;
+            }
+            auto job = pending.front();
+            pending.erase(pending.begin());
+            
+            lock.unlock();
+            std::shared_ptr<const TitleStrip> strip = rasterize(&fonts, job.first, job.second);
+            lock.lock();
+            
+            store(strip);
+        }
+    }
+    
+    // Caller holds mutex
+    void store(std::shared_ptr<const TitleStrip> strip) {
+        if (ready.size() >= CAPACITY) ready.erase(ready.begin());
+        ready.push_back(std::move(strip));
+    }
+    
+    std::shared_ptr<const TitleStrip> lookup(const std::string& text, int baseline) const {
+        for (auto it = ready.rbegin(); it != ready.rend(); ++it) {
+            if ((*it)->baseline == baseline && (*it)->text == text) return *it;
+        }
+        return nullptr;
+    }
+    
+public:
+    TitleRasterizer() : running(false) {}
+    
+    ~TitleRasterizer() {
+        stop();
+    }
+    
+    bool start(const char* font_path) {
+        if (running) return true;
+        if (!fonts.init(font_path)) return false;
+        running = true;
+        worker = std::thread(&TitleRasterizer::workerFunc, this);
+        return true;
+    }
+    
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_one();
+        if (worker.joinable()) worker.join();
+    }
+    
+    // Queue text for background rendering; no-op when ready or already queued
+    void request(const std::string& text, int baseline) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running || lookup(text, baseline)) return;
+            for (const auto& job : pending) {
+                if (job.second == baseline && job.first == text) return;
+            }
+            pending.emplace_back(text, baseline);
+        }
+        wake.notify_one();
+    }
+    
+    // Finished strip, or null when it was never requested or is still rendering
+    std::shared_ptr<const TitleStrip> find(const std::string& text, int baseline) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return lookup(text, baseline);
+    }
+    
+    // Also the synchronous fallback, with the render thread's own font manager
+    static std::shared_ptr<const TitleStrip> rasterize(FontManager* fm, const std::string& text, int baseline) {
+        auto strip = std::make_shared<TitleStrip>();
+        strip->text = text;
+        strip->baseline = baseline;
+        strip->width = fm->getTextWidth(text.c_str(), FontManager::SMALL);
+        // Glyphs can overhang their advance; keep a few spare columns
+        strip->columns.assign(strip->width + 4, 0);
+        fm->renderText(text.c_str(), strip->columns.data(), strip->columns.size(), 8, 0, baseline, FontManager::SMALL);
+        return strip;
+    }
+};
+
+// Render-side elapsed time for view ballistics. Clamped so a pause (sleep,
+// switching views) does not make markers jump when drawing resumes.
+class FrameClock {
+private:
+    std::chrono::steady_clock::time_point last;
+    bool started = false;
+    
+public:
+    static constexpr float MAX_STEP = 0.1f;
+    
+    float tick() {
+        auto now = std::chrono::steady_clock::now();
+        float dt = started ? std::chrono::duration<float>(now - last).count() : 0.0f;
+        last = now;
+        started = true;
+        return std::min(dt, MAX_STEP);
+    }
+};
+
+// VU needle rasterized once for each of its 128 scale positions, so a frame
+// ORs a short span list into the page buffer instead of running Bresenham
+class NeedleRaster {
+private:
+    struct Glyph {
+        uint32_t first;
+        uint16_t count;
+        uint8_t col_lo, col_hi, page_lo, page_hi;
+    };
+    
+    std::array<Glyph, 128> glyphs;
+    std::vector<PixelSpan> spans;
+    
+public:
+    static constexpr int POSITIONS = 128;
+    
+    // Pixel extent of one needle, for partial flushes
+    struct Bounds {
+        uint8_t col_lo, col_hi, page_lo, page_hi;
+        
+        Bounds merge(const Bounds& other) const {
+            return { std::min(col_lo, other.col_lo), std::max(col_hi, other.col_hi),
+                     std::min(page_lo, other.page_lo), std::max(page_hi, other.page_hi) };
+        }
+    };
+    
+    NeedleRaster() {
+        Display scratch(0, 0, 0);
+        for (int pos = 0; pos < POSITIONS; pos++) {
+            scratch.clear();
+            drawLines(&scratch, pos);
+            
+            Glyph& glyph = glyphs[pos];
+            glyph.first = spans.size();
+            glyph.col_lo = 127; glyph.col_hi = 0;
+            glyph.page_lo = 7; glyph.page_hi = 0;
+            for (int offset = 0; offset < 1024; offset++) {
+                if (!scratch.buffer[offset]) continue;
+                spans.push_back({ (uint16_t)offset, scratch.buffer[offset] });
+                uint8_t col = offset % 128, page = offset / 128;
+                glyph.col_lo = std::min(glyph.col_lo, col);
+                glyph.col_hi = std::max(glyph.col_hi, col);
+                glyph.page_lo = std::min(glyph.page_lo, page);
+                glyph.page_hi = std::max(glyph.page_hi, page);
+            }
+            glyph.count = spans.size() - glyph.first;
+        }
+    }
+    
+    // Scale position 0-1 spans the printed -20..+3 dB markings (0-125)
+    static int position(float scale_position) {
+        int pos = (int)(scale_position * 125.0f);
+        return std::max(0, std::min(POSITIONS - 1, pos));
+    }
+    
+    // Reference rasterization (matching Python algorithm), also used to build the table
+    static void drawLines(Display* display, int pos) {
+        int start_x = 71 - (127 - pos) / 8;
+        int start_y = 63;
+        int end_x = pos;
+        
+        // Parabolic curve for needle
+        int curve_height = pos * (127 - pos);
+        int end_y = 20 - curve_height / 200;
+        
+        // Draw needle with thickness
+        display->drawLine(start_x, start_y, end_x, end_y);
+        display->drawLine(start_x + 1, start_y, end_x + 1, end_y);
+    }
+    
+    Bounds draw(Display* display, int pos) const {
+        const Glyph& glyph = glyphs[pos];
+        display->orSpans(spans.data() + glyph.first, glyph.count);
+        return bounds(pos);
+    }
+    
+    Bounds bounds(int pos) const {
+        const Glyph& glyph = glyphs[pos];
+        return { glyph.col_lo, glyph.col_hi, glyph.page_lo, glyph.page_hi };
+    }
+    
+    size_t spanCount() const { return spans.size(); }
+};
+
+// Unified visualization class with an optional player title bar
+class Visualization {
+protected:
+    Display* left_display;
+    Display* right_display;
+    PlayerSource* player;
+    FontManager* font_manager;
+    TextScroller title_scroller_left;
+    TextScroller title_scroller_right;
+    
+    // Title layout for the metadata version it was computed from
+    struct TitleLayout {
+        uint64_t version = 0;
+        std::shared_ptr<const TrackMetadata> track;
+        std::shared_ptr<const TitleStrip> strip;
+    };
+    TitleLayout title_layout_left;
+    TitleLayout title_layout_right;
+    std::shared_ptr<const PlaybackStatus> playback;
+    TitleRasterizer* title_rasterizer;
+    uint64_t upcoming_version;
+    
+    // One-pixel progress line under the title, extrapolated from the last player event
+    void drawProgress(Display* display, int y) {
+        uint64_t version = player->getPlaybackVersion();
+        if (!playback || playback->version != version) {
+            playback = player->getPlayback();
+        }
+        if (!playback) return;
+        
+        float progress = playback->progressAt(std::chrono::steady_clock::now());
+        int width = (int)(std::min(progress, 1.0f) * 128.0f);
+        if (width > 0) {
+            display->drawLine(0, y, width - 1, y);
+        }
+    }
+    
+    // Helper to draw title with optional smooth scrolling player info
+    void drawTitleWithPlayer(Display* display, const char* viz_name, int y_offset = 0, bool is_left = true) {
+        // Always draw visualization name
+        display->drawText(0, y_offset, viz_name, FontManager::SMALL);
+        
+        // Early return without a player
+        if (!player || !font_manager) {
+            return;
+        }
+        
+        drawProgress(display, y_offset + 2);
+        
+        // Calculate where the player text should start
+        int viz_name_width = font_manager->getTextWidth(viz_name, FontManager::SMALL);
+        int text_start_x = viz_name_width + 8; // 8 pixels spacing
+        int available_width = 128 - text_start_x;
+        
+        // Re-layout only when the player published a new record. The strip is normally
+        // already rendered from when this song was the upcoming one.
+        TextScroller& scroller = is_left ? title_scroller_left : title_scroller_right;
+        TitleLayout& layout = is_left ? title_layout_left : title_layout_right;
+        uint64_t version = player->getMetadataVersion();
+        if (version != layout.version) {
+            layout.track = player->getMetadata();
+            layout.version = layout.track->version;
+            const std::string& text = layout.track->formatted_text;
+            layout.strip = title_rasterizer ? title_rasterizer->find(text, y_offset) : nullptr;
+            if (!layout.strip) {
+                layout.strip = TitleRasterizer::rasterize(font_manager, text, y_offset);
+            }
+            scroller.setText(text);
+        }
+        
+        // Get the next song's strip rendering before it starts
+        uint64_t upcoming = player->getUpcomingVersion();
+        if (title_rasterizer && upcoming != upcoming_version) {
+            upcoming_version = upcoming;
+            auto next = player->getUpcoming();
+            if (next && !next->formatted_text.empty()) {
+                title_rasterizer->request(next->formatted_text, y_offset);
+            }
+        }
+        
+        const TitleStrip& strip = *layout.strip;
+        if (strip.width == 0 || available_width <= 20) return;
+        
+        // Copy the visible window of the strip, wrapping for seamless looping
+        int offset = scroller.scrollOffset(strip.width, available_width);
+        int period = strip.width + TextScroller::SCROLL_GAP_PIXELS;
+        uint8_t* row = display->buffer + text_start_x;
+        if (strip.width <= available_width) {
+            for (int col = 0; col < available_width && col < (int)strip.columns.size(); col++) {
+                row[col] |= strip.columns[col];
+            }
+        } else {
+            for (int col = 0; col < available_width; col++) {
+                int src = (offset + col) % period;
+                if (src < strip.width) row[col] |= strip.columns[src];
+            }
+        }
+    }
+    
+    // Helper method for simple title drawing (backward compatibility)
+    void drawTitle(Display* display, const char* viz_name, int y_offset = 0) {
+        display->drawText(2, y_offset, viz_name, FontManager::SMALL);
+    }
+    
+public:
+    // Constructor for basic visualization (no player info)
+    Visualization(Display* left, Display* right) 
+        : left_display(left), right_display(right), player(nullptr), font_manager(nullptr),
+          title_rasterizer(nullptr), upcoming_version(0) {}
+    
+    // Constructor with player info
+    Visualization(Display* left, Display* right, PlayerSource* source, FontManager* fm) 
+        : left_display(left), right_display(right), player(source), font_manager(fm),
+          title_rasterizer(nullptr), upcoming_version(0) {}
+    
+    virtual ~Visualization() = default;
+    virtual void render(ControlState& state, AudioProcessor& audio) = 0;
+    virtual const char* getName() const = 0;
+    
+    // Analysis products read in render(), so the capture thread can skip the rest
+    virtual uint32_t requiredFeatures() const { return FEATURE_ALL; }
+    
+    // Displays were cleared or drawn by someone else; next render must repaint fully
+    virtual void activate() {}
+    
+    // Background renderer for upcoming titles; without one titles render on first use
+    void setTitleRasterizer(TitleRasterizer* rasterizer) { title_rasterizer = rasterizer; }
+    
+    // Utility method to check if player info is available
+    bool hasPlayerSupport() const { return player != nullptr && font_manager != nullptr; }
+};
+
+// VU Meter visualization
+class VUMeterVisualization : public Visualization {
+private:
+    struct DBPosition {
+        int x;
+        const char* text;
+    };
+    
+    std::array<DBPosition, 11> db_positions;
+    static constexpr const char* POWER_SCALE[6] = {"0", "20", "40", "60", "80", "100"};
+    
+    void calculateDBPositions() {
+        // dB values matching Python code
+        const float db_values[11] = {-20, -10, -7, -5, -3, -2, -1, 0, 1, 2, 3};
+        
+        for (int i = 0; i < 11; i++) {
+            // Convert dB to linear value
+            float value = powf(10.0f, db_values[i] / 20.0f);
+            float log_pos = log10f(value);
+            
+            // Min/max log values for -20dB to +3dB
+            float min_log = log10f(powf(10.0f, -20.0f / 20.0f));
+            float max_log = log10f(powf(10.0f, 3.0f / 20.0f));
+            
+            // Calculate x position (0-125 range as in Python)
+            int x_pos = (int)((log_pos - min_log) / (max_log - min_log) * 125.0f);
+            
+            // Store position and text
+            db_positions[i].x = x_pos;
+            // Static storage for text
+            static char texts[11][4];
+            snprintf(texts[i], 4, "%d", abs((int)db_values[i]));
+            db_positions[i].text = texts[i];
+        }
+    }
+    
+    void drawVUBackground(Display* display, bool is_left) {
+        // Draw dB markings
+        for (const auto& pos : db_positions) {
+            display->drawText(pos.x, 5, pos.text, FontManager::SMALL);
+            display->drawLine(pos.x, 7, pos.x, 9);
+        }
+        
+        // Draw horizontal lines
+        display->drawLine(108, 8, 127, 8);  // Short line at right
+        display->drawLine(0, 9, 127, 9);    // Full line
+        display->drawLine(0, 11, 127, 11);    // Full line
+        
+        // Draw edge marks
+        display->drawLine(0, 6, 0, 8);
+        display->drawLine(0, 11, 0, 13);
+        display->drawLine(127, 6, 127, 8);
+        display->drawLine(127, 11, 127, 13);
+        
+        // Draw power scale
+        for (int i = 0; i < 6; i++) {
+            int x = i * 22;
+            display->drawText(x, 22, POWER_SCALE[i], FontManager::SMALL);
+            display->drawLine(x, 11, x, 13);
+        }
+        
+        // Draw +/- indicators
+        display->drawText(0, 28, "-", FontManager::SMALL);
+        display->drawText(124, 28, "+", FontManager::SMALL);
+        
+        // Draw channel label
+        display->drawText(0, 64, is_left ? "LEFT" : "RIGHT", FontManager::SMALL);
+        display->drawText(120, 64, "dB", FontManager::SMALL);
+    }
+    
+    // Per-display copy of the static scale and the needle last flushed over it
+    struct Panel {
+        uint8_t background[1024];
+        int needle_pos = -1;  // -1: panel contents unknown, repaint everything
+    };
+    
+    NeedleRaster needle_raster;
+    Panel panels[2];
+    
+    void drawVUMeter(Display* display, Panel& panel, float scale_position, bool is_left) {
+        int pos = NeedleRaster::position(scale_position);
+        
+        if (panel.needle_pos < 0) {
+            display->clear();
+            drawVUBackground(display, is_left);
+            memcpy(panel.background, display->buffer, sizeof(panel.background));
+            needle_raster.draw(display, pos);
+            display->display();
+        } else if (pos != panel.needle_pos) {
+            // Restore the scale under the old needle, OR in the new one, and
+            // flush only the rectangle the two needles cover
+            NeedleRaster::Bounds dirty = needle_raster.bounds(panel.needle_pos).merge(needle_raster.bounds(pos));
+            int width = dirty.col_hi - dirty.col_lo + 1;
+            for (int page = dirty.page_lo; page <= dirty.page_hi; page++) {
+                int offset = page * 128 + dirty.col_lo;
+                memcpy(display->buffer + offset, panel.background + offset, width);
+            }
+            needle_raster.draw(display, pos);
+            display->displayRegion(dirty.col_lo, dirty.col_hi, dirty.page_lo, dirty.page_hi);
+        }
+        panel.needle_pos = pos;
+    }
+    
+public:
+    VUMeterVisualization(Display* left, Display* right) 
+        : Visualization(left, right) {
+        calculateDBPositions();
+    }
+    
+    void activate() override {
+        panels[0].needle_pos = -1;
+        panels[1].needle_pos = -1;
+    }
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        
+        // Draw one needle interval behind the model, between its last two states
+        float alpha = 1.0f;
+        if (frame.needle_interval > 0.0f) {
+            float age = std::chrono::duration<float>(std::chrono::steady_clock::now() - frame.needle_time).count();
+            alpha = std::max(0.0f, std::min(1.0f, age / frame.needle_interval));
+        }
+        
+        drawVUMeter(left_display, panels[0], frame.left_needle_prev + (frame.left_needle - frame.left_needle_prev) * alpha, true);
+        drawVUMeter(right_display, panels[1], frame.right_needle_prev + (frame.right_needle - frame.right_needle_prev) * alpha, false);
+    }
+    
+    const char* getName() const override { return "VU Meter"; }
+    uint32_t requiredFeatures() const override { return FEATURE_NEEDLE; }
+};
+
+class SpectrumVisualizationMPD : public Visualization {
+private:
+    static constexpr float PEAK_FALL_RATE = 60.0f;  // Pixels per second (0.8 per frame at the old ~75 FPS)
+    
+    std::array<float, BAND_COUNT> peak_left{};
+    std::array<float, BAND_COUNT> peak_right{};
+    FrameClock clock;
+    
+    void drawSpectrum(Display* display, const std::array<int, BAND_COUNT>& levels, 
+                      std::array<float, BAND_COUNT>& peaks, const char* title, bool is_left, float dt) {
+        display->clear();
+        
+        // Draw title with player info on same line
+        drawTitleWithPlayer(display, title, 5, is_left);
+        
+        // Now we have more vertical space for bars!
+        int bar_top = 8; // Only need small offset now
+        int bar_bottom = 57;
+        int bar_width = Bands::BAR_WIDTH;
+        int bar_height_range = bar_bottom - bar_top;
+        
+        // Draw bars
+        for (int i = 0; i < BAND_COUNT; i++) {
+            int x = 1 + (i * Bands::BAR_PITCH);
+            int height = (levels[i] * bar_height_range) / 255;
+            int bar_y = bar_bottom - height;
+            
+            // Draw bar
+            if (height > 0 && bar_y >= bar_top) {
+                display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
+                                 std::min(height, bar_bottom - bar_top), true);
+            }
+            
+            // Update and draw peak
+            if (bar_y < peaks[i]) {
+                peaks[i] = bar_y;
+            }
+            peaks[i] = std::min((float)(bar_bottom - 1), peaks[i] + PEAK_FALL_RATE * dt);
+            
+            if (peaks[i] < bar_bottom - 1 && peaks[i] >= bar_top) {
+                display->drawLine(x, (int)peaks[i], x + bar_width - 1, (int)peaks[i]);
+            }
+            
+            // Label
+            if (i % Bands::LABEL_STRIDE == 0) {
+                display->drawText(x, 64, Bands::TABLE.labels[i].data(), FontManager::SMALL);
+            }
+        }
+        
+        display->display();
+    }
+    
+public:
+    SpectrumVisualizationMPD(Display* left, Display* right, PlayerSource* player, FontManager* fm) 
+        : Visualization(left, right, player, fm) {}
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        float dt = clock.tick();
+        
+        drawSpectrum(left_display, frame.left_bands, peak_left, "SPECTRUM L", true, dt);
+        drawSpectrum(right_display, frame.right_bands, peak_right, "SPECTRUM R", false, dt);
+    }
+    
+    const char* getName() const override { return "Spectrum Analyzer"; }
+    uint32_t requiredFeatures() const override { return FEATURE_SPECTRUM; }
+};
+
+class EmptySpectrumVisualizationMPD : public Visualization {
+private:
+    void drawSpectrum(Display* display, const std::array<int, BAND_COUNT>& levels, const char* title, bool is_left) {
+        display->clear();
+        
+        // Draw title with player info on same line
+        drawTitleWithPlayer(display, title, 5, is_left);
+        
+        int bar_top = 8;
+        int bar_bottom = 57;
+        int bar_width = Bands::BAR_WIDTH;
+        int bar_height_range = bar_bottom - bar_top;
+        
+        // Draw bars
+        for (int i = 0; i < BAND_COUNT; i++) {
+            int x = 1 + (i * Bands::BAR_PITCH);
+            int height = (levels[i] * bar_height_range) / 255;
+            int bar_y = bar_bottom - height;
+            
+            // Draw bar
+            if (height > 0 && bar_y >= bar_top) {
+                display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
+                                 std::min(height, bar_bottom - bar_top), false);
+            }
+                       
+            // Label
+            if (i % Bands::LABEL_STRIDE == 0) {
+                display->drawText(x, 64, Bands::TABLE.labels[i].data(), FontManager::SMALL);
+            }
+        }
+        
+        display->display();
+    }
+    
+public:
+    EmptySpectrumVisualizationMPD(Display* left, Display* right, PlayerSource* player, FontManager* fm) 
+        : Visualization(left, right, player, fm) {}
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        
+        drawSpectrum(left_display, frame.left_bands, "SPECTRUM L", true);
+        drawSpectrum(right_display, frame.right_bands, "SPECTRUM R", false);
+    }
+    
+    const char* getName() const override { return "Empty Spectrum Analyzer"; }
+    uint32_t requiredFeatures() const override { return FEATURE_SPECTRUM; }
+};
+
+class TeubSpectrumVisualizationMPD : public Visualization {
+private:
+    static constexpr float PEAK_FALL_RATE = 60.0f;  // Pixels per second (0.8 per frame at the old ~75 FPS)
+    static constexpr int GLYPH_WIDTH = 19;          // Shaft plus the two radius-5 balls
+    static constexpr bool GLYPHS = Bands::BAR_PITCH >= GLYPH_WIDTH;  // Plain bars at narrower pitches
+    
+    std::array<float, BAND_COUNT> peak_left{};
+    std::array<float, BAND_COUNT> peak_right{};
+    FrameClock clock;
+    
+    void drawSpectrum(Display* display, const std::array<int, BAND_COUNT>& levels, 
+                      std::array<float, BAND_COUNT>& peaks, const char* title, bool is_left, float dt) {
+        display->clear();
+        
+        // Draw title with player info on same line
+        drawTitleWithPlayer(display, title, 5, is_left);
+        
+        // Now we have more vertical space for bars!
+        int bar_top = 12; // Only need small offset now
+        int bar_bottom = GLYPHS ? 47 : 57;
+        int bar_width = GLYPHS ? 8 : Bands::BAR_WIDTH;
+        int bar_height_range = bar_bottom - bar_top;
+        
+        // Draw bars
+        for (int i = 0; i < BAND_COUNT; i++) {
+            int x = 1 + (i * Bands::BAR_PITCH);
+            int height = (levels[i] * bar_height_range) / 255;
+            int bar_y = bar_bottom - height;
+            
+            if (!GLYPHS) {
+                if (height > 0) {
+                    display->drawRect(x, std::max(bar_y, bar_top), bar_width,
+                                      std::min(height, bar_height_range), true);
+                }
+                if (bar_y < peaks[i]) {
+                    peaks[i] = bar_y;
+                }
+                peaks[i] = std::min((float)(bar_bottom - 1), peaks[i] + PEAK_FALL_RATE * dt);
+                if (peaks[i] < bar_bottom - 1 && peaks[i] >= bar_top) {
+                    display->drawLine(x, (int)peaks[i], x + bar_width - 1, (int)peaks[i]);
+                }
+                if (i % Bands::LABEL_STRIDE == 0) {
+                    display->drawText(x, 64, Bands::TABLE.labels[i].data(), FontManager::SMALL);
+                }
+                continue;
+            }
+            
+            // Draw bar
+            if (height > 0 && bar_y >= bar_top) {
+            //    display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
+            //                     std::min(height, bar_height_range), false);
+                display->drawLine(x, std::max(bar_y, bar_top), x, bar_bottom);
+                display->drawLine(x+bar_width, std::max(bar_y, bar_top), x+bar_width, bar_bottom);
+                display->drawCircle(x+4, std::max(bar_y, bar_top), 5, false);
+                display->drawLine(x+4, std::max(bar_y, bar_top) -3, x+4, std::max(bar_y, bar_top)-1);
+
+
+            }
+            
+            // Update and draw peak
+            if (bar_y < peaks[i]) {
+                peaks[i] = bar_y;
+            }
+            peaks[i] = std::min((float)(bar_bottom - 1), peaks[i] + PEAK_FALL_RATE * dt);
+            
+            if (peaks[i] < bar_bottom - 1 && peaks[i] >= bar_top) {
+                display->drawLine(x+4, ((int)peaks[i])-4, x+4 , ((int)peaks[i])-2);
+                display->drawLine(x+3, ((int)peaks[i])-4, x+3 , ((int)peaks[i])-4);
+                display->drawLine(x+5, ((int)peaks[i])-4, x+5 , ((int)peaks[i])-6);
+
+
+            }
+            
+            // balls
+            display->drawCircle(x, 52, 5, false);
+            display->drawCircle(x+8, 52, 5, false);
+
+
+            // Label
+            if (i % Bands::LABEL_STRIDE == 0) {
+                display->drawText(x, 64, Bands::TABLE.labels[i].data(), FontManager::SMALL);
+            }
+        }
+        
+        display->display();
+    }
+    
+public:
+    TeubSpectrumVisualizationMPD(Display* left, Display* right, PlayerSource* player, FontManager* fm) 
+        : Visualization(left, right, player, fm) {}
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        float dt = clock.tick();
+        
+        drawSpectrum(left_display, frame.left_bands, peak_left, "SPECTEUB L", true, dt);
+        drawSpectrum(right_display, frame.right_bands, peak_right, "SPECTEUB R", false, dt);
+    }
+    
+    const char* getName() const override { return "Spectrum Analyzer"; }
+    uint32_t requiredFeatures() const override { return FEATURE_SPECTRUM; }
+};
+
+// Waveform visualization with player info
+class WaveformVisualizationMPD : public Visualization {
+private:
+    static constexpr int WAVE_SAMPLES = AnalysisFrame::WAVEFORM_SAMPLES;
+    
+    void drawWaveform(Display* display, const AnalysisFrame& frame, bool is_left) {
+        display->clear();
+        
+        // Draw title with player info on same line
+        drawTitleWithPlayer(display, is_left ? "WAVEFORM L" : "WAVEFORM R", 5, is_left);
+        
+        // Get waveform data
+        const float* samples = is_left ? frame.left_wave.data() : frame.right_wave.data();
+        
+        // Now we can use almost the full height!
+        int center_y = 37;  // Back to original center
+        int wave_height = 25; // Full height
+        
+        // Draw center line
+        display->drawLine(0, center_y, 127, center_y);
+        
+        // Draw waveform
+        for (int i = 0; i < WAVE_SAMPLES - 1; i++) {
+            int y1 = center_y - (int)(samples[i] * wave_height);
+            int y2 = center_y - (int)(samples[i + 1] * wave_height);
+            y1 = std::max(12, std::min(63, y1));
+            y2 = std::max(12, std::min(63, y2));
+            display->drawLine(i, y1, i + 1, y2);
+        }
+        
+        display->display();
+    }
+    
+public:
+    WaveformVisualizationMPD(Display* left, Display* right, PlayerSource* player, FontManager* fm) 
+        : Visualization(left, right, player, fm) {}
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        
+        drawWaveform(left_display, frame, true);
+        drawWaveform(right_display, frame, false);
+    }
+    
+    const char* getName() const override { return "Waveform"; }
+    uint32_t requiredFeatures() const override { return FEATURE_WAVEFORM; }
+};
+
+// Stereo field visualization with player info
+class StereoFieldVisualizationMPD : public Visualization {
+private:
+    static constexpr int HISTORY_SIZE = 64;
+    static constexpr int CENTER_X = 32;
+    static constexpr int CENTER_Y = 35;
+    static constexpr int BOX_SIZE = 23;
+    
+    // Phase history as plotted points, added once per analysis frame
+    std::array<int8_t, HISTORY_SIZE> history_x{};
+    std::array<int8_t, HISTORY_SIZE> history_y{};
+    int history_pos = 0;
+    uint64_t last_sequence = 0;
+    
+    void addHistoryPoint(float phase, float correlation) {
+        float angle = phase * M_PI;
+        float radius = (BOX_SIZE - 2) * (0.5f + correlation * 0.5f);
+        history_x[history_pos] = (int8_t)(radius * cosf(angle));
+        history_y[history_pos] = (int8_t)(radius * sinf(angle));
+        history_pos = (history_pos + 1) % HISTORY_SIZE;
+    }
+    
+    void drawStereoField(Display* display, const AnalysisFrame& frame, const char* title, bool is_left) {
+        display->clear();
+        
+        // Draw title with player info on same line
+        drawTitleWithPlayer(display, title, 5, is_left);
+        
+        float correlation = frame.correlation;
+        
+        // Full size phase meter!
+        display->drawRect(CENTER_X - BOX_SIZE, CENTER_Y - BOX_SIZE, BOX_SIZE * 2, BOX_SIZE * 2, false);
+        
+        // Draw phase history as dots
+        for (int i = 0; i < HISTORY_SIZE; i++) {
+            display->drawPixel(CENTER_X + history_x[i], CENTER_Y + history_y[i]);
+        }
+        
+        // Draw correlation meter on the right
+        int meter_x = 80;
+        display->drawRect(meter_x, 12, 20, 45, false);
+        int level = (int)(correlation * 22) + 22;
+        if (level > 0) {
+            display->drawRect(meter_x + 2, 57 - level, 16, level, true);
+        }
+        
+        display->drawText(meter_x +22, 31, "CORR:", FontManager::SMALL);
+        
+        // Show correlation value
+        char corr_text[8];
+        snprintf(corr_text, sizeof(corr_text), "%+.2f", correlation);
+        display->drawText(meter_x + 22, 38, corr_text, FontManager::SMALL);
+        
+        display->display();
+    }
+    
+public:
+    StereoFieldVisualizationMPD(Display* left, Display* right, PlayerSource* player, FontManager* fm) 
+        : Visualization(left, right, player, fm) {}
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        const AnalysisFrame& frame = audio.getFrame();
+        if (frame.sequence != last_sequence) {
+            last_sequence = frame.sequence;
+            addHistoryPoint(frame.phase, frame.correlation);
+        }
+        
+        drawStereoField(left_display, frame, "STEREO", true);
+        drawStereoField(right_display, frame, "PHASE", false);
+    }
+    
+    const char* getName() const override { return "Stereo Field"; }
+    uint32_t requiredFeatures() const override { return FEATURE_CORRELATION; }
+};
+
+// Player info: cover and position on the left, song details on the right
+class PlayerInfoVisualization : public Visualization {
+private:
+    static constexpr int INFO_X = 68;       // Left panel text column, right of the cover
+    static constexpr int BAR_WIDTH = 128 - INFO_X;
+    
+    std::shared_ptr<const AlbumArt> art;
+    std::shared_ptr<const PlaybackStatus> status;
+    std::shared_ptr<const TrackMetadata> track;
+    
+    // Left panel only changes once a second or so; remember what it shows
+    struct LeftKey {
+        uint64_t art_version;
+        uint64_t status_version;
+        int elapsed_second;
+        int bar_pixels;
+        bool operator==(const LeftKey& other) const {
+            return art_version == other.art_version && status_version == other.status_version &&
+                   elapsed_second == other.elapsed_second && bar_pixels == other.bar_pixels;
+        }
+    };
+    LeftKey left_shown;
+    bool left_valid;
+    
+    // Right panel details, re-rendered on metadata or status change
+    uint8_t details[1024];
+    uint64_t details_track_version;
+    uint64_t details_status_version;
+    
+    static void formatTime(float seconds, char* out, size_t size) {
+        int total = (int)seconds;
+        if (total >= 3600) {
+            snprintf(out, size, "%d:%02d:%02d", total / 3600, total / 60 % 60, total % 60);
+        } else {
+            snprintf(out, size, "%d:%02d", total / 60, total % 60);
+        }
+    }
+    
+    static const char* stateName(enum mpd_state state) {
+        switch (state) {
+            case MPD_STATE_PLAY: return "PLAYING";
+            case MPD_STATE_PAUSE: return "PAUSED";
+            case MPD_STATE_STOP: return "STOPPED";
+            default: return "";
+        }
+    }
+    
+    void refreshSnapshots() {
+        if (!art || art->version != player->getAlbumArtVersion()) art = player->getAlbumArt();
+        if (!status || status->version != player->getPlaybackVersion()) status = player->getPlayback();
+        if (!track || track->version != player->getMetadataVersion()) track = player->getMetadata();
+    }
+    
+    void drawCover(Display* display) {
+        if (art && art->present) {
+            for (int page = 0; page < 8; page++) {
+                memcpy(display->buffer + page * 128, art->bitmap.data() + page * AlbumArt::SIZE, AlbumArt::SIZE);
+            }
+        } else {
+            // No cover: a plain disc
+            display->drawCircle(31, 31, 30);
+            display->drawCircle(31, 31, 8);
+            display->drawPixel(31, 31);
+        }
+    }
+    
+    void drawLeft(Display* display) {
+        auto now = std::chrono::steady_clock::now();
+        float elapsed = status ? status->elapsedAt(now) : 0.0f;
+        float progress = status ? status->progressAt(now) : 0.0f;
+        LeftKey key = { art ? art->version : 0, status ? status->version : 0,
+                        (int)elapsed, (int)(std::min(progress, 1.0f) * (BAR_WIDTH - 2)) };
+        if (left_valid && key == left_shown) return;  // Nothing moved, skip the SPI push
+        left_shown = key;
+        left_valid = true;
+        
+        display->clear();
+        drawCover(display);
+        
+        if (status) {
+            char text[16];
+            display->drawText(INFO_X, 8, stateName(status->state), FontManager::SMALL);
+            formatTime(elapsed, text, sizeof(text));
+            display->drawText(INFO_X, 30, text, FontManager::LARGE);
+            if (status->duration_ms > 0) {
+                char total[16];
+                char line[sizeof(total) + 2];  // "/ " and the total
+                formatTime(status->duration_ms / 1000.0f, total, sizeof(total));
+                snprintf(line, sizeof(line), "/ %s", total);
+                display->drawText(INFO_X, 42, line, FontManager::SMALL);
+                
+                display->drawRect(INFO_X, 50, BAR_WIDTH, 5);
+                if (key.bar_pixels > 0) {
+                    display->drawRect(INFO_X + 1, 51, key.bar_pixels, 3, true);
+                }
+            }
+            if (status->volume >= 0) {
+                snprintf(text, sizeof(text), "VOL %d", status->volume);
+                display->drawText(INFO_X, 63, text, FontManager::SMALL);
+            }
+        }
+        
+        display->display();
+    }
+    
+    void renderDetails(Display* display) {
+        display->clear();
+        if (track) {
+            char text[64];
+            display->drawText(0, 20, track->artist.c_str(), FontManager::SMALL);
+            display->drawText(0, 32, track->album.c_str(), FontManager::SMALL);
+            if (!track->track_number.empty() || !track->year.empty()) {
+                snprintf(text, sizeof(text), "#%s  %s", track->track_number.c_str(), track->year.c_str());
+                display->drawText(0, 44, text, FontManager::SMALL);
+            }
+        }
+        if (status && status->sample_rate > 0) {
+            char text[48];
+            snprintf(text, sizeof(text), "%.1fk/%u/%uch %ukbps", status->sample_rate / 1000.0f,
+                     (unsigned)status->bits, (unsigned)status->channels, status->kbit_rate);
+            display->drawText(0, 63, text, FontManager::SMALL);
+        }
+        memcpy(details, display->buffer, sizeof(details));
+        details_track_version = track ? track->version : 0;
+        details_status_version = status ? status->version : 0;
+    }
+    
+    void drawRight(Display* display) {
+        if ((track ? track->version : 0) != details_track_version ||
+            (status ? status->version : 0) != details_status_version) {
+            renderDetails(display);
+        }
+        memcpy(display->buffer, details, sizeof(details));
+        drawTitleWithPlayer(display, "INFO", 5, false);
+        display->display();
+    }
+    
+public:
+    PlayerInfoVisualization(Display* left, Display* right, PlayerSource* player, FontManager* fm)
+        : Visualization(left, right, player, fm), left_valid(false),
+          details_track_version(~0ull), details_status_version(~0ull) {
+        memset(details, 0, sizeof(details));
+    }
+    
+    void activate() override {
+        left_valid = false;
+    }
+    
+    void render(ControlState& state, AudioProcessor& audio) override {
+        refreshSnapshots();
+        drawLeft(left_display);
+        drawRight(right_display);
+    }
+    
+    const char* getName() const override { return "Player Info"; }
+    uint32_t requiredFeatures() const override { return 0; }  // Player data only
+};
+
+// Control handler with sleep mode
+class ControlHandler {
+private:
+    ControlState& state;
+    AudioProcessor& audio;
+    PlayerSource* player;  // Transport controls on the Player Info view, may be null
+    uint8_t encoder1_state = 0;
+    uint8_t encoder2_state = 0;
+    int encoder1_steps = 0;  // Transitions since the encoder last rested
+    int encoder2_steps = 0;
+    bool btn2_turned = false;  // Encoder 2 moved while its button was held
+    
+    static constexpr float SEEK_STEP_SECONDS = 5.0f;
+    // Full-step encoders pass through 4 states per detent and rest with both
+    // pins pulled high (half-step ones would be 2, resting at 00 as well)
+    static constexpr int TRANSITIONS_PER_DETENT = 4;
+    static constexpr uint8_t ENCODER_REST = 0x3;
+    
+    // Player Info view with a player to control
+    bool transportMode() const {
+        return player && state.current_viz == PLAYER_INFO_VIEW && !state.is_sleeping;
+    }
+    static ControlHandler* instance;
+    
+    uint8_t readEncoder(int encoder) {
+        uint8_t clk = bcm2835_gpio_lev(encoder == 1 ? GPIO::ROT1_CLK : GPIO::ROT2_CLK);
+        uint8_t dt = bcm2835_gpio_lev(encoder == 1 ? GPIO::ROT1_DT : GPIO::ROT2_DT);
+        return (clk << 1) | dt;
+    }
+    
+    int getDirection(uint8_t old_state, uint8_t new_state) {
+        static const int transitions[16] = {
+            0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0
+        };
+        return transitions[(old_state << 2) | new_state];
+    }
+    
+    // Whole detents completed by this transition, for transport commands
+    // that must move once per click. Counted when the encoder comes back to
+    // rest; a missed transition still rounds to the click, a bounce to 0.
+    int completedDetents(int& steps, int dir, uint8_t new_state) {
+        steps += dir;
+        if (new_state != ENCODER_REST) return 0;
+        int half = TRANSITIONS_PER_DETENT / 2;
+        int detents = (steps + (steps < 0 ? -half : half)) / TRANSITIONS_PER_DETENT;
+        steps = 0;
+        return detents;
+    }
+    
+public:
+    ControlHandler(ControlState& st, AudioProcessor& ap, PlayerSource* player_source = nullptr)
+        : state(st), audio(ap), player(player_source) {
+        instance = this;
+        
+        // Setup GPIO
+        bcm2835_gpio_fsel(GPIO::POWER_LED, BCM2835_GPIO_FSEL_OUTP);
+        bcm2835_gpio_write(GPIO::POWER_LED, HIGH);
+        
+        uint8_t inputs[] = {
+            GPIO::ROT1_CLK, GPIO::ROT1_DT, GPIO::ROT1_SW,
+            GPIO::ROT2_CLK, GPIO::ROT2_DT, GPIO::ROT2_SW,
+            GPIO::POWER_SW
+        };
+        
+        for (uint8_t pin : inputs) {
+            bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_INPT);
+            bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_UP);
+        }
+        
+        encoder1_state = readEncoder(1);
+        encoder2_state = readEncoder(2);
+    }
+    
+    void poll() {
+        // Buttons - Fixed button reading
+        static bool btn1_last = true, btn2_last = true, pwr_last = true;
+        
+        // Encoder 1 - Sensitivity (Player Info: volume)
+        uint8_t new1 = readEncoder(1);
+        if (new1 != encoder1_state) {
+            int dir = getDirection(encoder1_state, new1);
+            if (transportMode()) {
+                int detents = completedDetents(encoder1_steps, dir, new1);
+                if (detents != 0) player->changeVolume(detents);
+            } else if (dir != 0) {
+                int val = audio.getSensitivity() + dir * 10;
+                audio.setSensitivity(std::max(10, std::min(300, val)));
+            }
+            encoder1_state = new1;
+        }
+        
+        // Encoder 2 - Noise reduction (Player Info: seek, or skip tracks with the button held)
+        uint8_t new2 = readEncoder(2);
+        if (new2 != encoder2_state) {
+            int dir = getDirection(encoder2_state, new2);
+            if (transportMode()) {
+                int detents = completedDetents(encoder2_steps, dir, new2);
+                if (dir != 0 && !btn2_last) btn2_turned = true;
+                if (detents != 0 && !btn2_last) {
+                    player->skipTracks(detents);
+                } else if (detents != 0) {
+                    player->seekBy(detents * SEEK_STEP_SECONDS);
+                }
+            } else if (dir != 0) {
+                int val = audio.getNoiseReduction() + dir * 5;
+                audio.setNoiseReduction(std::max(0, std::min(100, val)));
+            }
+            encoder2_state = new2;
+        }
+        
+        bool btn1 = bcm2835_gpio_lev(GPIO::ROT1_SW);
+        if (!btn1 && btn1_last) {
+            state.current_viz = (state.current_viz + 1) % VISUALIZATION_COUNT;
+            if (state.is_sleeping) {
+                state.is_sleeping = false;
+            }
+        }
+        btn1_last = btn1;
+        
+        bool btn2 = bcm2835_gpio_lev(GPIO::ROT2_SW);
+        if (transportMode()) {
+            // Player Info: a click without turning toggles pause
+            if (!btn2 && btn2_last) {
+                btn2_turned = false;
+            } else if (btn2 && !btn2_last && !btn2_turned) {
+                player->togglePause();
+            }
+        } else if (!btn2 && btn2_last) {
+            if (state.current_viz == VU_METER_VIEW && !state.is_sleeping) {
+                // VU meter: switch needle physics instead of resetting
+                int preset = audio.cycleNeedlePreset();
+                printf("Needle physics: %s\n", NeedleModel::PRESETS[preset].name);
+            } else {
+                audio.setSensitivity(100);
+                audio.setNoiseReduction(77);
+            }
+            if (state.is_sleeping) {
+                state.is_sleeping = false;
+            }
+        }
+        btn2_last = btn2;
+        
+        bool pwr = bcm2835_gpio_lev(GPIO::POWER_SW);
+        if (!pwr && pwr_last) {
+            state.running = false;
+        }
+        pwr_last = pwr;
+    }
+    
+    void setPowerLED(bool on) {
+        bcm2835_gpio_write(GPIO::POWER_LED, on ? HIGH : LOW);
+    }
+};
+
+ControlHandler* ControlHandler::instance = nullptr;
+
+// Startup configuration (command line)
+struct AppConfig {
+    BandEngine band_engine = BandEngine::FFT;
+    int workers = 2;  // Analysis threads including the capture thread
+    FFTKind fft_kind = DEFAULT_FFT;
+    int fps = 100;    // Render rate cap; meter ballistics do not depend on it
+    std::vector<std::string> players = { "mpd", "mpris", "shairport" };  // Metadata sources
+    std::string shairport_pipe = "/tmp/shairport-sync-metadata";
+    std::string mpd_fifo;  // PCM from MPD's fifo output instead of ALSA when set
+    PCMFormat mpd_fifo_format;
+};
+
+// Main application with sleep mode and player support
+class VisualizerApp {
+private:
+    Display* left_display;
+    Display* right_display;
+    AudioProcessor audio;
+    ControlState state;
+    ControlHandler* controls;
+    Visualization* visualizations[VISUALIZATION_COUNT];
+    FontManager font_manager;
+    TitleRasterizer title_rasterizer;
+    PlayerArbiter* players;
+    std::chrono::microseconds frame_period;
+    
+    static constexpr int CONTROL_POLL_MS = 10;  // Encoders need polling faster than any frame rate
+    
+    // Wait for the next frame slot, polling the controls meanwhile
+    void waitForFrame(std::chrono::steady_clock::time_point& next_frame) {
+        auto now = std::chrono::steady_clock::now();
+        next_frame += frame_period;
+        if (next_frame < now) {
+            next_frame = now;  // Running behind: don't try to catch up
+        }
+        while (now < next_frame) {
+            auto slice = std::min<std::chrono::steady_clock::duration>(next_frame - now,
+                                                                      std::chrono::milliseconds(CONTROL_POLL_MS));
+            std::this_thread::sleep_for(slice);
+            now = std::chrono::steady_clock::now();
+            if (now < next_frame) {
+                controls->poll();
+            }
+        }
+    }
+    
+    void setSPISpeedSlow() {
+    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_256);  // Slower for sleep
+    }
+    
+    void setSPISpeedNormal() {
+        bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);   // Normal speed
+    }
+    
+public:
+    VisualizerApp(const AppConfig& config) : left_display(nullptr), right_display(nullptr), 
+                      controls(nullptr), players(nullptr),
+                      frame_period(1000000 / config.fps) {
+        
+        // Initialize BCM2835
+        if (!bcm2835_init()) {
+            printf("Failed to init BCM2835\n");
+            exit(1);
+        }
+        
+        if (!bcm2835_spi_begin()) {
+            printf("Failed to init SPI\n");
+            bcm2835_close();
+            exit(1);
+        }
+        
+        bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
+        bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
+        bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);
+        
+        // Initialize displays
+        left_display = new Display(GPIO::LEFT_CS, GPIO::LEFT_DC, GPIO::LEFT_RST);
+        right_display = new Display(GPIO::RIGHT_CS, GPIO::RIGHT_DC, GPIO::RIGHT_RST);
+        
+        if (!left_display->begin() || !right_display->begin()) {
+            printf("Failed to init displays\n");
+            exit(1);
+        }
+        
+        // Initialize font manager
+        const char* font_paths[] = {
+            "./trixel-square.ttf",
+            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+            "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
+            nullptr
+        };
+        
+        bool font_loaded = false;
+        for (int i = 0; font_paths[i] && !font_loaded; i++) {
+            if (font_manager.init(font_paths[i])) {
+                font_loaded = true;
+                left_display->setFont(&font_manager);
+                right_display->setFont(&font_manager);
+                printf("Using TTF font: %s\n", font_paths[i]);
+                if (!title_rasterizer.start(font_paths[i])) {
+                    printf("Title rasterizer unavailable, titles render on the display thread\n");
+                }
+            }
+        }
         
-        // Update based on state
-        switch (scroll_state) {
-            case PAUSED_AT_START:
-                pause_counter -= elapsed_ms;
-                if (pause_counter <= 0) {
-                    scroll_state = SCROLLING;
-                    pause_counter = 0;
+        if (!font_loaded) {
+            printf("WARNING: No TTF font found. Text will not be displayed.\n");
+            printf("Please install fonts or place a .ttf file in current directory.\n");
+        }
+        
+        audio.setBandEngine(config.band_engine);
+        printf("Band engine: %s\n", bandEngineName(config.band_engine));
+        audio.setWorkers(config.workers);
+        audio.setFFTKind(config.fft_kind);
+        printf("FFT backend: %s\n", fftKindName(config.fft_kind));
+        printf("Analysis workers: %d\n", audio.getWorkers());
+        if (!config.mpd_fifo.empty()) {
+            audio.setFifoSource(config.mpd_fifo, config.mpd_fifo_format);
+        }
+        
+        // Initialize players; the arbiter shows whichever started playing last
+        if (!config.players.empty()) {
+            printf("Initializing players...\n");
+            players = new PlayerArbiter();
+            auto enabled = [&config](const char* name) {
+                return std::find(config.players.begin(), config.players.end(), name) != config.players.end();
+            };
+            if (enabled("mpd")) {
+                players->addSource(std::unique_ptr<PlayerSource>(new MPDClient("localhost", 6600)));
+            }
+#ifndef AAV_NO_MPRIS
+            if (enabled("mpris")) {
+                // MPRIS bridges of players we read directly would show up twice
+                std::vector<std::string> ignored;
+                if (enabled("mpd")) ignored.push_back("mpd");
+                if (enabled("shairport")) ignored.push_back("ShairportSync");
+                players->addSource(std::unique_ptr<PlayerSource>(new MPRISSource(ignored)));
+            }
+#endif
+            if (enabled("shairport")) {
+                players->addSource(std::unique_ptr<PlayerSource>(new ShairportSource(config.shairport_pipe)));
+            }
+            players->start();
+        }
+        
+        // Create visualizations - all with player info except VU Meter
+        visualizations[0] = new VUMeterVisualization(left_display, right_display);
+        visualizations[1] = new SpectrumVisualizationMPD(left_display, right_display, 
+                                                        players, &font_manager);
+        visualizations[2] = new EmptySpectrumVisualizationMPD(left_display, right_display, 
+                                                        players, &font_manager);
+        visualizations[3] = new TeubSpectrumVisualizationMPD(left_display, right_display, 
+                                                        players, &font_manager);
+        visualizations[4] = new WaveformVisualizationMPD(left_display, right_display,
+                                                        players, &font_manager);
+        visualizations[5] = new StereoFieldVisualizationMPD(left_display, right_display,
+                                                            players, &font_manager);
+        visualizations[6] = new PlayerInfoVisualization(left_display, right_display,
+                                                        players, &font_manager);
+        
+        for (Visualization* viz : visualizations) {
+            viz->setTitleRasterizer(&title_rasterizer);
+        }
+        
+        audio.setFeatures(visualizations[0]->requiredFeatures());
+        
+        // Initialize controls last
+        controls = new ControlHandler(state, audio, players);
+        
+        printf("Initialization complete\n");
+    }
+    
+    ~VisualizerApp() {
+        printf("Shutting down...\n");
+        
+        // Clean up in reverse order
+        if (controls) delete controls;
+        if (players) {
+            players->stop();
+            delete players;
+        }
+        
+        for (int i = 0; i < VISUALIZATION_COUNT; i++) {
+            if (visualizations[i]) delete visualizations[i];
+        }
+        
+        if (left_display) delete left_display;
+        if (right_display) delete right_display;
+        
+        bcm2835_spi_end();
+        bcm2835_close();
+    }
+    
+void run() {
+    printf("Dual OLED Audio Visualizer with MPD Support\n");
+    printf("===========================================\n");
+    printf("Rotary 1: Sensitivity | Rotary 2: Smoothing\n");
+    printf("Press Rotary 1 to switch visualization\n");
+    printf("Press Rotary 2 to reset settings\n");
+    printf("Power button to exit\n");
+    printf("Sleep mode after 10 seconds of silence\n\n");
+    
+    if (!audio.start()) {
+        if (audio.usesFifo()) {
+            printf("Failed to open the MPD fifo.\n");
+        } else {
+            printf("Failed to init audio. Make sure ALSA is configured properly.\n");
+            printf("Try: sudo modprobe snd-aloop, or read MPD directly with --mpd-fifo=PATH\n");
+        }
+        return;
+    }
+    
+    int current_viz = 0;
+    auto next_frame = std::chrono::steady_clock::now();
+    
+    while (state.running) {
+        controls->poll();
+        
+        // Check for audio and handle sleep mode
+        bool has_audio = audio.checkForAudio();
+        
+        if (!has_audio && !state.is_sleeping) {
+            // Enter sleep mode
+            printf("Entering sleep mode - no audio detected\n");
+            state.is_sleeping = true;
+            
+            // Notify audio processor about sleep state
+            audio.setSleepState(true);
+            
+            // Notify players about sleep state
+            if (players) {
+                players->setSleepState(true);
+            }
+            
+            // Just turn off displays and LED
+            left_display->sleep();
+            right_display->sleep();
+            controls->setPowerLED(false);
+            
+            // Reduce SPI speed for lower power consumption
+            setSPISpeedSlow();
+
+            
+        } else if (has_audio && state.is_sleeping) {
+            // Wake up
+            printf("Waking up - audio detected\n");
+            state.is_sleeping = false;
+            
+            // Restore normal SPI speed
+            setSPISpeedNormal();
+            
+            // Notify audio processor about wake state
+            audio.setSleepState(false);
+            
+            // Notify players about wake state
+            if (players) {
+                players->setSleepState(false);
+            }
+            
+            left_display->wake();
+            right_display->wake();
+            controls->setPowerLED(true);
+            
+            // Clear and redraw
+            left_display->clear();
+            right_display->clear();
+            left_display->display();
+            right_display->display();
+            visualizations[current_viz]->activate();
+        }
+        
+        // Handle visualization switching
+        if (state.current_viz != current_viz) {
+            current_viz = state.current_viz;
+            printf("Switched to: %s\n", visualizations[current_viz]->getName());
+            audio.setFeatures(visualizations[current_viz]->requiredFeatures());
+            
+            // Clear displays on switch
+            left_display->clear();
+            right_display->clear();
+            left_display->display();
+            right_display->display();
+            visualizations[current_viz]->activate();
+            
+            // Wake if sleeping
+            if (state.is_sleeping) {
+                state.is_sleeping = false;
+
+                // Restore normal SPI speed
+                setSPISpeedNormal();  
+
+                // Notify audio processor about wake state
+                audio.setSleepState(false); 
+
+                // Notify players about wake state
+                if (players) {
+                    players->setSleepState(false);
                 }
-                break;
                 
-            case SCROLLING:
-                // Smooth pixel-based scrolling
-                scroll_position += (SCROLL_SPEED_PIXELS_PER_SECOND * elapsed_ms) / 1000.0f;
+                left_display->wake();
+                right_display->wake();
+                controls->setPowerLED(true);
+            }
+        }
+        
+        // Render visualization if not sleeping
+        if (!state.is_sleeping) {
+            visualizations[current_viz]->render(state, audio);
+            waitForFrame(next_frame);
+        } else {
+            // During sleep, just poll controls occasionally
+            static int sleep_counter = 0;
+            if (++sleep_counter >= 10) {  // Check controls every second
+                controls->poll();
+                sleep_counter = 0;
+            }
+            bcm2835_delay(100);  // Sleep for 100ms
+        }
+            }
+            
+            printf("\nShutting down...\n");
+            audio.stop();
+            controls->setPowerLED(false);
+            left_display->clear();
+            right_display->clear();
+            left_display->display();
+            right_display->display();
+        }
+};
+
+// Offline DSP benchmarks: run with --bench, no display or audio hardware needed
+class Benchmark {
+private:
+    static constexpr int SAMPLE_RATE = 44100;
+    static constexpr int HOP = 512;
+    
+    // Deterministic white noise so runs are comparable
+    struct Noise {
+        uint32_t state = 0x12345678;
+        float next() {
+            state = state * 1664525u + 1013904223u;
+            return (int32_t)state / 2147483648.0f;
+        }
+    };
+    
+    static void fillTone(std::vector<int16_t>& pcm, float freq, float amplitude) {
+        for (size_t i = 0; i < pcm.size() / 2; i++) {
+            int16_t v = (int16_t)(amplitude * 32767.0f * sinf(2.0f * M_PI * freq * i / SAMPLE_RATE));
+            pcm[i * 2] = v;
+            pcm[i * 2 + 1] = v;
+        }
+    }
+    
+    static void fillNoise(std::vector<int16_t>& pcm, float amplitude) {
+        Noise noise;
+        for (size_t i = 0; i < pcm.size(); i++) {
+            pcm[i] = (int16_t)(amplitude * 32767.0f * noise.next());
+        }
+    }
+    
+    // Feed the whole buffer hop by hop, returns microseconds per hop
+    static double feed(AudioProcessor& audio, const std::vector<int16_t>& pcm) {
+        int hops = (int)(pcm.size() / 2 / HOP);
+        auto start = std::chrono::steady_clock::now();
+        for (int h = 0; h < hops; h++) {
+            audio.processBlock(pcm.data() + h * HOP * 2, HOP);
+        }
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::micro>(end - start).count() / hops;
+    }
+    
+    static void prepare(AudioProcessor& audio, BandEngine engine, int sensitivity = 10) {
+        audio.setBandEngine(engine);
+        audio.setSensitivity(sensitivity);  // Keep test levels below clipping
+        audio.setNoiseReduction(0);         // No smoothing, raw band levels
+    }
+    
+    // Band kernel against the scalar loop it replaced, on a synthetic spectrum
+    static void benchBandKernel() {
+        const int size = 2048;
+        const int stride = size / 2 + 2;
+        const int iterations = 20000;
+        
+        std::vector<float> spectrum(stride * 4);
+        Noise noise;
+        for (float& v : spectrum) v = noise.next();
+        const float* left = spectrum.data();
+        const float* right = spectrum.data() + stride * 2;
+        
+        BandEnergyKernel kernel;
+        std::vector<float> low(BAND_COUNT), high(BAND_COUNT);
+        for (int i = 0; i < BAND_COUNT; i++) {
+            low[i] = (float)Bands::TABLE.low[i] * size / SAMPLE_RATE;
+            high[i] = std::min((float)(size / 2), (float)Bands::TABLE.high[i] * size / SAMPLE_RATE);
+            kernel.addBand(i, low[i], high[i], 1.0f);
+        }
+        
+        std::array<float, BAND_COUNT> kernel_left{}, kernel_right{}, scalar_left{}, scalar_right{};
+        volatile float sink = 0.0f;
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            kernel.run(left, right, kernel_left.data(), kernel_right.data());
+            sink = sink + kernel_left[0];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double kernel_ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        
+        // Previous path: integer bin ranges, magnitude then squared, one channel at a time
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            for (int ch = 0; ch < 2; ch++) {
+                const float* spec = ch == 0 ? left : right;
+                float* out = ch == 0 ? scalar_left.data() : scalar_right.data();
+                for (int i = 0; i < BAND_COUNT; i++) {
+                    int low_idx = (int)low[i];
+                    int high_idx = std::max((int)high[i], low_idx + 1);
+                    float sum = 0.0f;
+                    for (int k = low_idx; k < high_idx; k++) {
+                        float mag = sqrtf(spec[k * 2] * spec[k * 2] + spec[k * 2 + 1] * spec[k * 2 + 1]);
+                        sum += mag * mag;
+                    }
+                    out[i] = sum / (high_idx - low_idx);
+                }
+            }
+            sink = sink + scalar_left[0];
+        }
+        end = std::chrono::steady_clock::now();
+        double scalar_ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+        
+        // Accuracy: same weights summed in double precision
+        double max_error = 0.0;
+        for (int i = 0; i < BAND_COUNT; i++) {
+            for (int ch = 0; ch < 2; ch++) {
+                const float* spec = ch == 0 ? left : right;
+                double sum = 0.0, weight_sum = 0.0;
+                for (int k = 0; k <= size / 2; k++) {
+                    double w = std::min(k + 0.5, (double)high[i]) - std::max(k - 0.5, (double)low[i]);
+                    w = std::max(0.0, std::min(1.0, w));
+                    sum += w * ((double)spec[k * 2] * spec[k * 2] + (double)spec[k * 2 + 1] * spec[k * 2 + 1]);
+                    weight_sum += w;
+                }
+                if (weight_sum <= 0.0) continue;
+                double got = ch == 0 ? kernel_left[i] : kernel_right[i];
+                max_error = std::max(max_error, fabs(got - sum / weight_sum) / (sum / weight_sum));
+            }
+        }
+        
+        printf("Band energy kernel (%d-point spectrum, stereo, %d bands)\n", size, BAND_COUNT);
+        printf("  scalar     %8.1f ns/call\n", scalar_ns);
+        printf("  kernel     %8.1f ns/call  %.2fx  max rel error %.2e\n\n",
+               kernel_ns, scalar_ns / kernel_ns, max_error);
+    }
+    
+    // VU/PPM ballistics: step to a 0 VU sine, then silence
+    static void benchLevelMeter() {
+        printf("Level meter (1 kHz sine at 0 VU, then silence)\n");
+        printf("  %8s %8s %8s\n", "ms", "vu dB", "ppm dB");
+        
+        AudioProcessor audio;
+        prepare(audio, BandEngine::GOERTZEL, 100);
+        const float amplitude = powf(10.0f, -18.0f / 20.0f) * sqrtf(2.0f);
+        std::vector<int16_t> tone(HOP * 2), silence(HOP * 2, 0);
+        
+        const int report[] = { 1, 5, 13, 26, 52, 78, 104, 130, 182 };
+        int next = 0;
+        for (int hop = 1; hop <= 182; hop++) {
+            if (hop <= 52) {
+                for (int i = 0; i < HOP; i++) {
+                    int n = (hop - 1) * HOP + i;
+                    tone[i * 2] = tone[i * 2 + 1] = (int16_t)(amplitude * 32767.0f * sinf(2.0f * M_PI * 1000.0f * n / SAMPLE_RATE));
+                }
+                audio.processBlock(tone.data(), HOP);
+            } else {
+                audio.processBlock(silence.data(), HOP);
+            }
+            if (hop == report[next]) {
+                const AnalysisFrame& frame = audio.getFrame();
+                printf("  %8.0f %+8.2f %+8.2f\n", hop * HOP * 1000.0f / SAMPLE_RATE, frame.left_vu, frame.left_ppm);
+                next++;
+            }
+        }
+        printf("\n");
+    }
+    
+    // Vectorized atan2 against libm, and correlation of known signals
+    static void benchStereo() {
+        const int count = 4096;
+        const int iterations = 2000;
+        std::vector<float> ys(count), xs(count), out(count);
+        Noise noise;
+        for (int i = 0; i < count; i++) {
+            ys[i] = noise.next();
+            xs[i] = noise.next();
+        }
+        
+        volatile float sink = 0.0f;
+        auto start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            for (int i = 0; i < count; i++) out[i] = atan2f(ys[i], xs[i]);
+            sink = sink + out[n % count];
+        }
+        auto end = std::chrono::steady_clock::now();
+        double libm_ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations / count;
+        
+        start = std::chrono::steady_clock::now();
+        for (int n = 0; n < iterations; n++) {
+            for (int i = 0; i < count; i += 4) {
+                float4 y, x;
+                memcpy(&y, &ys[i], sizeof(y));
+                memcpy(&x, &xs[i], sizeof(x));
+                float4 r = StereoMeter::fastAtan2(y, x);
+                memcpy(&out[i], &r, sizeof(r));
+            }
+            sink = sink + out[n % count];
+        }
+        end = std::chrono::steady_clock::now();
+        double fast_ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations / count;
+        
+        float max_error = 0.0f;
+        for (int i = 0; i < count; i++) {
+            max_error = std::max(max_error, std::abs(out[i] - atan2f(ys[i], xs[i])));
+        }
+        
+        printf("Stereo analysis\n");
+        printf("  atan2f     %8.2f ns/sample\n", libm_ns);
+        printf("  fastAtan2  %8.2f ns/sample  %.2fx  max error %.1e rad\n", fast_ns, libm_ns / fast_ns, max_error);
+        
+        // Correlation should read +1 for identical channels, -1 inverted, ~0 unrelated;
+        // band coherence 1, 1, ~0 and balance 0 except for the left-only signal
+        const char* names[] = { "same", "inverted", "unrelated", "left only" };
+        for (int mode = 0; mode < 4; mode++) {
+            std::vector<int16_t> pcm(SAMPLE_RATE / 2 * 2);
+            Noise left, right;
+            right.state = 0x9e3779b9;
+            for (size_t i = 0; i < pcm.size() / 2; i++) {
+                float l = 0.3f * left.next();
+                float r = mode == 0 ? l : mode == 1 ? -l : mode == 2 ? 0.3f * right.next() : 0.0f;
+                pcm[i * 2] = (int16_t)(l * 32767.0f);
+                pcm[i * 2 + 1] = (int16_t)(r * 32767.0f);
+            }
+            AudioProcessor audio;
+            prepare(audio, BandEngine::FFT);
+            feed(audio, pcm);
+            const AnalysisFrame& frame = audio.getFrame();
+            float coherence = 0.0f, balance = 0.0f;
+            for (int i = 0; i < BAND_COUNT; i++) {
+                coherence += frame.band_coherence[i] / BAND_COUNT;
+                balance += frame.band_balance[i] / BAND_COUNT;
+            }
+            printf("  %-10s correlation %+5.2f  phase %+5.2f  band coherence %4.2f  balance %+5.2f\n",
+                   names[mode], frame.correlation, frame.phase, coherence, balance);
+        }
+        printf("\n");
+    }
+    
+    // Per-hop cost of each visualization's feature set, and onset detection on a click track
+    static void benchAnalysisGraph() {
+        struct FeatureSet { const char* name; uint32_t features; };
+        const FeatureSet sets[] = {
+            { "all", FEATURE_ALL },
+            { "spectrum", FEATURE_SPECTRUM },
+            { "vu", FEATURE_LEVELS },
+            { "waveform", FEATURE_WAVEFORM },
+            { "stereo", FEATURE_CORRELATION },
+        };
+        
+        printf("Analysis graph (fft engine, white noise)\n");
+        std::vector<int16_t> pcm(SAMPLE_RATE * 2 * 2);
+        fillNoise(pcm, 0.3f);
+        for (const FeatureSet& set : sets) {
+            AudioProcessor audio;
+            prepare(audio, BandEngine::FFT);
+            audio.setFeatures(set.features);
+            printf("  %-10s %8.1f us/hop\n", set.name, feed(audio, pcm));
+        }
+        
+        // 10 ms noise bursts every 500 ms over a quiet noise floor
+        const int clicks = 8;
+        const int spacing = SAMPLE_RATE / 2;
+        std::vector<int16_t> track(clicks * spacing * 2);
+        fillNoise(track, 0.01f);
+        for (int c = 0; c < clicks; c++) {
+            for (int i = 0; i < SAMPLE_RATE / 100; i++) {
+                size_t n = (size_t)(c * spacing + spacing / 2 + i) * 2;
+                track[n] = (int16_t)(track[n] * 50);
+                track[n + 1] = (int16_t)(track[n + 1] * 50);
+            }
+        }
+        
+        AudioProcessor audio;
+        prepare(audio, BandEngine::FFT);
+        audio.setFeatures(FEATURE_ONSET);
+        int detected = 0;
+        bool previous = false;
+        for (size_t h = 0; h + HOP <= track.size() / 2; h += HOP) {
+            audio.processBlock(track.data() + h * 2, HOP);
+            bool onset = audio.getFrame().onset;
+            if (onset && !previous) detected++;
+            previous = onset;
+        }
+        printf("  onsets     %d detected of %d clicks\n\n", detected, clicks);
+    }
+    
+    // Spectrum cost per hop as the FFT work spreads over more threads
+    static void benchWorkers() {
+        int cores = std::max(1u, std::thread::hardware_concurrency());
+        printf("Analysis workers (fft engine, spectrum, %d cores online)\n", cores);
+        std::vector<int16_t> pcm(SAMPLE_RATE * 2 * 2);
+        fillNoise(pcm, 0.3f);
+        
+        double single = 0.0;
+        for (int workers = 1; workers <= std::max(4, cores); workers++) {
+            AudioProcessor audio;
+            audio.setWorkers(workers);
+            prepare(audio, BandEngine::FFT);
+            audio.setFeatures(FEATURE_SPECTRUM);
+            double us = feed(audio, pcm);
+            if (workers == 1) single = us;
+            printf("  %d worker%s  %8.1f us/hop  %.2fx\n", workers, workers == 1 ? " " : "s", us, single / us);
+        }
+        printf("\n");
+    }
+    
+    // FFT backends against a double-precision DFT, and their speed
+    static void benchFFT() {
+        std::vector<FFTKind> kinds;
+#ifndef AAV_NO_FFTW
+        kinds.push_back(FFTKind::FFTW);
+#endif
+        kinds.push_back(FFTKind::Q15);
+        
+        printf("FFT backends (Hann windowed input, SNR against double-precision DFT)\n");
+        printf("  %-6s %6s %12s %12s %12s\n", "fft", "size", "ns/call", "noise SNR", "-40dB SNR");
+        for (int size : { 512, 1024, 2048 }) {
+            std::vector<double> cos_table(size), sin_table(size);
+            for (int i = 0; i < size; i++) {
+                cos_table[i] = cos(2.0 * M_PI * i / size);
+                sin_table[i] = -sin(2.0 * M_PI * i / size);
+            }
+            
+            // Two test inputs: loud white noise and a quiet tone
+            float* inputs[2];
+            std::vector<double> reference[2];
+            Noise noise;
+            for (int t = 0; t < 2; t++) {
+                inputs[t] = allocFloats(size);
+                for (int i = 0; i < size; i++) {
+                    float window = 0.5f * (1.0f - cosf(2.0f * M_PI * i / (size - 1)));
+                    float v = t == 0 ? 0.5f * noise.next() : 0.01f * sinf(2.0f * M_PI * 1000.0f * i / SAMPLE_RATE);
+                    inputs[t][i] = v * window;
+                }
+                reference[t].assign(size + 2, 0.0);
+                for (int k = 0; k <= size / 2; k++) {
+                    for (int i = 0; i < size; i++) {
+                        int idx = (int)(((long)k * i) % size);
+                        reference[t][2 * k] += inputs[t][i] * cos_table[idx];
+                        reference[t][2 * k + 1] += inputs[t][i] * sin_table[idx];
+                    }
+                }
+            }
+            
+            for (FFTKind kind : kinds) {
+                float* in = allocFloats(size);
+                float* out = allocFloats(size + 2);
+                std::unique_ptr<FFTBackend> fft = createFFT(kind, size, in, out);
                 
-                // Check if we've scrolled the full text + gap
-                if (scroll_position >= text_width_pixels + SCROLL_GAP_PIXELS) {
-                    scroll_position = 0.0f;
-                    scroll_state = PAUSED_AT_START;
-                    pause_counter = SCROLL_PAUSE_MS;
+                double snr[2];
+                for (int t = 0; t < 2; t++) {
+                    memcpy(in, inputs[t], size * sizeof(float));
+                    fft->forward(in, out);
+                    double signal = 0.0, error = 0.0;
+                    for (int i = 0; i < size + 2; i++) {
+                        signal += reference[t][i] * reference[t][i];
+                        error += (out[i] - reference[t][i]) * (out[i] - reference[t][i]);
+                    }
+                    snr[t] = 10.0 * log10(signal / std::max(error, 1e-30));
                 }
-                break;
                 
-            case PAUSED_AT_END:
-                // Not used in continuous loop, but could be added for ping-pong scrolling
-                break;
+                const int iterations = 200000 / size;
+                memcpy(in, inputs[0], size * sizeof(float));
+                auto start = std::chrono::steady_clock::now();
+                for (int n = 0; n < iterations; n++) {
+                    fft->forward(in, out);
+                }
+                auto end = std::chrono::steady_clock::now();
+                double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+                
+                printf("  %-6s %6d %12.0f %9.1f dB %9.1f dB\n", fftKindName(kind), size, ns, snr[0], snr[1]);
+                fft.reset();
+                free(in);
+                free(out);
+            }
+            free(inputs[0]);
+            free(inputs[1]);
         }
-        
-        // Create the visible portion of text
-        // We need to handle partial character rendering at the edges
-        return createVisibleText(max_width, font_manager, font_size);
-    }
-    
-    void reset() {
-        scroll_position = 0.0f;
-        scroll_state = PAUSED_AT_START;
-        pause_counter = SCROLL_PAUSE_MS;
-        last_scroll_time = std::chrono::steady_clock::now();
+        printf("\n");
     }
     
-private:
-    std::string createVisibleText(int max_width, FontManager* font_manager, 
-                                 FontManager::FontSize font_size) {
-        // For smooth scrolling, we need to determine which characters are visible
-        // based on the current scroll position
-        
-        int current_pixel = 0;
-        int start_char = -1;
-        int end_char = -1;
-        
-        // Find the first visible character
-        for (size_t i = 0; i < current_text.length(); i++) {
-            int char_width = font_manager->getTextWidth(current_text.substr(i, 1).c_str(), font_size);
-            
-            if (current_pixel + char_width > scroll_position && start_char == -1) {
-                start_char = i;
+    // Spectrum smoothing should follow the same curve whatever the hop size
+    static void benchBallistics() {
+        const int hops[] = { 256, 512, 1024 };
+        const int report_frames[] = { 0, 2048, 4096, 8192, 16384 };  // Multiples of every hop
+        const int band = BAND_COUNT / 2;
+        
+        printf("Spectrum ballistics (tone off at 0 ms, band %d level, noise reduction 77)\n", band);
+        printf("  %6s", "hop");
+        for (int frames : report_frames) printf(" %6dms", frames * 1000 / SAMPLE_RATE);
+        printf("\n");
+        
+        float centre = sqrtf((float)Bands::TABLE.low[band] * Bands::TABLE.high[band]);
+        std::vector<int16_t> tone(SAMPLE_RATE * 2);
+        fillTone(tone, centre, 0.5f);
+        std::vector<int16_t> silence(SAMPLE_RATE * 2, 0);
+        
+        for (int hop : hops) {
+            AudioProcessor audio;
+            prepare(audio, BandEngine::GOERTZEL);
+            audio.setNoiseReduction(77);
+            audio.setFeatures(FEATURE_SPECTRUM);
+            for (size_t i = 0; i + hop <= tone.size() / 2; i += hop) {
+                audio.processBlock(tone.data() + i * 2, hop);
             }
             
-            current_pixel += char_width;
-            
-            if (current_pixel > scroll_position + max_width) {
-                end_char = i;
-                break;
+            printf("  %6d", hop);
+            int elapsed = 0;
+            for (int target : report_frames) {
+                for (; elapsed < target; elapsed += hop) {
+                    audio.processBlock(silence.data(), hop);
+                }
+                printf(" %8d", audio.getFrame().left_bands[band]);
             }
+            printf("\n");
         }
-        
-        if (start_char == -1) start_char = 0;
-        if (end_char == -1) end_char = current_text.length();
-        
-        // Extract visible portion
-        std::string visible = current_text.substr(start_char, end_char - start_char);
-        
-        // If we need more text to fill the width, add from the beginning (seamless loop)
-        int visible_width = font_manager->getTextWidth(visible.c_str(), font_size);
-        if (visible_width < max_width && scroll_position > 0) {
-            // Add gap
-            std::string gap(SCROLL_GAP_PIXELS / 6, ' ');  // Approximate space width
-            visible += gap;
+        printf("\n");
+    }
+    
+    // Needle step response per physics preset, from rest to a 0 VU tone
+    static void benchNeedle() {
+        const int report_ms[] = { 46, 93, 186, 302, 604 };
+        const float rest = NeedleModel::scalePosition(0.0f);
+        
+        printf("VU needle (step to 0 VU, position as %% of the 0 VU deflection)\n");
+        printf("  %-8s", "preset");
+        for (int ms : report_ms) printf(" %6dms", ms);
+        printf(" %9s\n", "overshoot");
+        
+        const float amplitude = powf(10.0f, -18.0f / 20.0f) * sqrtf(2.0f);
+        std::vector<int16_t> tone(SAMPLE_RATE * 2);
+        fillTone(tone, 1000.0f, amplitude);
+        
+        for (int p = 0; p < NeedleModel::PRESET_COUNT; p++) {
+            AudioProcessor audio;
+            prepare(audio, BandEngine::GOERTZEL, 100);
+            audio.setFeatures(FEATURE_NEEDLE);
+            audio.setNeedlePreset(p);
             
-            // Add beginning of text to create seamless loop
-            int remaining_width = max_width - font_manager->getTextWidth(visible.c_str(), font_size);
-            for (size_t i = 0; i < current_text.length() && remaining_width > 0; i++) {
-                visible += current_text[i];
-                remaining_width -= font_manager->getTextWidth(current_text.substr(i, 1).c_str(), font_size);
+            printf("  %-8s", NeedleModel::PRESETS[p].name);
+            float peak = 0.0f;
+            int next = 0;
+            for (int hop = 1; hop * HOP <= SAMPLE_RATE; hop++) {
+                audio.processBlock(tone.data() + (hop - 1) * HOP * 2, HOP);
+                float position = audio.getFrame().left_needle;
+                peak = std::max(peak, position);
+                int ms = hop * HOP * 1000 / SAMPLE_RATE;
+                if (next < 5 && ms >= report_ms[next]) {
+                    printf(" %7.1f%%", position / rest * 100.0f);
+                    next++;
+                }
             }
+            printf(" %8.1f%%\n", (peak / rest - 1.0f) * 100.0f);
         }
         
-        return visible;
+        // Integration cost
+        NeedleModel model;
+        const int steps = 1000000;
+        auto start = std::chrono::steady_clock::now();
+        model.advance(0.5f, steps * NeedleModel::STEP, NeedleModel::PRESETS[1]);
+        auto end = std::chrono::steady_clock::now();
+        volatile float sink = model.position();
+        (void)sink;
+        printf("  step cost %.1f ns\n\n", std::chrono::duration<double, std::nano>(end - start).count() / steps);
     }
-};
-
-// Unified visualization class with optional MPD support
-class Visualization {
-protected:
-    Display* left_display;
-    Display* right_display;
-    MPDClient* mpd_client;
-    FontManager* font_manager;
-    TextScroller title_scroller_left;
-    TextScroller title_scroller_right;
     
-    // Helper to draw title with optional smooth scrolling MPD info
-    void drawTitleWithMPD(Display* display, const char* viz_name, int y_offset = 0, bool is_left = true) {
-        // Always draw visualization name
-        display->drawText(0, y_offset, viz_name, FontManager::SMALL);
-        
-        // Early return if no MPD support
-        if (!mpd_client || !font_manager) {
-            return;
+    // Table-driven needle against the two Bresenham lines it replaced
+    static void benchNeedleRaster() {
+        NeedleRaster raster;
+        Display reference(0, 0, 0), table(0, 0, 0);
+        
+        int mismatches = 0, widest = 0;
+        for (int pos = 0; pos < NeedleRaster::POSITIONS; pos++) {
+            reference.clear();
+            table.clear();
+            NeedleRaster::drawLines(&reference, pos);
+            NeedleRaster::Bounds b = raster.draw(&table, pos);
+            if (memcmp(reference.buffer, table.buffer, sizeof(table.buffer)) != 0) mismatches++;
+            widest = std::max(widest, b.col_hi - b.col_lo + 1);
         }
         
-        // Calculate where the MPD text should start
-        int viz_name_width = font_manager->getTextWidth(viz_name, FontManager::SMALL);
-        int mpd_start_x = viz_name_width + 8; // 8 pixels spacing
-        int available_width = 128 - mpd_start_x;
-        
-        // Get current MPD text and update scroller
-        std::string mpd_text = mpd_client->getFormattedText();
-        TextScroller& scroller = is_left ? title_scroller_left : title_scroller_right;
-        scroller.setText(mpd_text);
-        
-        // For pixel-perfect scrolling, we need to render to a temporary area
-        // and then copy only the visible portion
-        if (!mpd_text.empty() && available_width > 20) {
-            std::string scrolled = scroller.getScrollingText(available_width, font_manager, FontManager::SMALL);
-            
-            // Calculate actual pixel offset for smooth rendering
-            int text_width = font_manager->getTextWidth(mpd_text.c_str(), FontManager::SMALL);
-            if (text_width > available_width) {
-                // Create a clipping region for smooth pixel-based scrolling
-                // This ensures text appears to slide smoothly rather than jump
-                renderClippedText(display, mpd_start_x, y_offset, scrolled.c_str(), 
-                                 available_width, FontManager::SMALL);
-            } else {
-                // Text fits, just draw normally
-                display->drawText(mpd_start_x, y_offset, scrolled.c_str(), FontManager::SMALL);
-            }
+        const int rounds = 2000;
+        auto start = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (int pos = 0; pos < NeedleRaster::POSITIONS; pos++) NeedleRaster::drawLines(&reference, pos);
         }
+        auto mid = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) {
+            for (int pos = 0; pos < NeedleRaster::POSITIONS; pos++) raster.draw(&table, pos);
+        }
+        auto end = std::chrono::steady_clock::now();
+        
+        int draws = rounds * NeedleRaster::POSITIONS;
+        double lines_ns = std::chrono::duration<double, std::nano>(mid - start).count() / draws;
+        double table_ns = std::chrono::duration<double, std::nano>(end - mid).count() / draws;
+        printf("VU needle raster (%zu spans, %zu bytes, widest needle %d columns)\n",
+               raster.spanCount(), raster.spanCount() * sizeof(PixelSpan), widest);
+        printf("  drawLine %.1f ns, table %.1f ns per needle (%.1fx), %d/%d positions differ\n\n",
+               lines_ns, table_ns, lines_ns / table_ns, mismatches, NeedleRaster::POSITIONS);
     }
     
-    // Helper method for simple title drawing (backward compatibility)
-    void drawTitle(Display* display, const char* viz_name, int y_offset = 0) {
-        display->drawText(2, y_offset, viz_name, FontManager::SMALL);
-    }
-    
-private:
-    // Helper to render text with pixel-perfect clipping
-    void renderClippedText(Display* display, int x, int y, const char* text, 
-                          int clip_width, FontManager::FontSize font_size) {
-        // Create temporary buffer for the text
-        uint8_t temp_buffer[128 * 8] = {0};  // One row of display height
-        
-        // Render text to temporary buffer
-        font_manager->renderText(text, temp_buffer, 128, 64, 0, y, font_size);
-        
-        // Copy only the visible portion to the display buffer
-        int page_start = (y - 8) / 8;  // Assuming font height ~8 pixels
-        int page_end = (y + 8) / 8;
+    static void benchBandEngines() {
+        const BandEngine engines[] = { BandEngine::FFT, BandEngine::GOERTZEL, BandEngine::IIR };
+        const float hop_us = HOP * 1e6f / SAMPLE_RATE;
+        
+        printf("Band engines (white noise, %d-frame hops, %.0f us per hop real time)\n", HOP, hop_us);
+        std::vector<int16_t> pcm(SAMPLE_RATE * 4 * 2);
+        fillNoise(pcm, 0.3f);
+        for (BandEngine engine : engines) {
+            AudioProcessor audio;
+            prepare(audio, engine);
+            double us = feed(audio, pcm);
+            printf("  %-10s %8.1f us/hop  %5.2f%% of one core\n",
+                   bandEngineName(engine), us, us * 100.0 / hop_us);
+        }
         
-        for (int page = page_start; page <= page_end && page < 8; page++) {
-            for (int col = 0; col < clip_width && (x + col) < 128; col++) {
-                // Copy pixel data from temp buffer to display buffer
-                display->buffer[page * 128 + x + col] |= temp_buffer[page * 128 + col];
+        printf("\nBand accuracy vs fft (band levels, tone at band centre and noise)\n");
+        printf("  %-8s %6s %6s %8s\n", "signal", "fft", "other", "diff dB");
+        std::vector<int16_t> tone(SAMPLE_RATE * 2);
+        for (BandEngine engine : engines) {
+            if (engine == BandEngine::FFT) continue;
+            printf("  [%s]\n", bandEngineName(engine));
+            for (int band = 0; band <= BAND_COUNT; band++) {
+                char label[16];
+                int sensitivity = 10;
+                if (band < BAND_COUNT) {
+                    float centre = sqrtf((float)Bands::TABLE.low[band] * Bands::TABLE.high[band]);
+                    fillTone(tone, centre, 0.5f);
+                    snprintf(label, sizeof(label), "%.0fHz", centre);
+                } else {
+                    fillNoise(tone, 0.3f);
+                    snprintf(label, sizeof(label), "noise");
+                    sensitivity = 100;
+                }
+                
+                AudioProcessor ref, test;
+                prepare(ref, BandEngine::FFT, sensitivity);
+                prepare(test, engine, sensitivity);
+                feed(ref, tone);
+                feed(test, tone);
+                const AnalysisFrame& a = ref.getFrame();
+                const AnalysisFrame& b = test.getFrame();
+                
+                int first = band < BAND_COUNT ? band : 0;
+                int last = band < BAND_COUNT ? band : BAND_COUNT - 1;
+                for (int i = first; i <= last; i++) {
+                    float diff = 20.0f * log10f(std::max(1, b.left_bands[i]) / (float)std::max(1, a.left_bands[i]));
+                    printf("  %-8s %6d %6d %+8.2f\n", i == first ? label : "", a.left_bands[i], b.left_bands[i], diff);
+                }
             }
         }
     }
     
 public:
-    // Constructor for basic visualization (no MPD support)
-    Visualization(Display* left, Display* right) 
-        : left_display(left), right_display(right), mpd_client(nullptr), font_manager(nullptr) {}
+    static int run() {
+        printf("AAV DSP benchmark (%d bands)\n", BAND_COUNT);
+        printf("===========================\n\n");
+        benchBandKernel();
+        benchLevelMeter();
+        benchNeedle();
+        benchNeedleRaster();
+        benchBallistics();
+        benchStereo();
+        benchAnalysisGraph();
+        benchWorkers();
+        benchFFT();
+        benchBandEngines();
+        return 0;
+    }
+};
+
+// Minimal MPD protocol stand-in on a Unix socket, so MPDClient can be
+// exercised and measured without a real MPD. It serves a scripted queue with
+// status, currentsong, playlistinfo, idle/noidle, command lists, album art
+// and the transport commands, with optional reply latency and forced
+// disconnects.
+class FakeMPDServer {
+public:
+    struct Song {
+        std::string file;
+        std::string title;
+        std::string artist;
+        std::string album;
+        std::string date;
+        unsigned duration;  // Seconds
+    };
     
-    // Constructor with MPD support
-    Visualization(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : left_display(left), right_display(right), mpd_client(mpd), font_manager(fm) {}
+    enum Event : uint32_t { EVENT_PLAYER = 1 << 0, EVENT_MIXER = 1 << 1 };
     
-    virtual ~Visualization() = default;
-    virtual void render(ControlState& state, AudioProcessor& audio) = 0;
-    virtual const char* getName() const = 0;
+    // One step of a replayed session: wait, then act
+    struct ScriptStep {
+        int delay_ms;
+        enum Action { NEXT, TOGGLE_PAUSE, SET_VOLUME, DISCONNECT } action;
+        int value;
+    };
     
-    // Utility method to check if MPD support is available
-    bool hasMPDSupport() const { return mpd_client != nullptr && font_manager != nullptr; }
-};
-
-// VU Meter visualization
-class VUMeterVisualization : public Visualization {
 private:
-    struct DBPosition {
-        int x;
-        const char* text;
+    struct Client {
+        int fd;
+        std::string input;
+        bool idle = false;
+        uint32_t idle_mask = 0;
+        uint32_t events = 0;          // Changes not yet reported to this client
+        bool in_list = false;
+        bool list_ok = false;
+        std::vector<std::string> list;
+        size_t binary_limit = 8192;
     };
     
-    std::array<DBPosition, 11> db_positions;
-    static constexpr const char* POWER_SCALE[6] = {"0", "20", "40", "60", "80", "100"};
+    std::string path;
+    int listen_fd;
+    int control_fd;  // eventfd: state changed from another thread, or stop
+    std::thread server_thread;
+    std::atomic<bool> running;
     
-    void calculateDBPositions() {
-        // dB values matching Python code
-        const float db_values[11] = {-20, -10, -7, -5, -3, -2, -1, 0, 1, 2, 3};
-        
-        for (int i = 0; i < 11; i++) {
-            // Convert dB to linear value
-            float value = powf(10.0f, db_values[i] / 20.0f);
-            float log_pos = log10f(value);
-            
-            // Min/max log values for -20dB to +3dB
-            float min_log = log10f(powf(10.0f, -20.0f / 20.0f));
-            float max_log = log10f(powf(10.0f, 3.0f / 20.0f));
-            
-            // Calculate x position (0-125 range as in Python)
-            int x_pos = (int)((log_pos - min_log) / (max_log - min_log) * 125.0f);
-            
-            // Store position and text
-            db_positions[i].x = x_pos;
-            // Static storage for text
-            static char texts[11][4];
-            snprintf(texts[i], 4, "%d", abs((int)db_values[i]));
-            db_positions[i].text = texts[i];
+    std::mutex mutex;  // Everything below
+    std::vector<Client> clients;
+    std::vector<Song> queue;
+    std::vector<uint8_t> cover;  // Served for every song by albumart; empty for none
+    bool art_denied;             // Pictures refused as for a client without permission
+    int current;                 // Queue position, -1 when stopped at the end
+    bool paused;
+    float elapsed_at_change;
+    std::chrono::steady_clock::time_point changed_at;
+    int volume;
+    unsigned queue_version;
+    unsigned latency_us;
+    bool drop_clients;
+    std::map<std::string, int> command_counts;
+    
+    static int songId(int pos) { return pos + 1; }
+    
+    float elapsed() const {
+        float value = elapsed_at_change;
+        if (!paused && current >= 0) {
+            value += std::chrono::duration<float>(std::chrono::steady_clock::now() - changed_at).count();
         }
+        return current >= 0 ? std::min(value, (float)queue[current].duration) : 0.0f;
     }
     
-    void drawVUBackground(Display* display, bool is_left) {
-        // Draw dB markings
-        for (const auto& pos : db_positions) {
-            display->drawText(pos.x, 5, pos.text, FontManager::SMALL);
-            display->drawLine(pos.x, 7, pos.x, 9);
+    // Caller holds mutex
+    void raise(uint32_t events) {
+        for (auto& client : clients) client.events |= events;
+    }
+    
+    void startSong(int pos) {
+        current = pos >= 0 && pos < (int)queue.size() ? pos : -1;
+        paused = false;
+        elapsed_at_change = 0.0f;
+        changed_at = std::chrono::steady_clock::now();
+        raise(EVENT_PLAYER);
+    }
+    
+    void wakeServer() {
+        uint64_t one = 1;
+        if (write(control_fd, &one, sizeof(one)) < 0) {}
+    }
+    
+    static void sendAll(int fd, const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0) return;
+            sent += n;
         }
-        
-        // Draw horizontal lines
-        display->drawLine(108, 8, 127, 8);  // Short line at right
-        display->drawLine(0, 9, 127, 9);    // Full line
-        display->drawLine(0, 11, 127, 11);    // Full line
-        
-        // Draw edge marks
-        display->drawLine(0, 6, 0, 8);
-        display->drawLine(0, 11, 0, 13);
-        display->drawLine(127, 6, 127, 8);
-        display->drawLine(127, 11, 127, 13);
-        
-        // Draw power scale
-        for (int i = 0; i < 6; i++) {
-            int x = i * 22;
-            display->drawText(x, 22, POWER_SCALE[i], FontManager::SMALL);
-            display->drawLine(x, 11, x, 13);
+    }
+    
+    // Split a command line into words, honouring "quoted \"strings\""
+    static std::vector<std::string> tokenize(const std::string& line) {
+        std::vector<std::string> words;
+        size_t i = 0;
+        while (i < line.size()) {
+            while (i < line.size() && line[i] == ' ') i++;
+            if (i >= line.size()) break;
+            std::string word;
+            if (line[i] == '"') {
+                for (i++; i < line.size() && line[i] != '"'; i++) {
+                    if (line[i] == '\\' && i + 1 < line.size()) i++;
+                    word += line[i];
+                }
+                i++;
+            } else {
+                while (i < line.size() && line[i] != ' ') word += line[i++];
+            }
+            words.push_back(word);
         }
-        
-        // Draw +/- indicators
-        display->drawText(0, 28, "-", FontManager::SMALL);
-        display->drawText(124, 28, "+", FontManager::SMALL);
-        
-        // Draw channel label
-        display->drawText(0, 64, is_left ? "LEFT" : "RIGHT", FontManager::SMALL);
-        display->drawText(120, 64, "dB", FontManager::SMALL);
+        return words;
     }
     
-    void drawVUNeedle(Display* display, float level) {
-        // Convert level (0-255) to position (0-127)
-        int pos = (int)((level / 255.0f) * 127.0f);
-        pos = std::max(0, std::min(127, pos));
-        
-        // Calculate needle start and end points (matching Python algorithm)
-        int start_x = 71 - (127 - pos) / 8;
-        int start_y = 63;
-        int end_x = pos;
-        
-        // Parabolic curve for needle
-        int curve_height = pos * (127 - pos);
-        int end_y = 20 - curve_height / 200;
-        
-        // Draw needle with thickness
-        display->drawLine(start_x, start_y, end_x, end_y);
-        display->drawLine(start_x + 1, start_y, end_x + 1, end_y);
+    static uint32_t parseSubsystems(const std::vector<std::string>& args) {
+        if (args.size() <= 1) return EVENT_PLAYER | EVENT_MIXER;
+        uint32_t mask = 0;
+        for (size_t i = 1; i < args.size(); i++) {
+            if (args[i] == "player") mask |= EVENT_PLAYER;
+            if (args[i] == "mixer") mask |= EVENT_MIXER;
+        }
+        return mask;
     }
     
-    void drawVUMeter(Display* display, int level, bool is_left) {
-        display->clear();
-        
-        // Draw background elements
-        drawVUBackground(display, is_left);
-        
-        // Draw needle
-        drawVUNeedle(display, (float)level);
-        
-        display->display();
+    static std::string changedLines(uint32_t events) {
+        std::string out;
+        if (events & EVENT_PLAYER) out += "changed: player\n";
+        if (events & EVENT_MIXER) out += "changed: mixer\n";
+        return out;
     }
     
-public:
-    VUMeterVisualization(Display* left, Display* right) 
-        : Visualization(left, right) {
-        calculateDBPositions();
+    void songLines(int pos, std::string& out) const {
+        const Song& song = queue[pos];
+        char line[64];
+        out += "file: " + song.file + "\n";
+        out += "Title: " + song.title + "\n";
+        out += "Artist: " + song.artist + "\n";
+        out += "Album: " + song.album + "\n";
+        out += "Date: " + song.date + "\n";
+        snprintf(line, sizeof(line), "Time: %u\nduration: %u.000\nPos: %d\nId: %d\n",
+                 song.duration, song.duration, pos, songId(pos));
+        out += line;
     }
     
-    void render(ControlState& state, AudioProcessor& audio) override {
-        int left_vu, right_vu;
-        audio.getVUMeterData(left_vu, right_vu);
-        
-        drawVUMeter(left_display, left_vu, true);
-        drawVUMeter(right_display, right_vu, false);
+    void statusLines(std::string& out) const {
+        char text[512];
+        int next = current >= 0 && current + 1 < (int)queue.size() ? current + 1 : -1;
+        snprintf(text, sizeof(text),
+                 "volume: %d\nrepeat: 0\nrandom: 0\nsingle: 0\nconsume: 0\n"
+                 "playlist: %u\nplaylistlength: %zu\nstate: %s\n",
+                 volume, queue_version, queue.size(),
+                 current < 0 ? "stop" : paused ? "pause" : "play");
+        out += text;
+        if (current >= 0) {
+            float now = elapsed();
+            snprintf(text, sizeof(text),
+                     "song: %d\nsongid: %d\ntime: %d:%u\nelapsed: %.3f\nbitrate: 320\n"
+                     "duration: %u.000\naudio: 44100:16:2\n",
+                     current, songId(current), (int)now, queue[current].duration, now,
+                     queue[current].duration);
+            out += text;
+        }
+        if (next >= 0) {
+            snprintf(text, sizeof(text), "nextsong: %d\nnextsongid: %d\n", next, songId(next));
+            out += text;
+        }
     }
     
-    const char* getName() const override { return "VU Meter"; }
-};
-
-class SpectrumVisualizationMPD : public Visualization {
-private:
-    std::array<float, 7> peak_left{};
-    std::array<float, 7> peak_right{};
-    static constexpr const char* FREQ_LABELS[7] = {
-        "63", "160", "400", "1K", "2.5K", "6.3K", "16K"
-    };
+    // One command; appends its reply without the final OK. False with an ACK in error.
+    bool execute(Client& client, const std::vector<std::string>& args, std::string& out, std::string& error) {
+        const std::string& cmd = args[0];
+        command_counts[cmd]++;
+        
+        if (cmd == "status") {
+            statusLines(out);
+        } else if (cmd == "currentsong") {
+            if (current >= 0) songLines(current, out);
+        } else if (cmd == "playlistinfo" && args.size() > 1) {
+            int pos = atoi(args[1].c_str());
+            if (pos < 0 || pos >= (int)queue.size()) {
+                error = "ACK [2@0] {playlistinfo} Bad song index\n";
+                return false;
+            }
+            songLines(pos, out);
+        } else if (cmd == "ping" || cmd == "password") {
+        } else if (cmd == "binarylimit" && args.size() > 1) {
+            client.binary_limit = std::max(64, atoi(args[1].c_str()));
+        } else if ((cmd == "albumart" || cmd == "readpicture") && args.size() > 2) {
+            size_t offset = strtoul(args[2].c_str(), nullptr, 10);
+            if (art_denied) {
+                error = "ACK [4@0] {" + cmd + "} you don't have permission for \"" + cmd + "\"\n";
+                return false;
+            }
+            if (cover.empty() || cmd == "readpicture") {
+                if (cmd == "readpicture") return true;  // No embedded picture: empty reply
+                error = "ACK [50@0] {albumart} No file exists\n";
+                return false;
+            }
+            offset = std::min(offset, cover.size());
+            size_t length = std::min(client.binary_limit, cover.size() - offset);
+            char header[64];
+            snprintf(header, sizeof(header), "size: %zu\nbinary: %zu\n", cover.size(), length);
+            out += header;
+            out.append((const char*)cover.data() + offset, length);
+            out += "\n";
+        } else if (cmd == "next" || cmd == "previous" || cmd == "play") {
+            int target = cmd == "next" ? current + 1 : cmd == "previous" ? std::max(0, current - 1)
+                       : args.size() > 1 ? atoi(args[1].c_str()) : std::max(0, current);
+            startSong(target);
+        } else if (cmd == "pause") {
+            if (current >= 0) {
+                elapsed_at_change = elapsed();
+                changed_at = std::chrono::steady_clock::now();
+                paused = args.size() > 1 ? args[1] == "1" : !paused;
+                raise(EVENT_PLAYER);
+            }
+        } else if (cmd == "seekcur" && args.size() > 1) {
+            if (current < 0) {
+                error = "ACK [55@0] {seekcur} Not playing\n";
+                return false;
+            }
+            float target = atof(args[1].c_str());
+            if (args[1][0] == '+' || args[1][0] == '-') target += elapsed();
+            elapsed_at_change = std::max(0.0f, std::min(target, (float)queue[current].duration));
+            changed_at = std::chrono::steady_clock::now();
+            raise(EVENT_PLAYER);
+        } else if ((cmd == "volume" || cmd == "setvol") && args.size() > 1) {
+            int value = atoi(args[1].c_str());
+            volume = std::max(0, std::min(100, cmd == "volume" ? volume + value : value));
+            raise(EVENT_MIXER);
+        } else {
+            error = "ACK [5@0] {" + cmd + "} unknown command \"" + cmd + "\"\n";
+            return false;
+        }
+        return true;
+    }
     
-    void drawSpectrum(Display* display, const std::array<int, 7>& levels, 
-                      std::array<float, 7>& peaks, const char* title, bool is_left) {
-        display->clear();
-        
-        // Draw title with MPD info on same line
-        drawTitleWithMPD(display, title, 5, is_left);
-        
-        // Now we have more vertical space for bars!
-        int bar_top = 8; // Only need small offset now
-        int bar_bottom = 57;
-        int bar_width = 12;
-        int bar_height_range = bar_bottom - bar_top;
+    // Caller holds mutex. False when the client should be closed.
+    bool handleLine(Client& client, const std::string& line) {
+        std::vector<std::string> args = tokenize(line);
+        if (args.empty()) return true;
+        
+        if (client.idle) {
+            // Only noidle is valid while idle; it ends idle with whatever is pending
+            if (args[0] != "noidle") return false;
+            command_counts["noidle"]++;
+            std::string changed = changedLines(client.events & client.idle_mask);
+            client.events &= ~client.idle_mask;
+            client.idle = false;
+            reply(client, changed + "OK\n");
+            return true;
+        }
+        if (args[0] == "noidle") return true;  // Raced a completed idle: ignored, like MPD
+        if (args[0] == "close") return false;
+        
+        if (args[0] == "command_list_begin" || args[0] == "command_list_ok_begin") {
+            client.in_list = true;
+            client.list_ok = args[0] == "command_list_ok_begin";
+            client.list.clear();
+            return true;
+        }
+        if (client.in_list && args[0] != "command_list_end") {
+            client.list.push_back(line);
+            return true;
+        }
         
-        // Draw bars
-        for (int i = 0; i < 7; i++) {
-            int x = 1 + (i * 19);
-            int height = (levels[i] * bar_height_range) / 255;
-            int bar_y = bar_bottom - height;
+        std::string out, error;
+        if (client.in_list) {
+            client.in_list = false;
+            for (size_t i = 0; i < client.list.size(); i++) {
+                if (!execute(client, tokenize(client.list[i]), out, error)) {
+                    // The ACK carries the failing command's index in the list
+                    error.replace(error.find('@') + 1, 1, std::to_string(i));
+                    break;
+                }
+                if (client.list_ok) out += "list_OK\n";
+            }
+        } else if (args[0] == "idle") {
+            command_counts["idle"]++;
+            client.idle_mask = parseSubsystems(args);
+            client.idle = true;
+            deliverIdle(client);
+            return true;
+        } else {
+            execute(client, args, out, error);
+        }
+        reply(client, error.empty() ? out + "OK\n" : out + error);
+        return true;
+    }
+    
+    void reply(Client& client, const std::string& reply) {
+        if (latency_us) std::this_thread::sleep_for(std::chrono::microseconds(latency_us));
+        sendAll(client.fd, reply);
+    }
+    
+    void deliverIdle(Client& client) {
+        uint32_t ready = client.events & client.idle_mask;
+        if (!client.idle || !ready) return;
+        client.events &= ~ready;
+        client.idle = false;
+        reply(client, changedLines(ready) + "OK\n");
+    }
+    
+    void serverFunc() {
+        while (running) {
+            std::vector<struct pollfd> fds;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                fds.push_back({ listen_fd, POLLIN, 0 });
+                fds.push_back({ control_fd, POLLIN, 0 });
+                for (const auto& client : clients) fds.push_back({ client.fd, POLLIN, 0 });
+            }
+            if (poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) break;
             
-            // Draw bar
-            if (height > 0 && bar_y >= bar_top) {
-                display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
-                                 std::min(height, bar_bottom - bar_top), true);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fds[1].revents & POLLIN) {
+                uint64_t count;
+                if (read(control_fd, &count, sizeof(count)) < 0) {}
+            }
+            if (fds[0].revents & POLLIN) {
+                int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) {
+                    Client client;
+                    client.fd = fd;
+                    clients.push_back(client);
+                    reply(clients.back(), "OK MPD 0.23.5\n");
+                }
             }
             
-            // Update and draw peak
-            if (bar_y < peaks[i]) {
-                peaks[i] = bar_y;
+            std::vector<int> closing;
+            for (size_t i = 2; i < fds.size(); i++) {
+                if (!fds[i].revents) continue;
+                Client* client = nullptr;
+                for (auto& c : clients) if (c.fd == fds[i].fd) client = &c;
+                if (!client) continue;
+                
+                char buffer[4096];
+                ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+                if (n <= 0) {
+                    closing.push_back(client->fd);
+                    continue;
+                }
+                client->input.append(buffer, n);
+                size_t newline;
+                while ((newline = client->input.find('\n')) != std::string::npos) {
+                    std::string line = client->input.substr(0, newline);
+                    client->input.erase(0, newline + 1);
+                    if (!handleLine(*client, line)) {
+                        closing.push_back(client->fd);
+                        break;
+                    }
+                }
             }
-            peaks[i] = std::min((float)(bar_bottom - 1), peaks[i] + 0.8f);
             
-            if (peaks[i] < bar_bottom - 1 && peaks[i] >= bar_top) {
-                display->drawLine(x, (int)peaks[i], x + bar_width - 1, (int)peaks[i]);
+            for (auto& client : clients) {
+                if (drop_clients) closing.push_back(client.fd);
+                else deliverIdle(client);
             }
+            drop_clients = false;
             
-            // Label
-            display->drawText(x, 64, FREQ_LABELS[i], FontManager::SMALL);
+            for (int fd : closing) {
+                auto it = std::find_if(clients.begin(), clients.end(), [fd](const Client& c) { return c.fd == fd; });
+                if (it == clients.end()) continue;
+                close(it->fd);
+                clients.erase(it);
+            }
         }
-        
-        display->display();
     }
     
-public:
-    SpectrumVisualizationMPD(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : Visualization(left, right, mpd, fm) {}
+public:
+    FakeMPDServer(const std::string& socket_path)
+        : path(socket_path), listen_fd(-1), control_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+          running(false), art_denied(false), current(-1), paused(false), elapsed_at_change(0.0f),
+          volume(50), queue_version(1), latency_us(0), drop_clients(false) {}
+    
+    ~FakeMPDServer() {
+        stop();
+        if (control_fd >= 0) close(control_fd);
+    }
+    
+    bool start() {
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path)) return false;
+        strcpy(addr.sun_path, path.c_str());
+        unlink(path.c_str());
+        
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(listen_fd, 4) != 0) {
+            printf("Fake MPD: cannot listen on %s: %s\n", path.c_str(), strerror(errno));
+            return false;
+        }
+        running = true;
+        server_thread = std::thread(&FakeMPDServer::serverFunc, this);
+        return true;
+    }
+    
+    void stop() {
+        if (running) {
+            running = false;
+            wakeServer();
+            if (server_thread.joinable()) server_thread.join();
+        }
+        for (auto& client : clients) close(client.fd);
+        clients.clear();
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            listen_fd = -1;
+            unlink(path.c_str());
+        }
+    }
+    
+    // Scripted session setup and actions; safe from any thread
+    void setQueue(const std::vector<Song>& songs) {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue = songs;
+        queue_version++;
+        startSong(queue.empty() ? -1 : 0);
+        wakeServer();
+    }
+    
+    void setCover(const std::vector<uint8_t>& data) {
+        std::lock_guard<std::mutex> lock(mutex);
+        cover = data;
+    }
+    
+    void denyArt(bool denied) {
+        std::lock_guard<std::mutex> lock(mutex);
+        art_denied = denied;
+    }
+    
+    void setLatency(unsigned microseconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        latency_us = microseconds;
+    }
     
-    void render(ControlState& state, AudioProcessor& audio) override {
-        std::array<int, 7> left_spectrum, right_spectrum;
-        audio.getSpectrumData(left_spectrum, right_spectrum);
-        
-        drawSpectrum(left_display, left_spectrum, peak_left, "SPECTRUM L", true);
-        drawSpectrum(right_display, right_spectrum, peak_right, "SPECTRUM R", false);
+    void next() {
+        std::lock_guard<std::mutex> lock(mutex);
+        startSong(current + 1 < (int)queue.size() ? current + 1 : 0);
+        wakeServer();
     }
     
-    const char* getName() const override { return "Spectrum Analyzer"; }
-};
-
-class EmptySpectrumVisualizationMPD : public Visualization {
-private:
-    static constexpr const char* FREQ_LABELS[7] = {
-        "63", "160", "400", "1K", "2.5K", "6.3K", "16K"
-    };
+    void togglePause() {
+        std::lock_guard<std::mutex> lock(mutex);
+        elapsed_at_change = elapsed();
+        changed_at = std::chrono::steady_clock::now();
+        paused = !paused;
+        raise(EVENT_PLAYER);
+        wakeServer();
+    }
     
-    void drawSpectrum(Display* display, const std::array<int, 7>& levels, const char* title, bool is_left) {
-        display->clear();
-        
-        // Draw title with MPD info on same line
-        drawTitleWithMPD(display, title, 5, is_left);
-        
-        int bar_top = 8;
-        int bar_bottom = 57;
-        int bar_width = 12;
-        int bar_height_range = bar_bottom - bar_top;
-        
-        // Draw bars
-        for (int i = 0; i < 7; i++) {
-            int x = 1 + (i * 19);
-            int height = (levels[i] * bar_height_range) / 255;
-            int bar_y = bar_bottom - height;
-            
-            // Draw bar
-            if (height > 0 && bar_y >= bar_top) {
-                display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
-                                 std::min(height, bar_bottom - bar_top), false);
+    void setVolume(int value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        volume = value;
+        raise(EVENT_MIXER);
+        wakeServer();
+    }
+    
+    // Drop every client connection, as an MPD restart would
+    void disconnectAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        drop_clients = true;
+        wakeServer();
+    }
+    
+    void replay(const std::vector<ScriptStep>& script) {
+        for (const auto& step : script) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(step.delay_ms));
+            switch (step.action) {
+                case ScriptStep::NEXT: next(); break;
+                case ScriptStep::TOGGLE_PAUSE: togglePause(); break;
+                case ScriptStep::SET_VOLUME: setVolume(step.value); break;
+                case ScriptStep::DISCONNECT: disconnectAll(); break;
             }
-                       
-            // Label
-            display->drawText(x, 64, FREQ_LABELS[i], FontManager::SMALL);
         }
-        
-        display->display();
     }
     
-public:
-    EmptySpectrumVisualizationMPD(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : Visualization(left, right, mpd, fm) {}
+    // Protocol traffic seen so far, by command name
+    int commandCount(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = command_counts.find(name);
+        return it == command_counts.end() ? 0 : it->second;
+    }
     
-    void render(ControlState& state, AudioProcessor& audio) override {
-        std::array<int, 7> left_spectrum, right_spectrum;
-        audio.getSpectrumData(left_spectrum, right_spectrum);
-        
-        drawSpectrum(left_display, left_spectrum, "SPECTRUM L", true);
-        drawSpectrum(right_display, right_spectrum, "SPECTRUM R", false);
+    int totalCommands() {
+        std::lock_guard<std::mutex> lock(mutex);
+        int total = 0;
+        for (const auto& entry : command_counts) total += entry.second;
+        return total;
     }
     
-    const char* getName() const override { return "Empty Spectrum Analyzer"; }
+    int volumeLevel() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return volume;
+    }
 };
 
-class TeubSpectrumVisualizationMPD : public Visualization {
+// MPDClient against FakeMPDServer: connect, idle wake-up, reconnect and
+// transport command latency, and client CPU per player event
+class MPDBenchmark {
 private:
-    std::array<float, 7> peak_left{};
-    std::array<float, 7> peak_right{};
-    static constexpr const char* FREQ_LABELS[7] = {
-        "63", "160", "400", "1K", "2.5K", "6.3K", "16K"
-    };
+    friend class PlayerBenchmark;  // Shares waitFor, report and makeCover
+    using Clock = std::chrono::steady_clock;
+    static constexpr int EVENTS = 50;
     
-    void drawSpectrum(Display* display, const std::array<int, 7>& levels, 
-                      std::array<float, 7>& peaks, const char* title, bool is_left) {
-        display->clear();
-        
-        // Draw title with MPD info on same line
-        drawTitleWithMPD(display, title, 5, is_left);
-        
-        // Now we have more vertical space for bars!
-        int bar_top = 12; // Only need small offset now
-        int bar_bottom = 47;
-        int bar_width = 8;
-        int bar_height_range = bar_bottom - bar_top;
-        
-        // Draw bars
-        for (int i = 0; i < 7; i++) {
-            int x = 1 + (i * 19);
-            int height = (levels[i] * bar_height_range) / 255;
-            int bar_y = bar_bottom - height;
-            
-            // Draw bar
-            if (height > 0 && bar_y >= bar_top) {
-            //    display->drawRect(x, std::max(bar_y, bar_top), bar_width, 
-            //                     std::min(height, bar_height_range), false);
-                display->drawLine(x, std::max(bar_y, bar_top), x, bar_bottom);
-                display->drawLine(x+bar_width, std::max(bar_y, bar_top), x+bar_width, bar_bottom);
-                display->drawCircle(x+4, std::max(bar_y, bar_top), 5, false);
-                display->drawLine(x+4, std::max(bar_y, bar_top) -3, x+4, std::max(bar_y, bar_top)-1);
-
-
-            }
-            
-            // Update and draw peak
-            if (bar_y < peaks[i]) {
-                peaks[i] = bar_y;
-            }
-            peaks[i] = std::min((float)(bar_bottom - 1), peaks[i] + 0.8f);
-            
-            if (peaks[i] < bar_bottom - 1 && peaks[i] >= bar_top) {
-                display->drawLine(x+4, ((int)peaks[i])-4, x+4 , ((int)peaks[i])-2);
-                display->drawLine(x+3, ((int)peaks[i])-4, x+3 , ((int)peaks[i])-4);
-                display->drawLine(x+5, ((int)peaks[i])-4, x+5 , ((int)peaks[i])-6);
-
-
-            }
-            
-            // balls
-            display->drawCircle(x, 52, 5, false);
-            display->drawCircle(x+8, 52, 5, false);
-
-
-            // Label
-            display->drawText(x, 64, FREQ_LABELS[i], FontManager::SMALL);
+    // Spin until the condition holds; milliseconds since start, or -1 on timeout
+    template <typename Condition>
+    static double waitFor(Condition condition, Clock::time_point start = Clock::now()) {
+        while (!condition()) {
+            if (Clock::now() - start > std::chrono::seconds(3)) return -1.0;
+            std::this_thread::yield();
         }
-        
-        display->display();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
     }
     
-public:
-    TeubSpectrumVisualizationMPD(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : Visualization(left, right, mpd, fm) {}
-    
-    void render(ControlState& state, AudioProcessor& audio) override {
-        std::array<int, 7> left_spectrum, right_spectrum;
-        audio.getSpectrumData(left_spectrum, right_spectrum);
-        
-        drawSpectrum(left_display, left_spectrum, peak_left, "SPECTEUB L", true);
-        drawSpectrum(right_display, right_spectrum, peak_right, "SPECTEUB R", false);
+    static std::vector<FakeMPDServer::Song> makeQueue() {
+        std::vector<FakeMPDServer::Song> songs;
+        for (int i = 0; i < 40; i++) {
+            char file[64], title[32];
+            snprintf(file, sizeof(file), "Artist %d/Album %d/%02d Track.flac", i / 10, i / 10, i % 10 + 1);
+            snprintf(title, sizeof(title), "Track \"%d\"", i + 1);
+            songs.push_back({ file, title, "Artist " + std::to_string(i / 10),
+                              "Album " + std::to_string(i / 10), "1999-01-01", 180u + i });
+        }
+        return songs;
     }
     
-    const char* getName() const override { return "Spectrum Analyzer"; }
-};
-
-// Waveform visualization with MPD support
-class WaveformVisualizationMPD : public Visualization {
-private:
-    static constexpr int WAVE_SAMPLES = 128;
+#ifndef AAV_NO_JPEG
+    // Gradient cover encoded in memory, so the art path decodes a real JPEG
+    static std::vector<uint8_t> makeCover() {
+        const int size = 500;
+        struct jpeg_compress_struct cinfo;
+        struct jpeg_error_mgr err;
+        cinfo.err = jpeg_std_error(&err);
+        jpeg_create_compress(&cinfo);
+        unsigned char* out = nullptr;
+        unsigned long out_size = 0;
+        jpeg_mem_dest(&cinfo, &out, &out_size);
+        cinfo.image_width = size;
+        cinfo.image_height = size;
+        cinfo.input_components = 1;
+        cinfo.in_color_space = JCS_GRAYSCALE;
+        jpeg_set_defaults(&cinfo);
+        jpeg_start_compress(&cinfo, TRUE);
+        std::vector<uint8_t> row(size);
+        while (cinfo.next_scanline < (unsigned)size) {
+            int y = cinfo.next_scanline;
+            for (int x = 0; x < size; x++) row[x] = (uint8_t)((x * 255 / size + y * 255 / size) / 2);
+            JSAMPROW rows[1] = { row.data() };
+            jpeg_write_scanlines(&cinfo, rows, 1);
+        }
+        jpeg_finish_compress(&cinfo);
+        jpeg_destroy_compress(&cinfo);
+        std::vector<uint8_t> data(out, out + out_size);
+        free(out);
+        return data;
+    }
+#else
+    static std::vector<uint8_t> makeCover() { return std::vector<uint8_t>(40000, 0x55); }
+#endif
     
-    void drawWaveform(Display* display, AudioProcessor& audio, bool is_left) {
-        display->clear();
-        
-        // Draw title with MPD info on same line
-        drawTitleWithMPD(display, is_left ? "WAVEFORM L" : "WAVEFORM R", 5, is_left);
-        
-        // Get waveform data
-        float* samples = new float[WAVE_SAMPLES];
-        audio.getWaveformData(samples, WAVE_SAMPLES, is_left);
-        
-        // Now we can use almost the full height!
-        int center_y = 37;  // Back to original center
-        int wave_height = 25; // Full height
-        
-        // Draw center line
-        display->drawLine(0, center_y, 127, center_y);
-        
-        // Draw waveform
-        for (int i = 0; i < WAVE_SAMPLES - 1; i++) {
-            int y1 = center_y - (int)(samples[i] * wave_height);
-            int y2 = center_y - (int)(samples[i + 1] * wave_height);
-            y1 = std::max(12, std::min(63, y1));
-            y2 = std::max(12, std::min(63, y2));
-            display->drawLine(i, y1, i + 1, y2);
+    static void removeDirectory(const char* path) {
+        DIR* dir = opendir(path);
+        if (dir) {
+            while (struct dirent* entry = readdir(dir)) {
+                if (entry->d_name[0] == '.') continue;
+                unlink((std::string(path) + "/" + entry->d_name).c_str());
+            }
+            closedir(dir);
         }
-        
-        delete[] samples;
-        display->display();
+        rmdir(path);
     }
     
-public:
-    WaveformVisualizationMPD(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : Visualization(left, right, mpd, fm) {}
+    static void report(const char* name, std::vector<double>& samples) {
+        std::sort(samples.begin(), samples.end());
+        printf("  %-24s median %6.2f ms, p95 %6.2f ms, max %6.2f ms (%zu events)\n", name,
+               samples[samples.size() / 2], samples[samples.size() * 95 / 100], samples.back(), samples.size());
+    }
     
-    void render(ControlState& state, AudioProcessor& audio) override {
-        drawWaveform(left_display, audio, true);
-        drawWaveform(right_display, audio, false);
+    // Song changes driven from the server side, timed until the client publishes
+    static bool measureSongChanges(FakeMPDServer& server, MPDClient& client, int events, const char* name) {
+        std::vector<double> samples;
+        for (int i = 0; i < events; i++) {
+            int before = client.getMetadata()->song_id;
+            auto start = Clock::now();
+            server.next();
+            double ms = waitFor([&] { return client.getMetadata()->song_id != before; }, start);
+            if (ms < 0) {
+                printf("  %s: client missed a song change\n", name);
+                return false;
+            }
+            samples.push_back(ms);
+            waitFor([&] { return client.getAlbumArtVersion() > 0 &&
+                                 client.getAlbumArt()->song_id == client.getMetadata()->song_id; });
+        }
+        report(name, samples);
+        return true;
     }
     
-    const char* getName() const override { return "Waveform"; }
-};
-
-// Stereo field visualization with MPD support
-class StereoFieldVisualizationMPD : public Visualization {
-private:
-    static constexpr int HISTORY_SIZE = 64;
-    std::array<float, HISTORY_SIZE> phase_history{};
-    std::array<float, HISTORY_SIZE> correlation_history{};
-    int history_pos = 0;
+    // A transport command issued while a large cover downloads: the transfer
+    // yields between chunks and resumes at its offset afterwards
+    static bool measureCoverInterrupt(FakeMPDServer& server, MPDClient& client, const char* cache_dir) {
+        std::vector<uint8_t> cover = makeCover();
+        cover.resize(2 * 1024 * 1024);  // Padding after the JPEG's end marker is ignored
+        server.setCover(cover);
+        std::string art_dir = std::string(cache_dir) + "/aav";  // Cold cache for this album
+        removeDirectory(art_dir.c_str());
+        mkdir(art_dir.c_str(), 0755);
+        server.setLatency(2000);
+        
+        // Step to the first song of the next album, which starts a fetch
+        std::string album = ArtCache::albumKey(client.getMetadata()->uri);
+        while (ArtCache::albumKey(client.getMetadata()->uri) == album) {
+            int before = client.getMetadata()->song_id;
+            server.next();
+            if (waitFor([&] { return client.getMetadata()->song_id != before; }) < 0) return false;
+        }
+        int song_id = client.getMetadata()->song_id;
+        int transfers_before = server.commandCount("albumart");
+        
+        auto submitted = Clock::now();
+        uint64_t sequence = client.changeVolume(1);
+        double done_ms = waitFor([&] {
+            auto playback = client.getPlayback();
+            return playback && playback->commands_done >= sequence;
+        }, submitted);
+        double art_ms = waitFor([&] {
+            auto art = client.getAlbumArt();
+            return art && art->song_id == song_id && art->present;
+        }, submitted);
+        server.setLatency(0);
+        if (done_ms < 0 || art_ms < 0) {
+            printf("  command or cover lost during the transfer\n");
+            return false;
+        }
+        printf("  volume command done in %.2f ms, 2 MiB cover in %.2f ms over %d 'albumart' requests\n",
+               done_ms, art_ms, server.commandCount("albumart") - transfers_before);
+        return true;
+    }
     
-    void drawStereoField(Display* display, AudioProcessor& audio, const char* title, bool is_left) {
-        display->clear();
-        
-        // Draw title with MPD info on same line
-        drawTitleWithMPD(display, title, 5, is_left);
-        
-        // Get stereo analysis
-        float phase, correlation;
-        audio.getStereoAnalysis(phase, correlation);
-        
-        // Update history
-        phase_history[history_pos] = phase;
-        correlation_history[history_pos] = correlation;
-        history_pos = (history_pos + 1) % HISTORY_SIZE;
-        
-        // Full size phase meter!
-        int center_x = 32;
-        int center_y = 35;  // Original position
-        int box_size = 23;  // Full size
-        
-        display->drawRect(center_x - box_size, center_y - box_size, box_size * 2, box_size * 2, false);
-        
-        // Draw crosshairs
-        //display->drawLine(center_x - box_size, center_y, center_x + box_size, center_y);
-        //display->drawLine(center_x, center_y - box_size, center_x, center_y + box_size);
-        
-        // Draw phase history as dots
-        for (int i = 0; i < HISTORY_SIZE; i++) {
-            float angle = phase_history[i] * M_PI;
-            float radius = (box_size - 2) * (0.5f + correlation_history[i] * 0.5f);
-            int x = center_x + (int)(radius * cosf(angle));
-            int y = center_y + (int)(radius * sinf(angle));
-            display->drawPixel(x, y);
+    // Pictures refused for lack of permission: no cover is shown, but none is
+    // cached either, so the next song asks again once access is granted
+    static bool measureArtRefused(FakeMPDServer& server, MPDClient& client) {
+        server.setCover(makeCover());
+        server.denyArt(true);
+        std::string album = ArtCache::albumKey(client.getMetadata()->uri);
+        while (ArtCache::albumKey(client.getMetadata()->uri) == album) {
+            int before = client.getMetadata()->song_id;
+            server.next();
+            if (waitFor([&] { return client.getMetadata()->song_id != before; }) < 0) return false;
         }
-        
-        // Draw correlation meter on the right
-        int meter_x = 80;
-        display->drawRect(meter_x, 12, 20, 45, false);
-        int level = (int)(correlation * 22) + 22;
-        if (level > 0) {
-            display->drawRect(meter_x + 2, 57 - level, 16, level, true);
+        int song_id = client.getMetadata()->song_id;
+        bool refused = waitFor([&] {
+            auto art = client.getAlbumArt();
+            return art && art->song_id == song_id && !art->present;
+        }) >= 0;
+        
+        server.denyArt(false);
+        auto start = Clock::now();
+        server.next();
+        double ms = waitFor([&] {
+            auto art = client.getAlbumArt();
+            return art && art->song_id == client.getMetadata()->song_id && art->song_id != song_id && art->present;
+        }, start);
+        if (!refused || ms < 0) {
+            printf("  refused cover was %s\n", refused ? "cached as missing" : "never published");
+            return false;
         }
-        
-        display->drawText(meter_x +22, 31, "CORR:", FontManager::SMALL);
-        
-        // Show correlation value
-        char corr_text[8];
-        snprintf(corr_text, sizeof(corr_text), "%+.2f", correlation);
-        display->drawText(meter_x + 22, 38, corr_text, FontManager::SMALL);
-        
-        display->display();
+        printf("  refused cover not cached, shown on the next song after %.2f ms\n", ms);
+        return true;
     }
     
 public:
-    StereoFieldVisualizationMPD(Display* left, Display* right, MPDClient* mpd, FontManager* fm) 
-        : Visualization(left, right, mpd, fm) {}
-    
-    void render(ControlState& state, AudioProcessor& audio) override {
-        drawStereoField(left_display, audio, "STEREO", true);
-        drawStereoField(right_display, audio, "PHASE", false);
+    static int run() {
+        printf("AAV MPD client benchmark (fake server on a Unix socket)\n");
+        printf("=======================================================\n\n");
+        
+        char socket_path[64], cache_dir[64];
+        snprintf(socket_path, sizeof(socket_path), "/tmp/aav-fake-mpd-%d.sock", (int)getpid());
+        snprintf(cache_dir, sizeof(cache_dir), "/tmp/aav-bench-cache-%d", (int)getpid());
+        mkdir(cache_dir, 0755);
+        setenv("XDG_CACHE_HOME", cache_dir, 1);  // Cold album art cache
+        
+        FakeMPDServer server(socket_path);
+        if (!server.start()) return 1;
+        server.setQueue(makeQueue());
+        server.setCover(makeCover());
+        
+        MPDClient client(socket_path, 0);
+        auto start = Clock::now();
+        client.start();
+        double connect_ms = waitFor([&] { return client.getMetadata()->song_id == 1; });
+        if (connect_ms < 0) {
+            printf("Client never synced with the fake server\n");
+            return 1;
+        }
+        printf("Connect and first sync: %.2f ms (%d commands)\n",
+               std::chrono::duration<double, std::milli>(Clock::now() - start).count(), server.totalCommands());
+        
+        printf("\nIdle wake-up, server event to published snapshot:\n");
+        double cpu_before = client.threadCPUSeconds();
+        int commands_before = server.totalCommands();
+        if (!measureSongChanges(server, client, EVENTS, "song change")) return 1;
+        double cpu_per_event = (client.threadCPUSeconds() - cpu_before) / EVENTS * 1e6;
+        double commands_per_event = (double)(server.totalCommands() - commands_before) / EVENTS;
+        
+        std::vector<double> samples;
+        for (int i = 0; i < EVENTS; i++) {
+            uint64_t before = client.getPlaybackVersion();
+            auto start = Clock::now();
+            server.togglePause();
+            double ms = waitFor([&] { return client.getPlaybackVersion() != before; }, start);
+            if (ms < 0) {
+                printf("  pause/resume: client missed a state change\n");
+                return 1;
+            }
+            samples.push_back(ms);
+        }
+        report("pause/resume", samples);
+        printf("  client CPU %.1f us and %.1f protocol commands per song change (album art every 10th)\n",
+               cpu_per_event, commands_per_event);
+        
+        server.setLatency(2000);
+        if (!measureSongChanges(server, client, 10, "song change, 2 ms RTT")) return 1;
+        server.setLatency(0);
+        
+        printf("\nReconnect after the server drops the connection:\n");
+        samples.clear();
+        for (int i = 0; i < 10; i++) {
+            uint64_t before = client.getMetadataVersion();
+            auto start = Clock::now();
+            server.disconnectAll();
+            double ms = waitFor([&] { return client.getMetadataVersion() != before; }, start);
+            if (ms < 0) {
+                printf("  client did not reconnect\n");
+                return 1;
+            }
+            samples.push_back(ms);
+        }
+        report("reconnect + resync", samples);
+        
+        printf("\nTransport commands:\n");
+        int volume_before = server.volumeLevel();
+        int sent_before = server.commandCount("volume");
+        auto submitted = Clock::now();
+        uint64_t sequence = 0;
+        for (int i = 0; i < 12; i++) sequence = client.changeVolume(1);
+        double done_ms = waitFor([&] {
+            auto playback = client.getPlayback();
+            return playback && playback->commands_done >= sequence;
+        });
+        printf("  12 volume steps: %d 'volume' command(s), %d -> %d, completed in %.2f ms\n",
+               server.commandCount("volume") - sent_before, volume_before, server.volumeLevel(),
+               done_ms < 0 ? -1.0 : std::chrono::duration<double, std::milli>(Clock::now() - submitted).count());
+        if (!measureCoverInterrupt(server, client, cache_dir)) return 1;
+        if (!measureArtRefused(server, client)) return 1;
+        
+        // Scripted session: mixed events at realistic spacing
+        std::vector<FakeMPDServer::ScriptStep> script = {
+            { 20, FakeMPDServer::ScriptStep::NEXT, 0 },
+            { 20, FakeMPDServer::ScriptStep::TOGGLE_PAUSE, 0 },
+            { 20, FakeMPDServer::ScriptStep::SET_VOLUME, 30 },
+            { 20, FakeMPDServer::ScriptStep::TOGGLE_PAUSE, 0 },
+            { 20, FakeMPDServer::ScriptStep::DISCONNECT, 0 },
+            { 50, FakeMPDServer::ScriptStep::NEXT, 0 },
+        };
+        int expected = server.totalCommands();
+        server.replay(script);
+        bool synced = waitFor([&] {
+            auto playback = client.getPlayback();
+            return playback && playback->volume == 30 && playback->state == MPD_STATE_PLAY;
+        }) >= 0;
+        printf("\nScripted session: %s, %d commands\n", synced ? "client in sync" : "client OUT OF SYNC",
+               server.totalCommands() - expected);
+        
+        auto stop_start = Clock::now();
+        client.stop();
+        printf("Client stop: %.2f ms\n\n",
+               std::chrono::duration<double, std::milli>(Clock::now() - stop_start).count());
+        server.stop();
+        
+        removeDirectory((std::string(cache_dir) + "/aav").c_str());
+        removeDirectory(cache_dir);
+        return synced ? 0 : 1;
     }
-    
-    const char* getName() const override { return "Stereo Field"; }
 };
 
-// Control handler with sleep mode
-class ControlHandler {
+#ifndef AAV_NO_MPRIS
+// Scriptable MPRIS player on its own session bus connection, for
+// PlayerBenchmark. Serves the Player properties (GetAll, Get Position, Set
+// Volume) and the transport methods, and emits PropertiesChanged and Seeked
+// like a real player. Titles are "<song> <track number>".
+class FakeMPRISPlayer {
 private:
-    ControlState& state;
-    AudioProcessor& audio;
-    uint8_t encoder1_state = 0;
-    uint8_t encoder2_state = 0;
-    static ControlHandler* instance;
+    std::string bus_name;
+    std::string song;
+    DBusConnection* bus;
+    std::thread dispatch_thread;
+    std::atomic<bool> running;
     
-    uint8_t readEncoder(int encoder) {
-        uint8_t clk = bcm2835_gpio_lev(encoder == 1 ? GPIO::ROT1_CLK : GPIO::ROT2_CLK);
-        uint8_t dt = bcm2835_gpio_lev(encoder == 1 ? GPIO::ROT1_DT : GPIO::ROT2_DT);
-        return (clk << 1) | dt;
+    std::mutex mutex;  // Everything below
+    bool playing;
+    int track;
+    int64_t position_us;
+    double volume;
+    std::map<std::string, int> call_counts;
+    
+    static constexpr int64_t LENGTH_US = 200000000;
+    
+    static void appendVariant(DBusMessageIter* iter, const char* signature, int type, const void* value) {
+        DBusMessageIter variant;
+        dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, signature, &variant);
+        dbus_message_iter_append_basic(&variant, type, value);
+        dbus_message_iter_close_container(iter, &variant);
     }
     
-    int getDirection(uint8_t old_state, uint8_t new_state) {
-        static const int transitions[16] = {
-            0, 1, -1, 0, -1, 0, 0, 1, 1, 0, 0, -1, 0, -1, 1, 0
-        };
-        return transitions[(old_state << 2) | new_state];
+    static void appendEntry(DBusMessageIter* dict, const char* key, const char* signature, int type, const void* value) {
+        DBusMessageIter entry;
+        dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+        appendVariant(&entry, signature, type, value);
+        dbus_message_iter_close_container(dict, &entry);
     }
     
-public:
-    ControlHandler(ControlState& st, AudioProcessor& ap) : state(st), audio(ap) {
-        instance = this;
-        
-        // Setup GPIO
-        bcm2835_gpio_fsel(GPIO::POWER_LED, BCM2835_GPIO_FSEL_OUTP);
-        bcm2835_gpio_write(GPIO::POWER_LED, HIGH);
-        
-        uint8_t inputs[] = {
-            GPIO::ROT1_CLK, GPIO::ROT1_DT, GPIO::ROT1_SW,
-            GPIO::ROT2_CLK, GPIO::ROT2_DT, GPIO::ROT2_SW,
-            GPIO::POWER_SW
-        };
-        
-        for (uint8_t pin : inputs) {
-            bcm2835_gpio_fsel(pin, BCM2835_GPIO_FSEL_INPT);
-            bcm2835_gpio_set_pud(pin, BCM2835_GPIO_PUD_UP);
+    // Metadata as an a{sv} property entry (under mutex)
+    void appendMetadata(DBusMessageIter* dict) {
+        DBusMessageIter entry, variant, metadata, artists_variant, artists;
+        const char* key = "Metadata";
+        dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, nullptr, &entry);
+        dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+        dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, "a{sv}", &variant);
+        dbus_message_iter_open_container(&variant, DBUS_TYPE_ARRAY, "{sv}", &metadata);
+        
+        std::string track_id = "/org/aav/track/" + std::to_string(track);
+        std::string title = song + " " + std::to_string(track);
+        const char* track_id_text = track_id.c_str();
+        const char* title_text = title.c_str();
+        dbus_int32_t number = track;
+        int64_t length = LENGTH_US;
+        appendEntry(&metadata, "mpris:trackid", "o", DBUS_TYPE_OBJECT_PATH, &track_id_text);
+        appendEntry(&metadata, "xesam:title", "s", DBUS_TYPE_STRING, &title_text);
+        appendEntry(&metadata, "mpris:length", "x", DBUS_TYPE_INT64, &length);
+        appendEntry(&metadata, "xesam:trackNumber", "i", DBUS_TYPE_INT32, &number);
+        
+        // xesam:artist is a string array
+        const char* artist_key = "xesam:artist";
+        const char* artist = "Fake Artist";
+        DBusMessageIter artist_entry;
+        dbus_message_iter_open_container(&metadata, DBUS_TYPE_DICT_ENTRY, nullptr, &artist_entry);
+        dbus_message_iter_append_basic(&artist_entry, DBUS_TYPE_STRING, &artist_key);
+        dbus_message_iter_open_container(&artist_entry, DBUS_TYPE_VARIANT, "as", &artists_variant);
+        dbus_message_iter_open_container(&artists_variant, DBUS_TYPE_ARRAY, "s", &artists);
+        dbus_message_iter_append_basic(&artists, DBUS_TYPE_STRING, &artist);
+        dbus_message_iter_close_container(&artists_variant, &artists);
+        dbus_message_iter_close_container(&artist_entry, &artists_variant);
+        dbus_message_iter_close_container(&metadata, &artist_entry);
+        
+        dbus_message_iter_close_container(&variant, &metadata);
+        dbus_message_iter_close_container(&entry, &variant);
+        dbus_message_iter_close_container(dict, &entry);
+    }
+    
+    // Player properties as a{sv} (under mutex)
+    void appendProperties(DBusMessageIter* iter, bool state, bool metadata, bool level) {
+        DBusMessageIter dict;
+        dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, "{sv}", &dict);
+        if (state) {
+            const char* status = playing ? "Playing" : "Paused";
+            appendEntry(&dict, "PlaybackStatus", "s", DBUS_TYPE_STRING, &status);
         }
-        
-        encoder1_state = readEncoder(1);
-        encoder2_state = readEncoder(2);
+        if (metadata) appendMetadata(&dict);
+        if (level) appendEntry(&dict, "Volume", "d", DBUS_TYPE_DOUBLE, &volume);
+        dbus_message_iter_close_container(iter, &dict);
     }
     
-    void poll() {
-        // Encoder 1 - Sensitivity
-        uint8_t new1 = readEncoder(1);
-        if (new1 != encoder1_state) {
-            int dir = getDirection(encoder1_state, new1);
-            if (dir != 0) {
-                int val = audio.getSensitivity() + dir * 10;
-                audio.setSensitivity(std::max(10, std::min(300, val)));
-            }
-            encoder1_state = new1;
+    // PropertiesChanged for the given properties (under mutex)
+    void emitChanged(bool state, bool metadata, bool level) {
+        DBusMessage* signal = dbus_message_new_signal("/org/mpris/MediaPlayer2", "org.freedesktop.DBus.Properties",
+                                                      "PropertiesChanged");
+        DBusMessageIter iter, invalidated;
+        const char* interface = "org.mpris.MediaPlayer2.Player";
+        dbus_message_iter_init_append(signal, &iter);
+        dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &interface);
+        appendProperties(&iter, state, metadata, level);
+        dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "s", &invalidated);
+        dbus_message_iter_close_container(&iter, &invalidated);
+        dbus_connection_send(bus, signal, nullptr);
+        dbus_connection_flush(bus);
+        dbus_message_unref(signal);
+    }
+    
+    void emitSeeked() {
+        DBusMessage* signal = dbus_message_new_signal("/org/mpris/MediaPlayer2", "org.mpris.MediaPlayer2.Player", "Seeked");
+        dbus_message_append_args(signal, DBUS_TYPE_INT64, &position_us, DBUS_TYPE_INVALID);
+        dbus_connection_send(bus, signal, nullptr);
+        dbus_connection_flush(bus);
+        dbus_message_unref(signal);
+    }
+    
+    void handle(DBusMessage* message) {
+        if (dbus_message_get_type(message) != DBUS_MESSAGE_TYPE_METHOD_CALL) return;
+        std::string member = dbus_message_get_member(message);
+        DBusMessage* reply = dbus_message_new_method_return(message);
+        DBusMessageIter iter;
+        dbus_message_iter_init_append(reply, &iter);
+        
+        std::lock_guard<std::mutex> lock(mutex);
+        call_counts[member]++;
+        if (member == "GetAll") {
+            appendProperties(&iter, true, true, true);
+        } else if (member == "Get") {
+            appendVariant(&iter, "x", DBUS_TYPE_INT64, &position_us);  // Position is the only one asked for
+        } else if (member == "Set") {
+            DBusMessageIter args, value;
+            dbus_message_iter_init(message, &args);
+            dbus_message_iter_next(&args);
+            dbus_message_iter_next(&args);
+            dbus_message_iter_recurse(&args, &value);
+            dbus_message_iter_get_basic(&value, &volume);
+            emitChanged(false, false, true);
+        } else if (member == "PlayPause") {
+            playing = !playing;
+            emitChanged(true, false, false);
+        } else if (member == "Next" || member == "Previous") {
+            track = std::max(1, track + (member == "Next" ? 1 : -1));
+            position_us = 0;
+            emitChanged(false, true, false);
+        } else if (member == "Seek") {
+            dbus_int64_t offset = 0;
+            dbus_message_get_args(message, nullptr, DBUS_TYPE_INT64, &offset, DBUS_TYPE_INVALID);
+            position_us = std::max<int64_t>(0, std::min(LENGTH_US, position_us + offset));
+            emitSeeked();
         }
-        
-        // Encoder 2 - Noise reduction
-        uint8_t new2 = readEncoder(2);
-        if (new2 != encoder2_state) {
-            int dir = getDirection(encoder2_state, new2);
-            if (dir != 0) {
-                int val = audio.getNoiseReduction() + dir * 5;
-                audio.setNoiseReduction(std::max(0, std::min(100, val)));
+        dbus_connection_send(bus, reply, nullptr);
+        dbus_connection_flush(bus);
+        dbus_message_unref(reply);
+    }
+    
+    void dispatchLoop() {
+        int fd = -1;
+        dbus_connection_get_unix_fd(bus, &fd);
+        while (running) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            poll(&pfd, 1, 10);  // Short timeout: stop() only flips the flag
+            if (!dbus_connection_read_write(bus, 0)) break;
+            while (DBusMessage* message = dbus_connection_pop_message(bus)) {
+                handle(message);
+                dbus_message_unref(message);
             }
-            encoder2_state = new2;
         }
-        
-        // Buttons - Fixed button reading
-        static bool btn1_last = true, btn2_last = true, pwr_last = true;
-        
-        bool btn1 = bcm2835_gpio_lev(GPIO::ROT1_SW);
-        if (!btn1 && btn1_last) {
-            state.current_viz = (state.current_viz + 1) % 6;
-            if (state.is_sleeping) {
-                state.is_sleeping = false;
-            }
+    }
+    
+public:
+    FakeMPRISPlayer(const std::string& name, const std::string& song_title, bool start_playing)
+        : bus_name(std::string("org.mpris.MediaPlayer2.") + name), song(song_title), bus(nullptr),
+          running(false), playing(start_playing), track(1), position_us(0), volume(0.5) {}
+    
+    ~FakeMPRISPlayer() {
+        stop();
+    }
+    
+    bool start() {
+        DBusError error;
+        dbus_error_init(&error);
+        bus = dbus_bus_get_private(DBUS_BUS_SESSION, &error);
+        if (!bus) {
+            printf("Fake MPRIS player: %s\n", error.message);
+            dbus_error_free(&error);
+            return false;
         }
-        btn1_last = btn1;
-        
-        bool btn2 = bcm2835_gpio_lev(GPIO::ROT2_SW);
-        if (!btn2 && btn2_last) {
-            audio.setSensitivity(100);
-            audio.setNoiseReduction(77);
-            if (state.is_sleeping) {
-                state.is_sleeping = false;
-            }
+        dbus_connection_set_exit_on_disconnect(bus, false);
+        if (dbus_bus_request_name(bus, bus_name.c_str(), DBUS_NAME_FLAG_DO_NOT_QUEUE, &error) !=
+            DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER) {
+            printf("Fake MPRIS player: cannot own %s\n", bus_name.c_str());
+            dbus_error_free(&error);
+            return false;
         }
-        btn2_last = btn2;
-        
-        bool pwr = bcm2835_gpio_lev(GPIO::POWER_SW);
-        if (!pwr && pwr_last) {
-            state.running = false;
+        running = true;
+        dispatch_thread = std::thread(&FakeMPRISPlayer::dispatchLoop, this);
+        return true;
+    }
+    
+    // Closing the connection drops the name, as when a player quits
+    void stop() {
+        running = false;
+        if (dispatch_thread.joinable()) dispatch_thread.join();
+        if (bus) {
+            dbus_connection_close(bus);
+            dbus_connection_unref(bus);
+            bus = nullptr;
         }
-        pwr_last = pwr;
     }
     
-    void setPowerLED(bool on) {
-        bcm2835_gpio_write(GPIO::POWER_LED, on ? HIGH : LOW);
+    // Play or pause from the player's own controls
+    void setPlaying(bool play) {
+        std::lock_guard<std::mutex> lock(mutex);
+        playing = play;
+        emitChanged(true, false, false);
+    }
+    
+    std::string title() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return song + " " + std::to_string(track);
+    }
+    
+    int callCount(const char* method) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = call_counts.find(method);
+        return it == call_counts.end() ? 0 : it->second;
     }
 };
+#endif
 
-ControlHandler* ControlHandler::instance = nullptr;
-
-// Main application with sleep mode and MPD support
-class VisualizerApp {
+// PlayerArbiter over ShairportSource and MPRISSource, against a private
+// dbus-daemon with fake MPRIS players and a temporary metadata FIFO:
+// switching between players, fallback when the shown one stops or leaves,
+// merged transport commands, and event-to-snapshot latency.
+class PlayerBenchmark {
 private:
-    Display* left_display;
-    Display* right_display;
-    AudioProcessor audio;
-    ControlState state;
-    ControlHandler* controls;
-    Visualization* visualizations[6];
-    FontManager font_manager;
-    MPDClient* mpd_client;
+    using Clock = std::chrono::steady_clock;
     
-    void setSPISpeedSlow() {
-    bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_256);  // Slower for sleep
+    static int failures;
+    
+    // Time from `start` until the condition holds, reported as one check
+    template <typename Condition>
+    static bool check(const char* name, Condition condition, Clock::time_point start = Clock::now()) {
+        double ms = MPDBenchmark::waitFor(condition, start);
+        if (ms < 0) {
+            printf("  %-44s FAILED\n", name);
+            failures++;
+            return false;
+        }
+        printf("  %-44s %7.2f ms\n", name, ms);
+        return true;
     }
     
-    void setSPISpeedNormal() {
-        bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);   // Normal speed
+    static std::string base64(const std::string& data) {
+        static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::string out;
+        for (size_t i = 0; i < data.size(); i += 3) {
+            uint32_t bits = (uint8_t)data[i] << 16;
+            if (i + 1 < data.size()) bits |= (uint8_t)data[i + 1] << 8;
+            if (i + 2 < data.size()) bits |= (uint8_t)data[i + 2];
+            out += alphabet[bits >> 18];
+            out += alphabet[(bits >> 12) & 63];
+            out += i + 1 < data.size() ? alphabet[(bits >> 6) & 63] : '=';
+            out += i + 2 < data.size() ? alphabet[bits & 63] : '=';
+        }
+        return out;
     }
     
-public:
-    VisualizerApp() : left_display(nullptr), right_display(nullptr), 
-                      controls(nullptr), mpd_client(nullptr) {
-        
-        // Initialize BCM2835
-        if (!bcm2835_init()) {
-            printf("Failed to init BCM2835\n");
-            exit(1);
+    // One metadata item as shairport-sync writes it, base64 wrapped at 60 columns
+    static std::string item(const char* type, const char* code, const std::string& data = "") {
+        char header[128];
+        snprintf(header, sizeof(header), "<item><type>%02x%02x%02x%02x</type><code>%02x%02x%02x%02x</code><length>%zu</length>",
+                 type[0], type[1], type[2], type[3], code[0], code[1], code[2], code[3], data.size());
+        std::string text = header;
+        if (!data.empty()) {
+            std::string encoded = base64(data);
+            text += "\n<data encoding=\"base64\">\n";
+            for (size_t i = 0; i < encoded.size(); i += 60) text += encoded.substr(i, 60) + "\n";
+            text += "</data>";
         }
-        
-        if (!bcm2835_spi_begin()) {
-            printf("Failed to init SPI\n");
-            bcm2835_close();
-            exit(1);
+        return text + "</item>\n";
+    }
+    
+    static bool writeAll(int fd, const std::string& data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t got = write(fd, data.data() + done, data.size() - done);
+            if (got < 0 && errno == EAGAIN) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (got <= 0) return false;
+            done += got;
         }
-        
-        bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);
-        bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);
-        bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);
-        
-        // Initialize displays
-        left_display = new Display(GPIO::LEFT_CS, GPIO::LEFT_DC, GPIO::LEFT_RST);
-        right_display = new Display(GPIO::RIGHT_CS, GPIO::RIGHT_DC, GPIO::RIGHT_RST);
-        
-        if (!left_display->begin() || !right_display->begin()) {
-            printf("Failed to init displays\n");
-            exit(1);
+        return true;
+    }
+    
+#ifndef AAV_NO_MPRIS
+    // Private session bus for the run; its pid, or -1
+    static pid_t startBus() {
+        FILE* daemon = popen("dbus-daemon --session --fork --print-address=1 --print-pid=1 2>/dev/null", "r");
+        if (!daemon) return -1;
+        char address[512] = "", pid[32] = "";
+        bool ok = fgets(address, sizeof(address), daemon) && fgets(pid, sizeof(pid), daemon);
+        pclose(daemon);
+        if (!ok) return -1;
+        address[strcspn(address, "\n")] = '\0';
+        setenv("DBUS_SESSION_BUS_ADDRESS", address, 1);
+        return (pid_t)atoi(pid);
+    }
+#endif
+    
+    static void runChecks(const char* fifo_path) {
+        PlayerArbiter players;
+        players.addSource(std::unique_ptr<PlayerSource>(new ShairportSource(fifo_path)));
+#ifndef AAV_NO_MPRIS
+        FakeMPRISPlayer first("aavbench.first", "Song A", false);
+        if (!first.start()) {
+            failures++;
+            return;
         }
+        players.addSource(std::unique_ptr<PlayerSource>(new MPRISSource()));
+#endif
+        players.start();
         
-        // Initialize font manager
-        const char* font_paths[] = {
-            "./trixel-square.ttf",
-            "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
-            "/usr/share/fonts/truetype/liberation/LiberationSans-Regular.ttf",
-            nullptr
+        auto shown = [&](const char* source, const std::string& title) {
+            return std::string(players.name()) == source && players.getMetadata()->title == title;
         };
-        
-        bool font_loaded = false;
-        for (int i = 0; font_paths[i] && !font_loaded; i++) {
-            if (font_manager.init(font_paths[i])) {
-                font_loaded = true;
-                left_display->setFont(&font_manager);
-                right_display->setFont(&font_manager);
-                printf("Using TTF font: %s\n", font_paths[i]);
-            }
+        auto state = [&] { return players.getPlayback() ? players.getPlayback()->state : MPD_STATE_UNKNOWN; };
+        
+        printf("Switching and fallback:\n");
+        auto start = Clock::now();
+#ifndef AAV_NO_MPRIS
+        first.setPlaying(true);
+        check("MPRIS player starts playing", [&] { return shown("MPRIS", "Song A 1") && state() == MPD_STATE_PLAY; },
+              start);
+#endif
+        
+        // The reader opens the FIFO on its own thread
+        int fifo = -1;
+        MPDBenchmark::waitFor([&] { return (fifo = open(fifo_path, O_WRONLY | O_NONBLOCK | O_CLOEXEC)) >= 0; });
+        if (fifo < 0) {
+            printf("  shairport-sync reader never opened %s\n", fifo_path);
+            failures++;
+            players.stop();
+            return;
         }
         
-        if (!font_loaded) {
-            printf("WARNING: No TTF font found. Text will not be displayed.\n");
-            printf("Please install fonts or place a .ttf file in current directory.\n");
+        std::string session = item("ssnc", "pbeg") + item("ssnc", "mdst") + item("core", "minm", "Air Song") +
+                              item("core", "asar", "Air Artist") + item("core", "asal", "Air Album") +
+                              item("core", "astn", std::string("\x00\x07", 2)) + item("ssnc", "mden") +
+                              item("ssnc", "prgr", "4294960000/4295000000/4300000000") +
+                              item("ssnc", "pvol", "-15.00,50.00,0.00,100.00");
+        start = Clock::now();
+        writeAll(fifo, session.substr(0, 37));  // Split inside an item, as pipe reads can be
+        writeAll(fifo, session.substr(37));
+        check("AirPlay session takes over", [&] {
+            auto status = players.getPlayback();
+            return shown("AirPlay", "Air Song") && status && status->volume == 50;
+        }, start);
+        
+        std::vector<uint8_t> cover = MPDBenchmark::makeCover();
+        start = Clock::now();
+        writeAll(fifo, item("ssnc", "PICT", std::string(cover.begin(), cover.end())));
+        check("AirPlay cover (PICT) decoded", [&] {
+            auto art = players.getAlbumArt();
+            return art && art->song_id == players.getMetadata()->song_id && art->present;
+        }, start);
+        
+        start = Clock::now();
+        writeAll(fifo, item("ssnc", "pend"));
+#ifndef AAV_NO_MPRIS
+        check("AirPlay ends, back to the playing player", [&] { return shown("MPRIS", "Song A 1"); }, start);
+        
+        FakeMPRISPlayer second("aavbench.second", "Song B", true);
+        start = Clock::now();
+        if (second.start()) {
+            check("Second player appears playing", [&] { return shown("MPRIS", "Song B 1"); }, start);
         }
-        
-        // Initialize MPD client
-        printf("Initializing MPD client...\n");
-        mpd_client = new MPDClient("localhost", 6600);
-        mpd_client->start();
-        
-        // Create visualizations - all with MPD support except VU Meter
-        visualizations[0] = new VUMeterVisualization(left_display, right_display);
-        visualizations[1] = new SpectrumVisualizationMPD(left_display, right_display, 
-                                                        mpd_client, &font_manager);
-        visualizations[2] = new EmptySpectrumVisualizationMPD(left_display, right_display, 
-                                                        mpd_client, &font_manager);
-        visualizations[3] = new TeubSpectrumVisualizationMPD(left_display, right_display, 
-                                                        mpd_client, &font_manager);
-        visualizations[4] = new WaveformVisualizationMPD(left_display, right_display,
-                                                        mpd_client, &font_manager);
-        visualizations[5] = new StereoFieldVisualizationMPD(left_display, right_display,
-                                                            mpd_client, &font_manager);
-        
-        // Initialize controls last
-        controls = new ControlHandler(state, audio);
-        
-        printf("Initialization complete\n");
-    }
-    
-    ~VisualizerApp() {
-        printf("Shutting down...\n");
-        
-        // Clean up in reverse order
-        if (controls) delete controls;
-        if (mpd_client) {
-            mpd_client->stop();
-            delete mpd_client;
+        start = Clock::now();
+        second.stop();
+        check("Second player quits, back to the first", [&] { return shown("MPRIS", "Song A 1"); }, start);
+        
+        printf("\nTransport commands through the arbiter:\n");
+        int sets_before = first.callCount("Set");
+        start = Clock::now();
+        for (int i = 0; i < 5; i++) players.changeVolume(2);
+        if (check("5 volume steps, 50 -> 60", [&] { return players.getPlayback()->volume == 60; }, start)) {
+            printf("  %-44s %7d\n", "  Volume Set calls", first.callCount("Set") - sets_before);
         }
         
-        for (int i = 0; i < 5; i++) {
-            if (visualizations[i]) delete visualizations[i];
+        start = Clock::now();
+        uint64_t sequence = players.togglePause();
+        check("Pause, acknowledged", [&] {
+            auto status = players.getPlayback();
+            return status->state == MPD_STATE_PAUSE && status->commands_done >= sequence;
+        }, start);
+        
+        start = Clock::now();
+        players.skipTracks(2);
+        check("Skip 2 tracks", [&] { return players.getMetadata()->title == "Song A 3"; }, start);
+        
+        start = Clock::now();
+        players.seekBy(10.0f);
+        check("Seek +10 s", [&] { return players.getPlayback()->elapsed_ms == 10000; }, start);
+        
+        printf("\nPlayer event to published snapshot:\n");
+        std::vector<double> samples;
+        bool play = true;
+        for (int i = 0; i < 100; i++) {
+            uint64_t before = players.getPlaybackVersion();
+            start = Clock::now();
+            first.setPlaying(play);
+            play = !play;
+            double ms = MPDBenchmark::waitFor([&] { return players.getPlaybackVersion() != before; }, start);
+            if (ms < 0) {
+                printf("  MPRIS PlaybackStatus: event lost\n");
+                failures++;
+                break;
+            }
+            samples.push_back(ms);
         }
-        
-        if (left_display) delete left_display;
-        if (right_display) delete right_display;
-        
-        bcm2835_spi_end();
-        bcm2835_close();
-    }
-    
-void run() {
-    printf("Dual OLED Audio Visualizer with MPD Support\n");
-    printf("===========================================\n");
-    printf("Rotary 1: Sensitivity | Rotary 2: Smoothing\n");
-    printf("Press Rotary 1 to switch visualization\n");
-    printf("Press Rotary 2 to reset settings\n");
-    printf("Power button to exit\n");
-    printf("Sleep mode after 10 seconds of silence\n\n");
-    
-    if (!audio.start()) {
-        printf("Failed to init audio. Make sure ALSA is configured properly.\n");
-        printf("Try: sudo modprobe snd-aloop\n");
-        return;
+        if (samples.size() == 100) MPDBenchmark::report("MPRIS PlaybackStatus", samples);
+#else
+        check("AirPlay ends, stopped", [&] { return state() == MPD_STATE_STOP; }, start);
+#endif
+        
+        close(fifo);
+        start = Clock::now();
+        players.stop();
+        printf("\nSources stop: %.2f ms\n\n", std::chrono::duration<double, std::milli>(Clock::now() - start).count());
     }
     
-    int current_viz = 0;
-    
-    while (state.running) {
-        controls->poll();
-        
-        // Check for audio and handle sleep mode
-        bool has_audio = audio.checkForAudio();
-        
-        if (!has_audio && !state.is_sleeping) {
-            // Enter sleep mode
-            printf("Entering sleep mode - no audio detected\n");
-            state.is_sleeping = true;
-            
-            // Notify audio processor about sleep state
-            audio.setSleepState(true);
-            
-            // Notify MPD client about sleep state
-            if (mpd_client) {
-                mpd_client->setSleepState(true);
-            }
-            
-            // Just turn off displays and LED
-            left_display->sleep();
-            right_display->sleep();
-            controls->setPowerLED(false);
-            
-            // Reduce SPI speed for lower power consumption
-            setSPISpeedSlow();
-
-            
-        } else if (has_audio && state.is_sleeping) {
-            // Wake up
-            printf("Waking up - audio detected\n");
-            state.is_sleeping = false;
-            
-            // Restore normal SPI speed
-            setSPISpeedNormal();
-            
-            // Notify audio processor about wake state
-            audio.setSleepState(false);
-            
-            // Notify MPD client about wake state
-            if (mpd_client) {
-                mpd_client->setSleepState(false);
-            }
-            
-            left_display->wake();
-            right_display->wake();
-            controls->setPowerLED(true);
-            
-            // Clear and redraw
-            left_display->clear();
-            right_display->clear();
-            left_display->display();
-            right_display->display();
+public:
+    static int run() {
+        printf("AAV player sources benchmark (private D-Bus daemon, metadata FIFO)\n");
+        printf("==================================================================\n\n");
+        
+        char fifo_path[64];
+        snprintf(fifo_path, sizeof(fifo_path), "/tmp/aav-bench-shairport-%d", (int)getpid());
+        unlink(fifo_path);
+        if (mkfifo(fifo_path, 0600) != 0) {
+            printf("Cannot create %s: %s\n", fifo_path, strerror(errno));
+            return 1;
         }
         
-        // Handle visualization switching
-        if (state.current_viz != current_viz) {
-            current_viz = state.current_viz;
-            printf("Switched to: %s\n", visualizations[current_viz]->getName());
-            
-            // Clear displays on switch
-            left_display->clear();
-            right_display->clear();
-            left_display->display();
-            right_display->display();
-            
-            // Wake if sleeping
-            if (state.is_sleeping) {
-                state.is_sleeping = false;
-
-                // Restore normal SPI speed
-                setSPISpeedNormal();  
-
-                // Notify audio processor about wake state
-                audio.setSleepState(false); 
-
-                // Notify MPD client about wake state
-                if (mpd_client) {
-                    mpd_client->setSleepState(false);
-                }
-                
-                left_display->wake();
-                right_display->wake();
-                controls->setPowerLED(true);
-            }
+#ifndef AAV_NO_MPRIS
+        pid_t daemon = startBus();
+        if (daemon <= 0) {
+            printf("Cannot start dbus-daemon --session\n");
+            unlink(fifo_path);
+            return 1;
         }
+#endif
         
-        // Render visualization if not sleeping
-        if (!state.is_sleeping) {
-            visualizations[current_viz]->render(state, audio);
-            bcm2835_delay(10);  // ~100 FPS max
-        } else {
-            // During sleep, just poll controls occasionally
-            static int sleep_counter = 0;
-            if (++sleep_counter >= 10) {  // Check controls every second
-                controls->poll();
-                sleep_counter = 0;
-            }
-            bcm2835_delay(100);  // Sleep for 100ms
-        }
-            }
-            
-            printf("\nShutting down...\n");
-            audio.stop();
-            controls->setPowerLED(false);
-            left_display->clear();
-            right_display->clear();
-            left_display->display();
-            right_display->display();
-        }
+        failures = 0;
+        runChecks(fifo_path);
+        
+#ifndef AAV_NO_MPRIS
+        kill(daemon, SIGTERM);
+#endif
+        unlink(fifo_path);
+        printf("%s\n", failures ? "FAILED" : "All checks passed");
+        return failures ? 1 : 0;
+    }
 };
 
+int PlayerBenchmark::failures = 0;
+
 // Signal handler
 VisualizerApp* app = nullptr;
 
@@ -2175,12 +8213,89 @@ void signalHandler(int sig) {
     exit(0);
 }
 
-int main() {
+void printUsage(const char* program) {
+    printf("Usage: %s [--engine=fft|goertzel|iir] [--fft=fftw|q15] [--workers=N] [--fps=N]\n"
+           "       [--players=mpd,mpris,shairport] [--shairport-pipe=PATH]\n"
+           "       [--mpd-fifo=PATH] [--mpd-fifo-format=RATE:BITS:CHANNELS] [--bench]\n"
+           "       [--bench-mpd] [--bench-players]\n", program);
+}
+
+// Comma-separated player sources; an empty list disables player info
+bool parsePlayers(const char* list, std::vector<std::string>& players) {
+    players.clear();
+    std::stringstream ss(list);
+    std::string name;
+    while (std::getline(ss, name, ',')) {
+        if (name.empty()) continue;
+#ifdef AAV_NO_MPRIS
+        if (name == "mpris") {
+            printf("MPRIS support not compiled in (AAV_NO_MPRIS)\n");
+            return false;
+        }
+#endif
+        if (name != "mpd" && name != "mpris" && name != "shairport") {
+            printf("Unknown player source: %s\n", name.c_str());
+            return false;
+        }
+        players.push_back(name);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    AppConfig config;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench") == 0) {
+            return Benchmark::run();
+        } else if (strcmp(argv[i], "--bench-mpd") == 0) {
+            return MPDBenchmark::run();
+        } else if (strcmp(argv[i], "--bench-players") == 0) {
+            return PlayerBenchmark::run();
+        } else if (strncmp(argv[i], "--engine=", 9) == 0) {
+            if (!parseBandEngine(argv[i] + 9, config.band_engine)) {
+                printf("Unknown band engine: %s\n", argv[i] + 9);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--fft=", 6) == 0) {
+            if (!parseFFTKind(argv[i] + 6, config.fft_kind)) {
+                printf("Unknown or unavailable FFT backend: %s\n", argv[i] + 6);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--fps=", 6) == 0) {
+            config.fps = atoi(argv[i] + 6);
+            if (config.fps < 1 || config.fps > 200) {
+                printf("FPS must be between 1 and 200\n");
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--players=", 10) == 0) {
+            if (!parsePlayers(argv[i] + 10, config.players)) return 1;
+        } else if (strncmp(argv[i], "--shairport-pipe=", 17) == 0) {
+            config.shairport_pipe = argv[i] + 17;
+        } else if (strncmp(argv[i], "--mpd-fifo=", 11) == 0) {
+            config.mpd_fifo = argv[i] + 11;
+        } else if (strncmp(argv[i], "--mpd-fifo-format=", 18) == 0) {
+            if (!parsePCMFormat(argv[i] + 18, config.mpd_fifo_format)) {
+                printf("Unsupported fifo format: %s (e.g. 44100:16:2, 48000:24:2, 44100:f:2)\n", argv[i] + 18);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--workers=", 10) == 0) {
+            config.workers = atoi(argv[i] + 10);
+            if (config.workers < 1 || config.workers > 8) {
+                printf("Workers must be between 1 and 8\n");
+                return 1;
+            }
+        } else {
+            printUsage(argv[0]);
+            return 1;
+        }
+    }
+    
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     
     try {
-        app = new VisualizerApp();
+        app = new VisualizerApp(config);
         app->run();
         delete app;
         app = nullptr;